@@ -83,3 +83,12 @@ struct LiverCells {
   SME_BENCHMARK_TEMPLATE(func, ABtoC);                                         \
   SME_BENCHMARK_TEMPLATE(func, VerySimpleModel);                               \
   SME_BENCHMARK_TEMPLATE(func, LiverCells)
+
+// As SME_BENCHMARK, but each benchmark is also run for each integer value
+// from lo to hi of the argument name, supplied as state.range(0)
+#define SME_BENCHMARK_DENSE_RANGE(func, name, lo, hi)                          \
+  SME_BENCHMARK_TEMPLATE(func, ABtoC)->ArgName(name)->DenseRange(lo, hi);      \
+  SME_BENCHMARK_TEMPLATE(func, VerySimpleModel)                                \
+      ->ArgName(name)                                                          \
+      ->DenseRange(lo, hi);                                                    \
+  SME_BENCHMARK_TEMPLATE(func, LiverCells)->ArgName(name)->DenseRange(lo, hi)
@@ -30,6 +30,11 @@ static void printHelpMessage() {
   fmt::print("\n./pixel [integration_order=1] [model=brusselator-model] "
              "[integration_time=10.0] [compartment_index=0] [species_index=0] "
              "[pixel_index=0]\n");
+  fmt::print("\nPossible values for integration_order:\n");
+  fmt::print("  - 1-4: explicit RK of this order\n");
+  fmt::print("  - 5: IMEX Euler\n");
+  fmt::print("  - 6: Rosenbrock Euler\n");
+  fmt::print("  - 7: RKC\n");
   fmt::print("\nPossible values for model:\n");
   for (const auto &model : params.models) {
     fmt::print("  - {}\n", model);
@@ -109,6 +114,12 @@ static void printFixedTimestepPixel(const PixelParams &params) {
       options.pixel.integrator = simulate::PixelIntegratorType::RK323;
     } else if (params.integration_order == 4) {
       options.pixel.integrator = simulate::PixelIntegratorType::RK435;
+    } else if (params.integration_order == 5) {
+      options.pixel.integrator = simulate::PixelIntegratorType::IMEX;
+    } else if (params.integration_order == 6) {
+      options.pixel.integrator = simulate::PixelIntegratorType::Rosenbrock;
+    } else if (params.integration_order == 7) {
+      options.pixel.integrator = simulate::PixelIntegratorType::RKC;
     }
     options.pixel.maxErr = {std::numeric_limits<double>::max(),
                             std::numeric_limits<double>::max()};
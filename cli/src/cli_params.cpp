@@ -31,6 +31,37 @@ static void addParams(CLI::App &app, Params &params) {
                  "The maximum number of CPU threads to use (0 means unlimited)")
       ->check(CLI::NonNegativeNumber)
       ->capture_default_str();
+  app.add_flag("--steady-state", params.steadyState,
+               "Simulate until a steady state is reached. The times are then "
+               "the maximum simulation time, and the image-intervals are the "
+               "interval between steady state checks");
+  app.add_option("--steady-state-tolerance", params.steadyStateTolerance,
+                 "Steady state is reached when the largest |dc/dt| of any "
+                 "species is less than this")
+      ->check(CLI::PositiveNumber)
+      ->capture_default_str();
+  app.add_flag("--newton-polish", params.newtonPolish,
+               "Polish the steady state with a Newton-Krylov solve (pixel "
+               "simulator only)");
+  app.add_option("--out-of-core", params.outOfCoreDirectory,
+                 "Store the simulation results in memory-mapped files in this "
+                 "directory instead of in memory")
+      ->check(CLI::ExistingDirectory);
+  app.add_option("--compression", params.compression.type,
+                 "Compression of the stored simulation results: none, "
+                 "lossless or bounded-error")
+      ->transform(CLI::CheckedTransformer(
+          std::map<std::string, simulate::FrameCompressionType>{
+              {"none", simulate::FrameCompressionType::None},
+              {"lossless", simulate::FrameCompressionType::Lossless},
+              {"bounded-error", simulate::FrameCompressionType::BoundedError}},
+          CLI::ignore_case))
+      ->capture_default_str();
+  app.add_option("--compression-max-error", params.compression.maxError,
+                 "The maximum absolute error of each stored concentration "
+                 "with bounded-error compression")
+      ->check(CLI::PositiveNumber)
+      ->capture_default_str();
 }
 
 static void addCallbacks(CLI::App &app) {
@@ -78,6 +109,21 @@ void printParams(const Params &params) {
   fmt::print("#   - Image Interval(s): {}\n", params.imageIntervals);
   fmt::print("#   - Output file: {}\n", params.outputFile);
   fmt::print("#   - Max CPU threads: {}\n", params.maxThreads);
+  if (!params.outOfCoreDirectory.empty()) {
+    fmt::print("#   - Out-of-core directory: {}\n", params.outOfCoreDirectory);
+  }
+  if (params.compression.type == simulate::FrameCompressionType::Lossless) {
+    fmt::print("#   - Compression: lossless\n");
+  } else if (params.compression.type ==
+             simulate::FrameCompressionType::BoundedError) {
+    fmt::print("#   - Compression: max error {}\n",
+               params.compression.maxError);
+  }
+  if (params.steadyState) {
+    fmt::print("#   - Steady state tolerance: {}\n",
+               params.steadyStateTolerance);
+    fmt::print("#   - Newton-Krylov polish: {}\n", params.newtonPolish);
+  }
 }
 
 } // namespace sme::cli
@@ -12,6 +12,11 @@ struct Params {
   simulate::SimulatorType simType{simulate::SimulatorType::DUNE};
   std::string outputFile{};
   std::size_t maxThreads{0};
+  bool steadyState{false};
+  double steadyStateTolerance{1e-6};
+  bool newtonPolish{false};
+  std::string outOfCoreDirectory{};
+  simulate::FrameCompression compression{};
 };
 
 Params setupCLI(CLI::App &app);
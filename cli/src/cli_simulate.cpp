@@ -52,6 +52,11 @@ bool doSimulation(const Params &params) {
   if (params.maxThreads == 1) {
     options.pixel.enableMultiThreading = false;
   }
+  auto &concentration{s.getSimulationData().concentration};
+  concentration.setCompression(params.compression);
+  if (!params.outOfCoreDirectory.empty()) {
+    concentration.setDiskBacked(params.outOfCoreDirectory);
+  }
   simulate::Simulation sim(s);
   if (const auto &e = sim.errorMessage(); !e.empty()) {
     fmt::print("\n\nError in simulation setup: {}\n\n", e);
@@ -60,11 +65,31 @@ bool doSimulation(const Params &params) {
 
   printSimulationInfo(s);
 
-  sim.doMultipleTimesteps(times.value());
+  if (params.steadyState) {
+    // times: maximum simulation time, first interval: time between checks
+    simulate::SteadyStateOptions steadyStateOptions;
+    steadyStateOptions.tolerance = params.steadyStateTolerance;
+    steadyStateOptions.checkInterval = times->front().second;
+    steadyStateOptions.maxTime = 0;
+    for (auto [n, l] : times.value()) {
+      steadyStateOptions.maxTime += static_cast<double>(n) * l;
+    }
+    steadyStateOptions.newtonPolish = params.newtonPolish;
+    auto result{sim.doSteadyState(steadyStateOptions)};
+    fmt::print("\n# Steady state {} at t={}, max |dc/dt| = {}\n",
+               result.converged ? "reached" : "not reached",
+               sim.getTimePoints().back(), result.maxAbsDcdt);
+  } else {
+    sim.doMultipleTimesteps(times.value());
+  }
   if (const auto &e = sim.errorMessage(); !e.empty()) {
     fmt::print("\n\nError during simulation: {}\n\n", e);
     return false;
   }
+  if (params.compression.type != simulate::FrameCompressionType::None) {
+    fmt::print("\n# Simulation results compression ratio: {:.2f}\n",
+               concentration.getCompressionRatio());
+  }
   s.exportSMEFile(params.outputFile);
   return true;
 }
@@ -1,6 +1,7 @@
 #include "catch_wrapper.hpp"
 #include "cli_simulate.hpp"
 #include "sme/model.hpp"
+#include "sme/simulate.hpp"
 #include <QFile>
 
 using namespace sme;
@@ -51,4 +52,56 @@ TEST_CASE("CLI Simulate", "[cli][simulate]") {
     REQUIRE(m2.getSimulationData().timePoints.size() == 13);
     REQUIRE(m2.getSimulationData().timePoints[12] == dbl_approx(1.20));
   }
+  SECTION("Steady state, pixel sim") {
+    cli::Params params;
+    params.inputFile = tmpInputFile;
+    params.simulationTimes = "3";
+    params.imageIntervals = "1";
+    params.outputFile = tmpOutputFile;
+    params.simType = simulate::SimulatorType::Pixel;
+    params.steadyState = true;
+    SECTION("not reached: one timepoint per check until the max time") {
+      params.steadyStateTolerance = 0.0;
+      REQUIRE(doSimulation(params));
+      model::Model m;
+      m.importFile(tmpOutputFile);
+      const auto &data{m.getSimulationData()};
+      REQUIRE(data.timePoints.size() == 4);
+      REQUIRE(data.timePoints[0] == dbl_approx(0.0));
+      REQUIRE(data.timePoints[1] == dbl_approx(1.0));
+      REQUIRE(data.timePoints[2] == dbl_approx(2.0));
+      REQUIRE(data.timePoints[3] == dbl_approx(3.0));
+      REQUIRE(data.concentration.size() == 4);
+    }
+    SECTION("reached at the first check, then Newton-Krylov polish") {
+      // max |dc/dt| at the last timepoint of the output file, evaluated by
+      // continuing the simulation from it
+      auto getMaxAbsDcdt{[tmpOutputFile]() {
+        model::Model m;
+        m.importFile(tmpOutputFile);
+        simulate::Simulation sim(m);
+        return sim.getMaxAbsDcdt();
+      }};
+      params.steadyStateTolerance = 1e300;
+      REQUIRE(doSimulation(params));
+      const double maxAbsDcdt{getMaxAbsDcdt()};
+      REQUIRE(maxAbsDcdt > 0.0);
+      params.newtonPolish = true;
+      REQUIRE(doSimulation(params));
+      model::Model m;
+      m.importFile(tmpOutputFile);
+      const auto &data{m.getSimulationData()};
+      REQUIRE(data.timePoints.size() == 2);
+      REQUIRE(data.timePoints[0] == dbl_approx(0.0));
+      REQUIRE(data.timePoints[1] == dbl_approx(1.0));
+      // the polished concentrations replace the last timepoint
+      REQUIRE(data.concentration.size() == 2);
+      const auto c0{data.concentration[0]};
+      const auto c1{data.concentration[1]};
+      REQUIRE(c1.size() == c0.size());
+      REQUIRE(c1[0].size() == c0[0].size());
+      // and never increase the largest |dc/dt|
+      REQUIRE(getMaxAbsDcdt() <= maxAbsDcdt);
+    }
+  }
 }
@@ -47,7 +47,11 @@ public:
   Symbolic &operator=(const Symbolic &) = delete;
   ~Symbolic();
   static const char *getLLVMVersion();
-  void compile(bool doCSE = true, unsigned optLevel = 3);
+  // if batchSize > 1, also compile a function that evaluates the expressions
+  // at batchSize points in a single call, which is used by the multi-point
+  // eval
+  void compile(bool doCSE = true, unsigned optLevel = 3,
+               std::size_t batchSize = 1);
   [[nodiscard]] std::string expr(std::size_t i = 0) const;
   [[nodiscard]] std::string inlinedExpr(std::size_t i = 0) const;
   [[nodiscard]] std::string diff(const std::string &var,
@@ -57,6 +61,11 @@ public:
   void eval(std::vector<double> &results,
             const std::vector<double> &vars = {}) const;
   void eval(double *results, const double *vars) const;
+  // evaluate at n points: the variables for point i start at
+  // vars[i * nVariables], and the results at results[i * nExpressions].
+  // Points are evaluated batchSize at a time, and any remaining points one at
+  // a time
+  void eval(double *results, const double *vars, std::size_t n) const;
   [[nodiscard]] bool isValid() const;
   [[nodiscard]] bool isCompiled() const;
   [[nodiscard]] const std::string &getErrorMessage() const;
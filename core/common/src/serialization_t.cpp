@@ -137,6 +137,29 @@ TEST_CASE("Serialization",
     const auto &s{m2.getSimulationSettings()};
     REQUIRE(s.options.pixel.maxErr.rel == dbl_approx(0.005));
   }
+  SECTION("compressed simulation data roundtrip") {
+    common::SmeFileContents contents;
+    contents.xmlModel = "model";
+    contents.simulationData = std::make_unique<simulate::SimulationData>();
+    auto &data{*contents.simulationData};
+    data.concentration.setCompression(
+        {simulate::FrameCompressionType::BoundedError, 1e-8});
+    for (std::size_t i = 0; i < 20; ++i) {
+      auto t{static_cast<double>(i)};
+      data.timePoints.push_back(t);
+      data.concentration.push_back({{t, 0.5 * t, 1.0}, {-t}});
+    }
+    REQUIRE(common::exportSmeFile("compressed.sme", contents));
+    auto imported{common::importSmeFile("compressed.sme")};
+    REQUIRE(imported != nullptr);
+    const auto &c{imported->simulationData->concentration};
+    REQUIRE(c.getCompression().type ==
+            simulate::FrameCompressionType::BoundedError);
+    REQUIRE(c.getCompression().maxError == dbl_approx(1e-8));
+    REQUIRE(c.size() == 20);
+    REQUIRE(c[13][0][1] == Catch::Approx(6.5).margin(1e-8));
+    REQUIRE(c[19][1][0] == Catch::Approx(-19.0).margin(1e-8));
+  }
   SECTION("settings xml roundtrip") {
     sme::model::Settings s{};
     s.simulationSettings.times = {{1, 0.3}, {2, 0.1}};
@@ -30,6 +30,9 @@ Symbolic::SymEngineFunc::SymEngineFunc(const SymbolicFunction &symbolicFunction)
 
 struct Symbolic::SymEngineWrapper {
   LLVMDoubleVisitor lambdaLLVM{};
+  // batchSize copies of the expressions, each with its own variables
+  LLVMDoubleVisitor lambdaLLVMBatch{};
+  std::size_t batchSize{1};
   vec_basic exprInlined{};
   vec_basic exprOriginal{};
   vec_basic varVec{};
@@ -158,10 +161,11 @@ Symbolic &Symbolic::operator=(Symbolic &&) noexcept = default;
 
 const char *Symbolic::getLLVMVersion() { return LLVM_VERSION_STRING; }
 
-void Symbolic::compile(bool doCSE, unsigned optLevel) {
+void Symbolic::compile(bool doCSE, unsigned optLevel, std::size_t batchSize) {
   if (!valid) {
     return;
   }
+  se->batchSize = std::max(batchSize, std::size_t{1});
   SPDLOG_DEBUG("compiling expression:");
 #if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
   if (se->varVec.size() == se->exprInlined.size()) {
@@ -173,6 +177,26 @@ void Symbolic::compile(bool doCSE, unsigned optLevel) {
 #endif
   try {
     se->lambdaLLVM.init(se->varVec, se->exprInlined, doCSE, optLevel);
+    if (se->batchSize > 1) {
+      // the copies are independent, so LLVM is free to interleave or
+      // vectorize them, and there is a single call for the whole batch
+      vec_basic batchVars;
+      vec_basic batchExprs;
+      batchVars.reserve(se->batchSize * se->varVec.size());
+      batchExprs.reserve(se->batchSize * se->exprInlined.size());
+      for (std::size_t k = 0; k < se->batchSize; ++k) {
+        map_basic_basic d;
+        for (const auto &v : se->varVec) {
+          auto vk{dummy(sbml(*v))};
+          d[v] = vk;
+          batchVars.push_back(vk);
+        }
+        for (const auto &e : se->exprInlined) {
+          batchExprs.push_back(e->xreplace(d));
+        }
+      }
+      se->lambdaLLVMBatch.init(batchVars, batchExprs, doCSE, optLevel);
+    }
   } catch (const std::exception &e) {
     // if SymEngine failed to compile, capture error message
     SPDLOG_WARN("{}", e.what());
@@ -230,7 +254,7 @@ void Symbolic::relabel(const std::vector<std::string> &newVariables) {
   std::swap(se->varVec, newVarVec);
   std::swap(se->symbols, newSymbols);
   if (compiled) {
-    compile(true, 3);
+    compile(true, 3, se->batchSize);
   }
 }
 
@@ -257,7 +281,7 @@ void Symbolic::rescale(double factor,
     SPDLOG_DEBUG("  -> '{}'", sbml(*e));
   }
   if (compiled) {
-    compile(true, 3);
+    compile(true, 3, se->batchSize);
   }
 }
 
@@ -270,6 +294,23 @@ void Symbolic::eval(double *results, const double *vars) const {
   se->lambdaLLVM.call(results, vars);
 }
 
+void Symbolic::eval(double *results, const double *vars, std::size_t n) const {
+  const std::size_t nResults{se->exprInlined.size()};
+  const std::size_t nVars{se->varVec.size()};
+  const std::size_t batchSize{se->batchSize};
+  std::size_t i{0};
+  if (batchSize > 1) {
+    const auto &fBatch{se->lambdaLLVMBatch};
+    for (; i + batchSize <= n; i += batchSize) {
+      fBatch.call(results + i * nResults, vars + i * nVars);
+    }
+  }
+  const auto &f{se->lambdaLLVM};
+  for (; i < n; ++i) {
+    f.call(results + i * nResults, vars + i * nVars);
+  }
+}
+
 bool Symbolic::isValid() const { return valid; }
 
 bool Symbolic::isCompiled() const { return compiled; }
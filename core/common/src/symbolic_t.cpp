@@ -199,6 +199,24 @@ TEST_CASE("Symbolic", "[core/common/symbolic][core/common][core][symbolic]") {
         }
       }
     }
+    // evaluate multiple points
+    std::vector<double> vars{-0.1, -0.11, -0.12, 0.69, 34,  31,
+                             23e-7, 0.9,  0.89,  4.188e5, 29e-7, 37e-7};
+    std::vector<double> results(8, 0);
+    sym.eval(results.data(), vars.data(), 4);
+    for (std::size_t i = 0; i < 4; ++i) {
+      sym.eval(res, {vars[3 * i], vars[3 * i + 1], vars[3 * i + 2]});
+      REQUIRE(results[2 * i] == dbl_approx(res[0]));
+      REQUIRE(results[2 * i + 1] == dbl_approx(res[1]));
+    }
+    // evaluate multiple points in batches of 3: one batch, then one point
+    sym.compile(true, 3, 3);
+    REQUIRE(sym.isCompiled() == true);
+    std::vector<double> batchResults(8, 0);
+    sym.eval(batchResults.data(), vars.data(), 4);
+    for (std::size_t i = 0; i < 8; ++i) {
+      REQUIRE(batchResults[i] == dbl_approx(results[i]));
+    }
   }
   SECTION("exponentiale^(4*x): print exponential function") {
     std::string expr{"exponentiale^(4*x)"};
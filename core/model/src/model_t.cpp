@@ -889,8 +889,14 @@ TEST_CASE("SBML: load .xml model, simulate, save as .sme, load .sme",
   REQUIRE(s.getXml() == s2.getXml());
   REQUIRE(s2.getSimulationData().timePoints.size() == 3);
   REQUIRE(s2.getSimulationData().timePoints[2] == dbl_approx(0.2));
-  REQUIRE(s2.getSimulationData().concPadding.size() == 3);
-  REQUIRE(s2.getSimulationData().concPadding[2] == dbl_approx(0));
+  REQUIRE(s2.getSimulationData().concentration.size() == 3);
+  // stored concentrations only contain the species at each pixel
+  const auto frame{s2.getSimulationData().concentration[2]};
+  const auto &avgMinMax{s2.getSimulationData().avgMinMax[2]};
+  for (std::size_t ic = 0; ic < frame.size(); ++ic) {
+    REQUIRE(frame[ic].size() ==
+            avgMinMax[ic].size() * sim.getConc(2, ic, 0).size());
+  }
   model::Model s3;
   s3.importFile("tmpmodelsmetest.sme");
   // do something that causes ModelCompartments to clear the simulation results
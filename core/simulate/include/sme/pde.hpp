@@ -67,6 +67,8 @@ private:
   std::vector<std::vector<double>> M;
   // vector of maps of constants
   std::vector<std::vector<std::pair<std::string, double>>> constants;
+  // number of global constants at the start of each map of constants
+  std::size_t nGlobalConstants{0};
   std::vector<double> getStoichMatrixRow(const model::Model *doc,
                                          const std::string &reacId) const;
 
@@ -79,6 +81,9 @@ public:
                                         std::size_t reactionIndex) const;
   [[nodiscard]] const std::vector<std::pair<std::string, double>> &
   getConstants(std::size_t reactionIndex) const;
+  // the constants of each reaction are the global constants, followed by the
+  // local parameters of the reaction
+  [[nodiscard]] std::size_t getNumberOfGlobalConstants() const;
   Reaction(const model::Model *doc, std::vector<std::string> species,
            const std::vector<std::string> &reactionIDs);
 };
@@ -6,6 +6,7 @@
 #include "sme/simulate_data.hpp"
 #include "sme/simulate_options.hpp"
 #include <QImage>
+#include <QPoint>
 #include <QRgb>
 #include <QSize>
 #include <atomic>
@@ -14,6 +15,7 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 #include <vector>
@@ -37,6 +39,29 @@ struct SimEvent {
   std::vector<std::string> ids;
 };
 
+struct SteadyStateOptions {
+  // converged when the largest |dc/dt| of any species is less than this
+  double tolerance{1e-6};
+  // simulation time between convergence checks, the concentrations are
+  // stored at each check
+  double checkInterval{1.0};
+  // give up if not converged after this much simulation time
+  double maxTime{1e3};
+  // polish the result with a Newton-Krylov solve (pixel simulator only)
+  bool newtonPolish{false};
+  // Newton-Krylov stops when the largest |dc/dt| is less than this
+  double newtonTolerance{1e-10};
+  std::size_t maxNewtonIterations{50};
+};
+
+struct SteadyStateResult {
+  bool converged{false};
+  // largest |dc/dt| of any species at the end of the solve
+  double maxAbsDcdt{std::numeric_limits<double>::max()};
+  // number of Newton iterations done when polishing the result
+  std::size_t newtonIterations{0};
+};
+
 class Simulation {
 private:
   std::unique_ptr<BaseSim> simulator;
@@ -51,6 +76,16 @@ private:
   model::Model &model;
   model::SimulationSettings *settings;
   SimulationData *data;
+  EnsembleParameters ensemble;
+  // results of ensemble members 1, 2, ... (member 0 is stored in data)
+  std::vector<SimulationData> ensembleData;
+  // empty until enabled, then compartment->index, each built on the first
+  // time series query for its compartment and kept updated after that
+  mutable std::vector<std::unique_ptr<TimeTraceIndex>> timeTraceIndices;
+  // guards timeTraceIndices, and keeps them in sync with data->concentration
+  mutable std::mutex timeTraceIndexMutex;
+  // incremented when a stored timepoint is removed or replaced
+  std::size_t timeTraceIndexRemovals{0};
   QSize imageSize;
   std::atomic<bool> isRunning{false};
   std::atomic<bool> stopRequested{false};
@@ -60,9 +95,15 @@ private:
   void initEvents();
   void applyNextEvent();
   void updateConcentrations(double t);
+  void updateConcentrations(double t, SimulationData &d, std::size_t member);
+  // remove the last timepoint of data, and of the time trace indices
+  void popBackConcentrations();
 
 public:
-  explicit Simulation(model::Model &model);
+  // if ensembleParameters is not empty, each ensemble member is simulated
+  // with its own parameter set in a single pixel simulation
+  explicit Simulation(model::Model &model,
+                      EnsembleParameters ensembleParameters = {});
   ~Simulation();
 
   std::size_t doTimesteps(double time, std::size_t nSteps = 1,
@@ -71,23 +112,52 @@ public:
       const std::vector<std::pair<std::size_t, double>> &timesteps,
       double timeout_ms = -1.0,
       const std::function<bool()> &stopRunningCallback = {});
+  // simulate until the largest |dc/dt| is less than the tolerance, or until
+  // the maximum time is reached
+  SteadyStateResult
+  doSteadyState(const SteadyStateOptions &options, double timeout_ms = -1.0,
+                const std::function<bool()> &stopRunningCallback = {});
+  // largest |dc/dt| of any species at the current concentrations, including
+  // the diffusion term, at every pixel (for the pixel simulator, otherwise
+  // estimated from the last two timepoints)
+  double getMaxAbsDcdt();
   [[nodiscard]] const std::string &errorMessage() const;
   [[nodiscard]] const QImage &errorImage() const;
+  // statistics of all timesteps done so far (pixel simulator only)
+  [[nodiscard]] const TimestepStatistics &getTimestepStatistics() const;
   [[nodiscard]] const std::vector<std::string> &getCompartmentIds() const;
   [[nodiscard]] const std::vector<std::string> &
   getSpeciesIds(std::size_t compartmentIndex) const;
   [[nodiscard]] const std::vector<QRgb> &
   getSpeciesColors(std::size_t compartmentIndex) const;
-  [[nodiscard]] const std::vector<double> &getTimePoints() const;
+  [[nodiscard]] const AppendOnlyVector<double> &getTimePoints() const;
   [[nodiscard]] const AvgMinMax &getAvgMinMax(std::size_t timeIndex,
                                               std::size_t compartmentIndex,
                                               std::size_t speciesIndex) const;
   [[nodiscard]] std::vector<double> getConc(std::size_t timeIndex,
                                             std::size_t compartmentIndex,
                                             std::size_t speciesIndex) const;
+  // number of ensemble members, 1 if this is not an ensemble simulation
+  [[nodiscard]] std::size_t getEnsembleSize() const;
+  // concentrations of an ensemble member, member 0 is the same as getConc
+  [[nodiscard]] std::vector<double>
+  getEnsembleConc(std::size_t member, std::size_t timeIndex,
+                  std::size_t compartmentIndex,
+                  std::size_t speciesIndex) const;
   [[nodiscard]] std::vector<double>
   getConcArray(std::size_t timeIndex, std::size_t compartmentIndex,
                std::size_t speciesIndex) const;
+  // index the concentrations of a compartment by pixel on the first
+  // getPixelTimeSeries call for it, and keep the index updated as timepoints
+  // are added, to make later calls fast (the index is compressed if the
+  // stored concentrations are)
+  void enableTimeTraceIndex();
+  [[nodiscard]] bool getTimeTraceIndexEnabled() const;
+  // the concentration of a species at each timepoint for each point
+  // (zero for points outside the compartment): point->time
+  [[nodiscard]] std::vector<std::vector<double>>
+  getPixelTimeSeries(std::size_t compartmentIndex, std::size_t speciesIndex,
+                     const std::vector<QPoint> &points) const;
   void applyConcsToModel(model::Model &m, std::size_t timeIndex) const;
   [[nodiscard]] std::vector<double> getDcdt(std::size_t compartmentIndex,
                                             std::size_t speciesIndex) const;
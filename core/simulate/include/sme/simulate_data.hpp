@@ -5,22 +5,343 @@
 #include "sme/simulate_options.hpp"
 #include <cereal/cereal.hpp>
 #include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
 namespace sme::simulate {
 
+// a vector whose elements never move: they are stored in segments of
+// increasing size that are never reallocated. A single writer can append
+// elements while other threads read the existing elements without locking.
+// Removing elements is not safe while other threads may be reading them
+template <typename T> class AppendOnlyVector {
+private:
+  // segment k holds (firstSegmentSize << k) elements
+  static constexpr std::size_t log2FirstSegmentSize{5};
+  static constexpr std::size_t firstSegmentSize{std::size_t{1}
+                                                << log2FirstSegmentSize};
+  static constexpr std::size_t maxSegments{40};
+  std::array<std::atomic<T *>, maxSegments> segments;
+  std::atomic<std::size_t> count{0};
+
+  static std::size_t segmentIndex(std::size_t index) {
+    std::size_t k{0};
+    for (std::size_t i = (index >> log2FirstSegmentSize) + 1; i > 1; i >>= 1) {
+      ++k;
+    }
+    return k;
+  }
+  static std::size_t segmentStart(std::size_t k) {
+    return firstSegmentSize * ((std::size_t{1} << k) - 1);
+  }
+  T *segment(std::size_t k) {
+    auto *s{segments[k].load(std::memory_order_acquire)};
+    if (s == nullptr) {
+      s = new T[firstSegmentSize << k]{};
+      segments[k].store(s, std::memory_order_release);
+    }
+    return s;
+  }
+  [[nodiscard]] T *element(std::size_t index) const {
+    const auto k{segmentIndex(index)};
+    return segments[k].load(std::memory_order_acquire) + index -
+           segmentStart(k);
+  }
+  void release() {
+    for (auto &s : segments) {
+      delete[] s.exchange(nullptr);
+    }
+    count.store(0, std::memory_order_release);
+  }
+
+public:
+  AppendOnlyVector() {
+    for (auto &s : segments) {
+      s.store(nullptr);
+    }
+  }
+  AppendOnlyVector(std::initializer_list<T> values) : AppendOnlyVector() {
+    for (const auto &value : values) {
+      push_back(value);
+    }
+  }
+  AppendOnlyVector(const AppendOnlyVector &other) : AppendOnlyVector() {
+    *this = other;
+  }
+  AppendOnlyVector(AppendOnlyVector &&other) noexcept : AppendOnlyVector() {
+    *this = std::move(other);
+  }
+  AppendOnlyVector &operator=(const AppendOnlyVector &other) {
+    if (this != &other) {
+      clear();
+      reserve(other.size());
+      for (std::size_t i = 0; i < other.size(); ++i) {
+        push_back(other[i]);
+      }
+    }
+    return *this;
+  }
+  AppendOnlyVector &operator=(AppendOnlyVector &&other) noexcept {
+    if (this != &other) {
+      release();
+      for (std::size_t k = 0; k < maxSegments; ++k) {
+        segments[k].store(other.segments[k].exchange(nullptr));
+      }
+      count.store(other.count.exchange(0));
+    }
+    return *this;
+  }
+  AppendOnlyVector &operator=(std::initializer_list<T> values) {
+    clear();
+    for (const auto &value : values) {
+      push_back(value);
+    }
+    return *this;
+  }
+  ~AppendOnlyVector() { release(); }
+
+  [[nodiscard]] std::size_t size() const {
+    return count.load(std::memory_order_acquire);
+  }
+  [[nodiscard]] bool empty() const { return size() == 0; }
+  // index must be less than a previously returned size()
+  [[nodiscard]] const T &operator[](std::size_t index) const {
+    return *element(index);
+  }
+  [[nodiscard]] T &operator[](std::size_t index) { return *element(index); }
+  [[nodiscard]] const T &back() const { return (*this)[size() - 1]; }
+  [[nodiscard]] T &back() { return (*this)[size() - 1]; }
+  // the element is visible to readers once it has been constructed
+  void push_back(T value) {
+    const auto n{count.load(std::memory_order_relaxed)};
+    const auto k{segmentIndex(n)};
+    segment(k)[n - segmentStart(k)] = std::move(value);
+    count.store(n + 1, std::memory_order_release);
+  }
+  void pop_back() {
+    const auto n{count.load(std::memory_order_relaxed) - 1};
+    count.store(n, std::memory_order_release);
+    (*this)[n] = T{};
+  }
+  void clear() { release(); }
+  // allocate the segments for n elements
+  void reserve(std::size_t n) {
+    if (n == 0) {
+      return;
+    }
+    for (std::size_t k = 0; k <= segmentIndex(n - 1); ++k) {
+      segment(k);
+    }
+  }
+
+  template <class Archive> void save(Archive &ar) const {
+    ar(cereal::make_size_tag(static_cast<cereal::size_type>(size())));
+    for (std::size_t i = 0; i < size(); ++i) {
+      ar((*this)[i]);
+    }
+  }
+
+  template <class Archive> void load(Archive &ar) {
+    clear();
+    cereal::size_type n{0};
+    ar(cereal::make_size_tag(n));
+    reserve(static_cast<std::size_t>(n));
+    for (cereal::size_type i = 0; i < n; ++i) {
+      T value{};
+      ar(value);
+      push_back(std::move(value));
+    }
+  }
+};
+
+// concentrations at a single timepoint: compartment->(ix->species)
+// the concentrations remain valid as long as this object exists
+class ConcentrationFrame {
+private:
+  std::shared_ptr<const std::vector<std::vector<double>>> frame;
+
+public:
+  ConcentrationFrame() = default;
+  explicit ConcentrationFrame(
+      std::shared_ptr<const std::vector<std::vector<double>>> concentrations);
+  [[nodiscard]] std::size_t size() const;
+  [[nodiscard]] bool empty() const;
+  [[nodiscard]] const std::vector<double> &
+  operator[](std::size_t compartmentIndex) const &;
+  [[nodiscard]] const std::vector<std::vector<double>> &get() const &;
+  // a temporary frame may own the only reference to its concentrations, so
+  // these return a copy instead of a reference that would dangle
+  [[nodiscard]] std::vector<double> operator[](std::size_t compartmentIndex) &&;
+  [[nodiscard]] std::vector<std::vector<double>> get() &&;
+};
+
+enum class FrameCompressionType { None, Lossless, BoundedError };
+
+struct FrameCompression {
+  FrameCompressionType type{FrameCompressionType::None};
+  // BoundedError: maximum absolute error of each stored concentration
+  double maxError{1e-9};
+};
+
+// the concentrations at each timepoint, stored in memory, or optionally in
+// chunked memory-mapped files with only the most recently used timepoints
+// kept in memory. Timepoints can optionally be compressed, each is then
+// stored as the difference from the previous timepoint, and decompressed
+// when it is accessed
+class ConcentrationFrames {
+public:
+  // a single timepoint in its stored form
+  struct Encoded {
+    std::uint8_t type{0};
+    // number of timepoints since the last self-contained timepoint
+    std::uint64_t keyframeOffset{0};
+    std::vector<std::uint64_t> sizes{};
+    std::string bytes{};
+
+    template <class Archive> void serialize(Archive &ar) {
+      ar(type, keyframeOffset, sizes, bytes);
+    }
+  };
+
+private:
+  struct Store;
+  AppendOnlyVector<std::shared_ptr<const std::vector<std::vector<double>>>>
+      frames;
+  // readers hold a shared lock, the writer holds a unique lock while it
+  // modifies an element of frames
+  mutable std::shared_mutex framesMutex;
+  std::unique_ptr<Store> store;
+  void reconfigure(const std::string &directory, std::size_t cachedFrames,
+                   const FrameCompression &frameCompression);
+
+public:
+  ConcentrationFrames();
+  ConcentrationFrames(const ConcentrationFrames &other);
+  ConcentrationFrames(ConcentrationFrames &&) noexcept;
+  ConcentrationFrames &operator=(const ConcentrationFrames &other);
+  ConcentrationFrames &operator=(ConcentrationFrames &&) noexcept;
+  ~ConcentrationFrames();
+  [[nodiscard]] std::size_t size() const;
+  [[nodiscard]] bool empty() const;
+  [[nodiscard]] ConcentrationFrame operator[](std::size_t timeIndex) const;
+  [[nodiscard]] ConcentrationFrame back() const;
+  void push_back(std::vector<std::vector<double>> concentrations);
+  // replace the last timepoint: a concurrent reader gets either the previous
+  // or the new concentrations
+  void replaceBack(std::vector<std::vector<double>> concentrations);
+  void pop_back();
+  void clear();
+  void reserve(std::size_t n);
+  // store the concentrations in memory-mapped files in directory, keeping the
+  // cachedFrames most recently used timepoints in memory (existing timepoints
+  // are moved to disk), an empty directory stores everything in memory
+  void setDiskBacked(const std::string &directory,
+                     std::size_t cachedFrames = 16);
+  [[nodiscard]] bool isDiskBacked() const;
+  // compress the stored concentrations (existing timepoints are re-encoded)
+  void setCompression(const FrameCompression &frameCompression);
+  [[nodiscard]] const FrameCompression &getCompression() const;
+  // uncompressed size divided by stored size of all timepoints
+  [[nodiscard]] double getCompressionRatio() const;
+  [[nodiscard]] Encoded getEncoded(std::size_t timeIndex) const;
+  // returns false if encoded is not valid
+  bool pushEncoded(const Encoded &encoded);
+
+  template <class Archive> void save(Archive &ar) const {
+    const auto &c{getCompression()};
+    ar(static_cast<std::uint8_t>(c.type), c.maxError);
+    ar(cereal::make_size_tag(static_cast<cereal::size_type>(size())));
+    for (std::size_t i = 0; i < size(); ++i) {
+      ar(getEncoded(i));
+    }
+  }
+
+  template <class Archive> void load(Archive &ar) {
+    std::uint8_t type{0};
+    FrameCompression c{};
+    ar(type, c.maxError);
+    c.type = static_cast<FrameCompressionType>(type);
+    clear();
+    setCompression(c);
+    cereal::size_type n{0};
+    ar(cereal::make_size_tag(n));
+    for (cereal::size_type i = 0; i < n; ++i) {
+      Encoded encoded;
+      ar(encoded);
+      if (!pushEncoded(encoded)) {
+        throw cereal::Exception("Invalid stored concentrations");
+      }
+    }
+  }
+};
+
+// the concentrations at each pixel of a compartment over time, stored in tiles
+// of tilePixels pixels by tileTimepoints timepoints, so that the time series of
+// a pixel is read from a few contiguous blocks of memory instead of from every
+// timepoint. Tiles can optionally be compressed once all of their timepoints
+// have been added. A single writer can add timepoints while other threads read
+// time series
+class TimeTraceIndex {
+private:
+  static constexpr std::size_t tilePixels{64};
+  static constexpr std::size_t tileTimepoints{64};
+  // tile values are pixel->time->species
+  using Tile = std::vector<double>;
+  std::size_t nSpecies;
+  std::size_t nPixels;
+  std::size_t nPixelTiles;
+  bool compressTiles;
+  // timeTile * nPixelTiles + pixelTile for the first timeTiles
+  std::vector<std::string> compressedTiles{};
+  // the tiles after the compressed ones
+  std::vector<Tile> tiles{};
+  std::size_t count{0};
+  // readers hold a shared lock, the writer holds a unique lock while it
+  // modifies the tiles
+  mutable std::shared_mutex mutex;
+  [[nodiscard]] std::size_t nCompressedTimeTiles() const;
+  void write(std::size_t timeIndex, const std::vector<double> &concentrations);
+
+public:
+  // number of species and pixels in the compartment, and whether to compress
+  // tiles with all of their timepoints
+  TimeTraceIndex(std::size_t compartmentSpecies, std::size_t compartmentPixels,
+                 bool compress = false);
+  [[nodiscard]] std::size_t size() const;
+  // concentrations of the compartment at a timepoint: ix->species
+  void push_back(const std::vector<double> &concentrations);
+  void replaceBack(const std::vector<double> &concentrations);
+  void pop_back();
+  // the concentration of a species at a pixel for each timepoint
+  [[nodiscard]] std::vector<double> getTimeSeries(std::size_t speciesIndex,
+                                                  std::size_t pixelIndex) const;
+};
+
 class SimulationData {
+private:
+  // remove the extra values after the species at each pixel in timepoints
+  // stored in version 0
+  void removePadding(const std::vector<std::size_t> &concPadding);
+
 public:
-  std::vector<double> timePoints;
+  // a timepoint is appended to timePoints after the other members, so a
+  // reader can access any timepoint less than the size of timePoints while
+  // a simulation is running
+  AppendOnlyVector<double> timePoints;
   // time->compartment->(ix->species)
-  std::vector<std::vector<std::vector<double>>> concentration;
+  ConcentrationFrames concentration;
   // time->compartment->species
-  std::vector<std::vector<std::vector<AvgMinMax>>> avgMinMax;
+  AppendOnlyVector<std::vector<std::vector<AvgMinMax>>> avgMinMax;
   // time->compartment->species
-  std::vector<std::vector<std::vector<double>>> concentrationMax;
-  // time->concPadding
-  std::vector<std::size_t> concPadding;
+  AppendOnlyVector<std::vector<std::vector<double>>> concentrationMax;
   std::string xmlModel;
   void clear();
   [[nodiscard]] std::size_t size() const;
@@ -30,12 +351,21 @@ public:
   template <class Archive>
   void serialize(Archive &ar, std::uint32_t const version) {
     if (version == 0) {
-      ar(timePoints, concentration, avgMinMax, concentrationMax, concPadding,
-         xmlModel);
+      // concentrations were stored uncompressed and padded in version 0
+      std::vector<std::vector<std::vector<double>>> c;
+      std::vector<std::size_t> concPadding;
+      ar(timePoints, c, avgMinMax, concentrationMax, concPadding, xmlModel);
+      concentration.clear();
+      for (auto &frame : c) {
+        concentration.push_back(std::move(frame));
+      }
+      removePadding(concPadding);
+    } else if (version == 1) {
+      ar(timePoints, concentration, avgMinMax, concentrationMax, xmlModel);
     }
   }
 };
 
 } // namespace sme::simulate
 
-CEREAL_CLASS_VERSION(sme::simulate::SimulationData, 0);
+CEREAL_CLASS_VERSION(sme::simulate::SimulationData, 1);
@@ -45,7 +45,38 @@ struct DuneOptions {
   }
 };
 
-enum class PixelIntegratorType { RK101, RK212, RK323, RK435 };
+// IMEX: implicit-explicit Euler, reactions explicit, diffusion implicit
+// Rosenbrock: linearly implicit Euler for reactions using their Jacobian,
+// operator split with implicit diffusion
+// RKC: second order Runge-Kutta-Chebyshev, explicit with the number of stages
+// chosen such that diffusion is stable for the timestep
+enum class PixelIntegratorType {
+  RK101,
+  RK212,
+  RK323,
+  RK435,
+  IMEX,
+  Rosenbrock,
+  RKC
+};
+
+// ordering of the concentration array of each compartment in the pixel sim:
+//  - PixelMajor: [ix * nSpecies + is], all species for each pixel together
+//  - SpeciesMajor: [is * nPixels + ix], all pixels for each species together
+enum class PixelStorageLayout { PixelMajor, SpeciesMajor };
+
+// ordering of the pixels of each compartment in the pixel sim:
+//  - Column: same as the compartment geometry, i.e. each column of the image
+//  in turn, so the +x and -x neighbours of a pixel are a column apart
+//  - Morton: Z-order curve, all four neighbours of a pixel are typically
+//  close in memory
+enum class PixelOrdering { Column, Morton };
+
+// timestep controller of the adaptive pixel sim RK integrators:
+//  - I: new timestep from the error of the current step only
+//  - PI: new timestep also uses the error of the previous accepted step, with
+//  limits on how much the timestep can change in a single step
+enum class PixelStepController { I, PI };
 
 struct PixelIntegratorError {
   double abs{std::numeric_limits<double>::max()};
@@ -67,6 +98,26 @@ struct PixelOptions {
   std::size_t maxThreads{0};
   bool doCSE{true};
   unsigned optLevel{3};
+  PixelStorageLayout storageLayout{PixelStorageLayout::PixelMajor};
+  // evaluate dcdt and apply each RK stage update in a single pass over the
+  // pixels (only used for models without membrane reactions or non-spatial
+  // species)
+  bool fuseRKStages{false};
+  PixelOrdering pixelOrdering{PixelOrdering::Column};
+  PixelStepController stepController{PixelStepController::I};
+  // sub-cycle each compartment with its own timestep, exchanging membrane
+  // fluxes at synchronisation points (only used for explicit RK integrators)
+  bool multirate{false};
+  // if non-zero, only evaluate dcdt in tiles of pixels where |dcdt| is larger
+  // than this value at the previous evaluation, and their neighbours (only
+  // used for explicit integrators)
+  double activeTileTolerance{0.0};
+  // if non-zero, merge square blocks of up to 2^quadtreeMaxLevel pixels where
+  // the relative variation of the concentrations is less than
+  // quadtreeTolerance into a single cell, the cells are rebuilt at the start
+  // of each simulation time interval (only used for explicit integrators)
+  unsigned quadtreeMaxLevel{0};
+  double quadtreeTolerance{1e-3};
 
   template <class Archive>
   void serialize(Archive &ar, std::uint32_t const version) {
@@ -74,6 +125,14 @@ struct PixelOptions {
       ar(CEREAL_NVP(integrator), CEREAL_NVP(maxErr), CEREAL_NVP(maxTimestep),
          CEREAL_NVP(enableMultiThreading), CEREAL_NVP(maxThreads),
          CEREAL_NVP(doCSE), CEREAL_NVP(optLevel));
+    } else if (version == 1) {
+      ar(CEREAL_NVP(integrator), CEREAL_NVP(maxErr), CEREAL_NVP(maxTimestep),
+         CEREAL_NVP(enableMultiThreading), CEREAL_NVP(maxThreads),
+         CEREAL_NVP(doCSE), CEREAL_NVP(optLevel), CEREAL_NVP(storageLayout),
+         CEREAL_NVP(fuseRKStages), CEREAL_NVP(pixelOrdering),
+         CEREAL_NVP(stepController), CEREAL_NVP(multirate),
+         CEREAL_NVP(activeTileTolerance), CEREAL_NVP(quadtreeMaxLevel),
+         CEREAL_NVP(quadtreeTolerance));
     }
   }
 };
@@ -105,10 +164,33 @@ struct AvgMinMax {
 
 bool operator==(const AvgMinMax &lhs, const AvgMinMax &rhs);
 
+// statistics of the timesteps taken by the pixel simulator
+struct TimestepStatistics {
+  std::size_t acceptedSteps{0};
+  std::size_t rejectedSteps{0};
+  double minTimestep{std::numeric_limits<double>::max()};
+  double maxTimestep{0};
+  // number of dcdt evaluations over the whole domain thrown away by rejected
+  // steps
+  std::size_t wastedEvaluations{0};
+  // wall time in seconds spent in the final stage of each step of the
+  // adaptive integrators, where the error estimate is calculated
+  double errorEstimateSeconds{0};
+};
+
+// parameter sets of an ensemble simulation with the pixel simulator: member k
+// uses values[k][i] for the constant model parameter parameterIds[i]
+struct EnsembleParameters {
+  std::vector<std::string> parameterIds{};
+  std::vector<std::vector<double>> values{};
+  // number of ensemble members, zero if this is not an ensemble simulation
+  [[nodiscard]] std::size_t size() const { return values.size(); }
+};
+
 } // namespace sme::simulate
 
 CEREAL_CLASS_VERSION(sme::simulate::Options, 0);
 CEREAL_CLASS_VERSION(sme::simulate::DuneOptions, 0);
 CEREAL_CLASS_VERSION(sme::simulate::PixelIntegratorError, 0);
-CEREAL_CLASS_VERSION(sme::simulate::PixelOptions, 0);
+CEREAL_CLASS_VERSION(sme::simulate::PixelOptions, 1);
 CEREAL_CLASS_VERSION(sme::simulate::AvgMinMax, 0);
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "sme/simulate_options.hpp"
 #include <QImage>
 #include <string>
 #include <vector>
@@ -18,6 +19,8 @@ public:
   [[nodiscard]] virtual std::size_t getConcentrationPadding() const = 0;
   [[nodiscard]] virtual const std::string &errorMessage() const = 0;
   [[nodiscard]] virtual const QImage &errorImage() const = 0;
+  [[nodiscard]] virtual const TimestepStatistics &
+  getTimestepStatistics() const = 0;
   virtual void setStopRequested(bool stop) = 0;
 };
 
@@ -0,0 +1,194 @@
+#include "dct.hpp"
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+namespace sme::simulate {
+
+static bool isPowerOfTwo(std::size_t n) { return n > 0 && (n & (n - 1)) == 0; }
+
+// below this length the O(n^2) dense matrix is faster than Bluestein's
+// algorithm, which needs three power of two FFTs of length at least 2n - 1
+constexpr std::size_t maxDenseSize{160};
+
+Dct::Dct(std::size_t size) : n{size}, m{size} {
+  if (n == 0) {
+    return;
+  }
+  const double pi{std::acos(-1.0)};
+  const auto dn{static_cast<double>(n)};
+  if (!isPowerOfTwo(n) && n <= maxDenseSize) {
+    matrix.resize(n * n);
+    for (std::size_t k = 0; k < n; ++k) {
+      const double s{k == 0 ? std::sqrt(1.0 / dn) : std::sqrt(2.0 / dn)};
+      for (std::size_t j = 0; j < n; ++j) {
+        matrix[k * n + j] = s * std::cos(pi * static_cast<double>(k) *
+                                         (static_cast<double>(j) + 0.5) / dn);
+      }
+    }
+    return;
+  }
+  if (!isPowerOfTwo(n)) {
+    m = 1;
+    while (m < 2 * n - 1) {
+      m *= 2;
+    }
+  }
+  twiddles.resize(m / 2);
+  for (std::size_t k = 0; k < twiddles.size(); ++k) {
+    twiddles[k] = std::polar(1.0, -2.0 * pi * static_cast<double>(k) /
+                                      static_cast<double>(m));
+  }
+  if (m != n) {
+    chirp.resize(n);
+    for (std::size_t k = 0; k < n; ++k) {
+      // the chirp has period 2n in k^2: reduce it to keep the angle accurate
+      const auto k2{static_cast<double>((k * k) % (2 * n))};
+      chirp[k] = std::polar(1.0, pi * k2 / dn);
+    }
+    chirpFilter.assign(m, 0.0);
+    chirpFilter[0] = chirp[0];
+    for (std::size_t k = 1; k < n; ++k) {
+      chirpFilter[k] = chirp[k];
+      chirpFilter[m - k] = chirp[k];
+    }
+    fftPowerOfTwo(chirpFilter);
+  }
+  shift.resize(n);
+  norm.resize(n);
+  for (std::size_t k = 0; k < n; ++k) {
+    shift[k] = std::polar(1.0, -pi * static_cast<double>(k) / (2.0 * dn));
+    norm[k] = k == 0 ? std::sqrt(1.0 / dn) : std::sqrt(2.0 / dn);
+  }
+}
+
+void Dct::fftPowerOfTwo(std::vector<std::complex<double>> &a) const {
+  // bit reversal permutation
+  for (std::size_t i = 1, j = 0; i < m; ++i) {
+    std::size_t bit{m >> 1};
+    for (; (j & bit) != 0; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(a[i], a[j]);
+    }
+  }
+  // butterflies
+  for (std::size_t len = 2; len <= m; len *= 2) {
+    const std::size_t half{len / 2};
+    const std::size_t step{m / len};
+    for (std::size_t i = 0; i < m; i += len) {
+      for (std::size_t k = 0; k < half; ++k) {
+        const auto t{twiddles[k * step] * a[i + k + half]};
+        a[i + k + half] = a[i + k] - t;
+        a[i + k] += t;
+      }
+    }
+  }
+}
+
+void Dct::fft(Workspace &w) const {
+  auto &v{w.v};
+  if (m == n) {
+    fftPowerOfTwo(v);
+    return;
+  }
+  // Bluestein: the DFT is a convolution of the chirped values with the chirp,
+  // done with power of two FFTs
+  auto &c{w.conv};
+  c.assign(m, 0.0);
+  for (std::size_t k = 0; k < n; ++k) {
+    c[k] = v[k] * std::conj(chirp[k]);
+  }
+  fftPowerOfTwo(c);
+  for (std::size_t k = 0; k < m; ++k) {
+    c[k] = std::conj(c[k] * chirpFilter[k]);
+  }
+  // inverse FFT: conjugate, FFT, conjugate, divide by m
+  fftPowerOfTwo(c);
+  const double scale{1.0 / static_cast<double>(m)};
+  for (std::size_t k = 0; k < n; ++k) {
+    v[k] = scale * std::conj(c[k]) * std::conj(chirp[k]);
+  }
+}
+
+std::size_t Dct::size() const { return n; }
+
+void Dct::forward(const double *x, std::size_t xStride, double *y,
+                  std::size_t yStride, Workspace &w) const {
+  if (n == 0) {
+    return;
+  }
+  if (!matrix.empty()) {
+    auto &r{w.values};
+    r.resize(n);
+    for (std::size_t j = 0; j < n; ++j) {
+      r[j] = x[j * xStride];
+    }
+    for (std::size_t k = 0; k < n; ++k) {
+      y[k * yStride] =
+          std::inner_product(r.cbegin(), r.cend(), matrix.data() + k * n, 0.0);
+    }
+    return;
+  }
+  // even values in order, then odd values in reverse order
+  auto &v{w.v};
+  v.resize(n);
+  for (std::size_t j = 0; 2 * j < n; ++j) {
+    v[j] = x[2 * j * xStride];
+  }
+  for (std::size_t j = 0; 2 * j + 1 < n; ++j) {
+    v[n - 1 - j] = x[(2 * j + 1) * xStride];
+  }
+  fft(w);
+  for (std::size_t k = 0; k < n; ++k) {
+    y[k * yStride] = norm[k] * (shift[k] * v[k]).real();
+  }
+}
+
+void Dct::inverse(const double *y, std::size_t yStride, double *x,
+                  std::size_t xStride, Workspace &w) const {
+  if (n == 0) {
+    return;
+  }
+  if (!matrix.empty()) {
+    auto &r{w.values};
+    r.assign(n, 0.0);
+    for (std::size_t k = 0; k < n; ++k) {
+      const double yk{y[k * yStride]};
+      const double *row{matrix.data() + k * n};
+      for (std::size_t j = 0; j < n; ++j) {
+        r[j] += yk * row[j];
+      }
+    }
+    for (std::size_t j = 0; j < n; ++j) {
+      x[j * xStride] = r[j];
+    }
+    return;
+  }
+  // the FFT of the reordered values is determined by the unnormalised
+  // transform X: exp(-i pi k / 2n) V_k = X_k - i X_{n-k}
+  auto &v{w.v};
+  v.resize(n);
+  v[0] = y[0] / norm[0];
+  for (std::size_t k = 1; k < n; ++k) {
+    const double xk{y[k * yStride] / norm[k]};
+    const double xnk{y[(n - k) * yStride] / norm[n - k]};
+    v[k] = std::conj(shift[k]) * std::complex<double>(xk, -xnk);
+  }
+  // inverse FFT: conjugate, FFT, conjugate, divide by n (the result is real)
+  for (auto &z : v) {
+    z = std::conj(z);
+  }
+  fft(w);
+  const double scale{1.0 / static_cast<double>(n)};
+  for (std::size_t j = 0; 2 * j < n; ++j) {
+    x[2 * j * xStride] = scale * v[j].real();
+  }
+  for (std::size_t j = 0; 2 * j + 1 < n; ++j) {
+    x[(2 * j + 1) * xStride] = scale * v[n - 1 - j].real();
+  }
+}
+
+} // namespace sme::simulate
@@ -0,0 +1,60 @@
+// Fast discrete cosine transform
+//  - Dct: orthonormal DCT-II of any length and its inverse in O(n log n)
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace sme::simulate {
+
+// Orthonormal DCT-II y = M x of a sequence of n values, where
+// M[k][j] = s_k cos(pi k (j + 1/2) / n), s_0 = sqrt(1/n), s_k = sqrt(2/n),
+// and its inverse x = M^T y. The values are reordered so that the transform
+// is the real part of a complex FFT of length n (Makhoul's algorithm), which
+// is done with Bluestein's algorithm if n is not a power of two. For short
+// sequences whose length is not a power of two the dense matrix is cheaper
+// than Bluestein's algorithm, and is used instead.
+class Dct {
+public:
+  // work vectors of a transform, one for each thread using the same Dct
+  struct Workspace {
+    std::vector<std::complex<double>> v;
+    std::vector<std::complex<double>> conv;
+    std::vector<double> values;
+  };
+
+private:
+  std::size_t n;
+  // length of the power of two FFTs: n, or at least 2n - 1 if n is not a
+  // power of two
+  std::size_t m;
+  // exp(-2 pi i k / m) for k < m / 2
+  std::vector<std::complex<double>> twiddles;
+  // Bluestein's algorithm: chirp exp(i pi k^2 / n) for k < n, and the FFT of
+  // the chirp filter that it is convolved with
+  std::vector<std::complex<double>> chirp;
+  std::vector<std::complex<double>> chirpFilter;
+  // exp(-i pi k / 2n) for k < n
+  std::vector<std::complex<double>> shift;
+  std::vector<double> norm;
+  // dense matrix M, or empty if the FFT is used
+  std::vector<double> matrix;
+  // in-place power of two FFT of length m
+  void fftPowerOfTwo(std::vector<std::complex<double>> &a) const;
+  // in-place FFT of w.v (length n)
+  void fft(Workspace &w) const;
+
+public:
+  explicit Dct(std::size_t size = 0);
+  [[nodiscard]] std::size_t size() const;
+  // y = M x, the elements of x and y are at multiples of the strides
+  void forward(const double *x, std::size_t xStride, double *y,
+               std::size_t yStride, Workspace &w) const;
+  // x = M^T y, the elements of x and y are at multiples of the strides
+  void inverse(const double *y, std::size_t yStride, double *x,
+               std::size_t xStride, Workspace &w) const;
+};
+
+} // namespace sme::simulate
@@ -0,0 +1,49 @@
+#include "catch_wrapper.hpp"
+#include "dct.hpp"
+#include <cmath>
+#include <vector>
+
+using namespace sme;
+
+TEST_CASE("Dct", "[core/simulate/dct][core/simulate][core][dct]") {
+  const double pi{std::acos(-1.0)};
+  // powers of two use a single FFT, other lengths use the dense matrix if
+  // they are short, otherwise Bluestein's algorithm
+  for (std::size_t n : {1, 2, 3, 4, 5, 7, 8, 30, 64, 97, 200, 256, 300}) {
+    CAPTURE(n);
+    simulate::Dct dct(n);
+    simulate::Dct::Workspace w;
+    REQUIRE(dct.size() == n);
+    const auto dn{static_cast<double>(n)};
+    std::vector<double> x(n);
+    for (std::size_t j = 0; j < n; ++j) {
+      x[j] = std::sin(0.3 * static_cast<double>(j * j)) + 0.1;
+    }
+    // compare to the dense orthonormal DCT-II matrix
+    std::vector<double> yDense(n, 0.0);
+    for (std::size_t k = 0; k < n; ++k) {
+      const double s{k == 0 ? std::sqrt(1.0 / dn) : std::sqrt(2.0 / dn)};
+      for (std::size_t j = 0; j < n; ++j) {
+        yDense[k] += s *
+                     std::cos(pi * static_cast<double>(k) *
+                              (static_cast<double>(j) + 0.5) / dn) *
+                     x[j];
+      }
+    }
+    std::vector<double> y(n);
+    dct.forward(x.data(), 1, y.data(), 1, w);
+    for (std::size_t k = 0; k < n; ++k) {
+      REQUIRE(y[k] == Catch::Approx(yDense[k]).margin(1e-12));
+    }
+    // inverse in place, with a stride
+    std::vector<double> strided(2 * n, -1.0);
+    for (std::size_t k = 0; k < n; ++k) {
+      strided[2 * k] = y[k];
+    }
+    dct.inverse(strided.data(), 2, strided.data(), 2, w);
+    for (std::size_t j = 0; j < n; ++j) {
+      REQUIRE(strided[2 * j] == Catch::Approx(x[j]).margin(1e-12));
+      REQUIRE(strided[2 * j + 1] == dbl_approx(-1.0));
+    }
+  }
+}
@@ -189,16 +189,16 @@ static void addCompartment(
         // use concentrations from existing simulation data
         auto simField{*f};
         const std::size_t nPixels{f->getCompartment()->nPixels()};
-        const std::size_t padding{model.getSimulationData().concPadding.back()};
-        const std::size_t stride{padding + nonConstantSpecies.size()};
+        const std::size_t stride{nonConstantSpecies.size()};
         std::vector<double> c(nPixels, 0.0);
         SPDLOG_INFO("using simulation concentration data for species {}",
                     name.toStdString());
         SPDLOG_INFO("- species index {}", i);
         SPDLOG_INFO("- species dune index {}", indices[i]);
+        const auto frame{simConcs.back()};
+        const auto &simConc{frame[simDataCompartmentIndex]};
         for (std::size_t iPixel = 0; iPixel < nPixels; ++iPixel) {
-          c[iPixel] =
-              simConcs.back()[simDataCompartmentIndex][iPixel * stride + i];
+          c[iPixel] = simConc[iPixel * stride + i];
         }
         simField.setConcentration(c);
         concs[indices[i]] = simField.getConcentrationImageArray();
@@ -270,6 +270,10 @@ const std::string &DuneSim::errorMessage() const { return currentErrorMessage; }
 
 const QImage &DuneSim::errorImage() const { return currentErrorImage; }
 
+const TimestepStatistics &DuneSim::getTimestepStatistics() const {
+  return timestepStatistics;
+}
+
 void DuneSim::setStopRequested([[maybe_unused]] bool stop) {
   SPDLOG_DEBUG("Not implemented - ignoring request");
 }
@@ -63,6 +63,8 @@ private:
   void updateSpeciesConcentrations();
   std::string currentErrorMessage{};
   QImage currentErrorImage{};
+  // timesteps are chosen internally by DUNE, so these are not available
+  TimestepStatistics timestepStatistics{};
   double volOverL3;
 
 public:
@@ -78,6 +80,8 @@ public:
   [[nodiscard]] std::size_t getConcentrationPadding() const override;
   [[nodiscard]] const std::string &errorMessage() const override;
   [[nodiscard]] const QImage &errorImage() const override;
+  [[nodiscard]] const TimestepStatistics &
+  getTimestepStatistics() const override;
   void setStopRequested(bool stop) override;
 };
 
@@ -72,6 +72,19 @@ Pde::Pde(const model::Model *doc_ptr,
           }
         }
       }
+      // extra variables are never replaced by the value of a global
+      // constant, but a local parameter with the same id still shadows them
+      const auto globalConstantsEnd{
+          constants.begin() +
+          static_cast<std::ptrdiff_t>(reactions.getNumberOfGlobalConstants())};
+      constants.erase(std::remove_if(constants.begin(), globalConstantsEnd,
+                                     [&extraVariables](const auto &c) {
+                                       return std::find(extraVariables.cbegin(),
+                                                        extraVariables.cend(),
+                                                        c.first) !=
+                                              extraVariables.cend();
+                                     }),
+                      globalConstantsEnd);
       // parse and inline constants & function calls
       common::Symbolic sym(expr.toStdString(), vars, constants,
                            doc_ptr->getFunctions().getSymbolicFunctions());
@@ -168,6 +181,10 @@ Reaction::getConstants(std::size_t reactionIndex) const {
   return constants.at(reactionIndex);
 }
 
+std::size_t Reaction::getNumberOfGlobalConstants() const {
+  return nGlobalConstants;
+}
+
 Reaction::Reaction(const model::Model *doc, std::vector<std::string> species,
                    const std::vector<std::string> &reactionIDs)
     : speciesIDs(std::move(species)) {
@@ -187,6 +204,7 @@ Reaction::Reaction(const model::Model *doc, std::vector<std::string> species,
       for (const auto &c : doc->getParameters().getGlobalConstants()) {
         constants.back().push_back({c.id, c.value});
       }
+      nGlobalConstants = constants.back().size();
       for (const auto &paramId :
            doc->getReactions().getParameterIds(reacID.c_str())) {
         double value =
@@ -19,6 +19,7 @@ TEST_CASE("PDE", "[core/simulate/pde][core/simulate][core][pde]") {
     REQUIRE(reac.size() == 1);
     REQUIRE(symEq(reac.getExpression(0), "A * B * k1"));
     REQUIRE_THROWS(reac.getExpression(1));
+    REQUIRE(reac.getNumberOfGlobalConstants() == 6);
     REQUIRE(reac.getConstants(0)[5].first == "comp");
     REQUIRE(reac.getConstants(0)[5].second == dbl_approx(3149000.0));
     REQUIRE(reac.getConstants(0)[6].first == "k1");
@@ -125,4 +126,26 @@ TEST_CASE("PDE", "[core/simulate/pde][core/simulate][core][pde]") {
     REQUIRE(symEq(pde.getJacobian()[2][1], "2.7e6*dim"));
     REQUIRE(symEq(pde.getJacobian()[2][2], "0"));
   }
+  SECTION("extra variable shadowed by a local parameter") {
+    auto s{getExampleModel(Mod::ABtoC)};
+    s.getParameters().add("kscale");
+    s.getParameters().setExpression("kscale", "2");
+    s.getReactions().setRateExpression("r1", "A * B * k1 * kscale");
+    std::vector<std::string> speciesIDs{"A", "B", "C"};
+    // global parameter used as an extra variable instead of its value
+    simulate::Pde pde(&s, speciesIDs, {"r1"}, {}, {}, {"kscale"});
+    REQUIRE(symEq(pde.getRHS()[0], "-0.1*A*B*kscale"));
+    // add a local parameter with the same id to the reaction
+    auto localId{s.getReactions().addParameter("r1", "kscale", 3.0)};
+    auto xml{s.getXml()};
+    xml.replace(QString("id=\"%1\"").arg(localId), "id=\"kscale\"");
+    model::Model shadowed;
+    shadowed.importSBMLString(xml.toStdString());
+    REQUIRE(shadowed.getReactions().getParameterIds("r1").contains("kscale"));
+    // the local parameter value is used instead of the extra variable
+    simulate::Pde pdeShadowed(&shadowed, speciesIDs, {"r1"}, {}, {},
+                              {"kscale"});
+    REQUIRE(symEq(pdeShadowed.getRHS()[0], "-0.3*A*B"));
+    REQUIRE(symEq(pdeShadowed.getRHS()[2], "0.3*A*B"));
+  }
 }
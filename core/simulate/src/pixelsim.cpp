@@ -11,17 +11,255 @@
 #include <array>
 #include <cmath>
 #include <cstdlib>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <utility>
+// Qt defines emit keyword which interferes with a tbb emit() function
+#ifdef emit
+#undef emit
+#include <oneapi/tbb/flow_graph.h>
 #include <oneapi/tbb/global_control.h>
 #include <oneapi/tbb/info.h>
-#include <utility>
+#define emit // restore the Qt empty definition of "emit"
+#else
+#include <oneapi/tbb/flow_graph.h>
+#include <oneapi/tbb/global_control.h>
+#include <oneapi/tbb/info.h>
+#endif
 
 namespace sme::simulate {
 
+// integrators that do the diffusion step implicitly, separately from dcdt
+static bool hasImplicitDiffusion(PixelIntegratorType integrator) {
+  return integrator == PixelIntegratorType::IMEX ||
+         integrator == PixelIntegratorType::Rosenbrock;
+}
+
+static double dot(const std::vector<double> &a, const std::vector<double> &b) {
+  double sum{0.0};
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static double norm2(const std::vector<double> &a) {
+  return std::sqrt(dot(a, a));
+}
+
+static double normInf(const std::vector<double> &a) {
+  double maxAbs{0.0};
+  for (double v : a) {
+    if (std::isnan(v)) {
+      return std::numeric_limits<double>::max();
+    }
+    maxAbs = std::max(maxAbs, std::abs(v));
+  }
+  return maxAbs;
+}
+
+// restarted GMRES solve of A x = b, starting from x = 0, until
+// |b - A x| < relTol |b| or maxIterations is reached
+static void solveGMRES(
+    const std::function<void(const std::vector<double> &,
+                             std::vector<double> &)> &applyA,
+    const std::vector<double> &b, std::vector<double> &x, double relTol,
+    std::size_t maxIterations) {
+  constexpr std::size_t maxKrylovVectors{20};
+  const std::size_t n{b.size()};
+  const std::size_t m{std::min(maxKrylovVectors, maxIterations)};
+  x.assign(n, 0.0);
+  const double bNorm{norm2(b)};
+  if (bNorm == 0.0) {
+    return;
+  }
+  // Arnoldi basis, Hessenberg matrix H[i * m + j] & Givens rotations
+  std::vector<std::vector<double>> v(m + 1, std::vector<double>(n, 0.0));
+  std::vector<double> h((m + 1) * m, 0.0);
+  std::vector<double> cs(m, 0.0);
+  std::vector<double> sn(m, 0.0);
+  std::vector<double> g(m + 1, 0.0);
+  std::vector<double> w(n, 0.0);
+  std::size_t iteration{0};
+  while (iteration < maxIterations) {
+    // v[0] = r / |r|, where r = b - A x
+    applyA(x, w);
+    for (std::size_t i = 0; i < n; ++i) {
+      v[0][i] = b[i] - w[i];
+    }
+    const double beta{norm2(v[0])};
+    if (beta <= relTol * bNorm) {
+      return;
+    }
+    for (auto &vi : v[0]) {
+      vi /= beta;
+    }
+    std::fill(g.begin(), g.end(), 0.0);
+    g[0] = beta;
+    std::size_t k{0};
+    bool converged{false};
+    while (k < m && iteration < maxIterations && !converged) {
+      applyA(v[k], w);
+      // modified Gram-Schmidt
+      for (std::size_t j = 0; j <= k; ++j) {
+        const double hjk{dot(w, v[j])};
+        h[j * m + k] = hjk;
+        for (std::size_t i = 0; i < n; ++i) {
+          w[i] -= hjk * v[j][i];
+        }
+      }
+      const double hNext{norm2(w)};
+      h[(k + 1) * m + k] = hNext;
+      if (hNext > 0.0) {
+        for (std::size_t i = 0; i < n; ++i) {
+          v[k + 1][i] = w[i] / hNext;
+        }
+      }
+      // apply previous rotations to the new column, then eliminate h[k+1][k]
+      for (std::size_t j = 0; j < k; ++j) {
+        const double a{h[j * m + k]};
+        const double c{h[(j + 1) * m + k]};
+        h[j * m + k] = cs[j] * a + sn[j] * c;
+        h[(j + 1) * m + k] = -sn[j] * a + cs[j] * c;
+      }
+      const double r{std::hypot(h[k * m + k], hNext)};
+      cs[k] = r > 0.0 ? h[k * m + k] / r : 1.0;
+      sn[k] = r > 0.0 ? hNext / r : 0.0;
+      h[k * m + k] = r;
+      h[(k + 1) * m + k] = 0.0;
+      g[k + 1] = -sn[k] * g[k];
+      g[k] = cs[k] * g[k];
+      converged = std::abs(g[k + 1]) <= relTol * bNorm || hNext == 0.0;
+      ++k;
+      ++iteration;
+    }
+    // x += V y, where H y = g
+    std::vector<double> y(k, 0.0);
+    for (std::size_t i = k; i-- > 0;) {
+      double yi{g[i]};
+      for (std::size_t j = i + 1; j < k; ++j) {
+        yi -= h[i * m + j] * y[j];
+      }
+      y[i] = h[i * m + i] != 0.0 ? yi / h[i * m + i] : 0.0;
+    }
+    for (std::size_t j = 0; j < k; ++j) {
+      for (std::size_t i = 0; i < n; ++i) {
+        x[i] += y[j] * v[j][i];
+      }
+    }
+    if (converged) {
+      return;
+    }
+  }
+}
+
+struct PixelSim::DcdtGraph {
+  using Msg = oneapi::tbb::flow::continue_msg;
+  using Node = oneapi::tbb::flow::continue_node<Msg>;
+  oneapi::tbb::flow::graph graph;
+  oneapi::tbb::flow::broadcast_node<Msg> start{graph};
+  std::vector<std::unique_ptr<Node>> nodes;
+};
+
+void PixelSim::buildDcdtGraph() {
+  using Msg = DcdtGraph::Msg;
+  using Node = DcdtGraph::Node;
+  dcdtGraph = std::make_unique<DcdtGraph>();
+  auto &g{*dcdtGraph};
+  auto addNode{[&g](auto &&body) {
+    return g.nodes
+        .emplace_back(std::make_unique<Node>(
+            g.graph, [body](const Msg &) { body(); }))
+        .get();
+  }};
+  // the last node to write to the dcdt of each compartment
+  std::vector<Node *> lastWriter;
+  lastWriter.reserve(simCompartments.size());
+  for (auto &sim : simCompartments) {
+    auto *node{addNode([s = sim.get(), this]() {
+      if (hasImplicitDiffusion(integrator)) {
+        s->evaluateReactions_tbb();
+      } else {
+        s->evaluateReactionsAndDiffusion_tbb();
+      }
+    })};
+    oneapi::tbb::flow::make_edge(g.start, *node);
+    lastWriter.push_back(node);
+  }
+  // each membrane depends on its compartments, and on any previous membrane
+  // that writes to the same compartment, so that membrane contributions are
+  // added in the same order as without the graph
+  auto compartmentIndex{[this](const SimCompartment *c) {
+    return static_cast<std::size_t>(
+        std::find_if(simCompartments.cbegin(), simCompartments.cend(),
+                     [c](const auto &sc) { return sc.get() == c; }) -
+        simCompartments.cbegin());
+  }};
+  for (auto &sim : simMembranes) {
+    auto *node{addNode([s = sim.get()]() { s->evaluateReactions_tbb(); })};
+    std::vector<Node *> predecessors;
+    for (const auto *c : {sim->getCompartmentA(), sim->getCompartmentB()}) {
+      if (c == nullptr) {
+        continue;
+      }
+      auto i{compartmentIndex(c)};
+      if (std::find(predecessors.cbegin(), predecessors.cend(),
+                    lastWriter[i]) == predecessors.cend()) {
+        predecessors.push_back(lastWriter[i]);
+      }
+      lastWriter[i] = node;
+    }
+    for (auto *predecessor : predecessors) {
+      oneapi::tbb::flow::make_edge(*predecessor, *node);
+    }
+    if (predecessors.empty()) {
+      oneapi::tbb::flow::make_edge(g.start, *node);
+    }
+  }
+  for (std::size_t i = 0; i < simCompartments.size(); ++i) {
+    auto *node{addNode([s = simCompartments[i].get()]() {
+      s->spatiallyAverageDcdt();
+      s->updateActiveTiles_tbb();
+    })};
+    oneapi::tbb::flow::make_edge(*lastWriter[i], *node);
+  }
+}
+
 void PixelSim::calculateDcdt() {
+  if (isMultirateSubstep) {
+    // membrane fluxes are held constant between synchronisation points
+    for (auto *sim : steppedCompartments) {
+      if (useTBB) {
+        sim->evaluateReactionsAndDiffusion_tbb();
+      } else {
+        sim->evaluateReactionsAndDiffusion();
+      }
+      sim->addMembraneFluxes();
+      sim->spatiallyAverageDcdt();
+      if (useTBB) {
+        sim->updateActiveTiles_tbb();
+      } else {
+        sim->updateActiveTiles();
+      }
+    }
+    return;
+  }
+  if (dcdtGraph != nullptr) {
+    dcdtGraph->start.try_put(DcdtGraph::Msg{});
+    dcdtGraph->graph.wait_for_all();
+    return;
+  }
   // calculate dcd/dt in all compartments
+  // (IMEX, Rosenbrock: diffusion is done implicitly after the reactions)
   for (auto &sim : simCompartments) {
-    if (useTBB) {
+    if (hasImplicitDiffusion(integrator)) {
+      if (useTBB) {
+        sim->evaluateReactions_tbb();
+      } else {
+        sim->evaluateReactions();
+      }
+    } else if (useTBB) {
       sim->evaluateReactionsAndDiffusion_tbb();
     } else {
       sim->evaluateReactionsAndDiffusion();
@@ -29,17 +267,204 @@ void PixelSim::calculateDcdt() {
   }
   // membrane contribution to dc/dt
   for (auto &sim : simMembranes) {
-    sim->evaluateReactions();
+    if (useTBB) {
+      sim->evaluateReactions_tbb();
+    } else {
+      sim->evaluateReactions();
+    }
   }
   for (auto &sim : simCompartments) {
     sim->spatiallyAverageDcdt();
+    if (useTBB) {
+      sim->updateActiveTiles_tbb();
+    } else {
+      sim->updateActiveTiles();
+    }
+  }
+}
+
+void PixelSim::doDiffusionTimestep(SimCompartment *sim, double dt,
+                                   bool isFirstHalfStep) {
+  // compartments with spectral diffusion use Strang splitting: an exact
+  // diffusion half step before and after the reactions, the others use Lie
+  // splitting: a backwards Euler diffusion step after the reactions
+  if (sim->hasSpectralDiffusion()) {
+    if (useTBB) {
+      sim->doSpectralDiffusionTimestep_tbb(0.5 * dt);
+    } else {
+      sim->doSpectralDiffusionTimestep(0.5 * dt);
+    }
+  } else if (!isFirstHalfStep) {
+    if (useTBB) {
+      sim->doImplicitDiffusionTimestep_tbb(dt);
+    } else {
+      sim->doImplicitDiffusionTimestep(dt);
+    }
+  }
+}
+
+void PixelSim::doIMEX(double dt) {
+  // IMEX Euler: forwards Euler for reactions, backwards Euler (or exact
+  // spectral) for diffusion, so stable for any timestep for pure diffusion
+  for (auto &sim : simCompartments) {
+    doDiffusionTimestep(sim.get(), dt, true);
+  }
+  calculateDcdt();
+  for (auto &sim : simCompartments) {
+    if (useTBB) {
+      sim->doForwardsEulerTimestep_tbb(dt);
+    } else {
+      sim->doForwardsEulerTimestep(dt);
+    }
+    doDiffusionTimestep(sim.get(), dt, false);
+  }
+}
+
+void PixelSim::doRosenbrock(double dt) {
+  // linearly implicit Euler step for the reactions, with backwards Euler (or
+  // exact spectral) diffusion, so stiff reaction terms don't limit the
+  // timestep
+  for (auto &sim : simCompartments) {
+    doDiffusionTimestep(sim.get(), dt, true);
+  }
+  calculateDcdt();
+  for (auto &sim : simCompartments) {
+    if (useTBB) {
+      sim->doLinearlyImplicitReactionTimestep_tbb(dt);
+    } else {
+      sim->doLinearlyImplicitReactionTimestep(dt);
+    }
+    doDiffusionTimestep(sim.get(), dt, false);
+  }
+}
+
+void PixelSim::doStepDoubling(double dt) {
+  // the result of a single step of dt is stored in s2, and the result of two
+  // steps of dt/2 is used as the new concentration
+  auto doStep{[this](double h) {
+    if (integrator == PixelIntegratorType::IMEX) {
+      doIMEX(h);
+    } else {
+      doRosenbrock(h);
+    }
+  }};
+  for (auto *sim : steppedCompartments) {
+    sim->doRKInit();
+  }
+  doStep(dt);
+  for (auto *sim : steppedCompartments) {
+    sim->doStepDoublingRestart();
+  }
+  doStep(0.5 * dt);
+  doStep(0.5 * dt);
+  QElapsedTimer timer;
+  timer.start();
+  rkError = {0.0, 0.0};
+  for (const auto *sim : steppedCompartments) {
+    if (useTBB) {
+      rkError = maxError(rkError, sim->calculateRKError_tbb(epsilon));
+    } else {
+      rkError = maxError(rkError, sim->calculateRKError(epsilon));
+    }
+  }
+  timestepStatistics.errorEstimateSeconds +=
+      1e-9 * static_cast<double>(timer.nsecsElapsed());
+}
+
+// coefficients of the s stages of the damped second order RKC method, see
+// https://doi.org/10.1016/S0377-0427(97)00219-7
+static std::vector<RKCStage> getRKCStages(std::size_t s) {
+  constexpr double damping{2.0 / 13.0};
+  const auto sd{static_cast<double>(s)};
+  const double w0{1.0 + damping / (sd * sd)};
+  // Chebyshev polynomials T_j(w0) and their first two derivatives
+  std::vector<double> cheb(s + 1);
+  std::vector<double> dCheb(s + 1);
+  std::vector<double> d2Cheb(s + 1);
+  cheb[0] = 1.0;
+  cheb[1] = w0;
+  dCheb[0] = 0.0;
+  dCheb[1] = 1.0;
+  d2Cheb[0] = 0.0;
+  d2Cheb[1] = 0.0;
+  for (std::size_t j = 2; j <= s; ++j) {
+    cheb[j] = 2.0 * w0 * cheb[j - 1] - cheb[j - 2];
+    dCheb[j] = 2.0 * cheb[j - 1] + 2.0 * w0 * dCheb[j - 1] - dCheb[j - 2];
+    d2Cheb[j] = 4.0 * dCheb[j - 1] + 2.0 * w0 * d2Cheb[j - 1] - d2Cheb[j - 2];
+  }
+  const double w1{dCheb[s] / d2Cheb[s]};
+  std::vector<double> b(s + 1);
+  for (std::size_t j = 2; j <= s; ++j) {
+    b[j] = d2Cheb[j] / (dCheb[j] * dCheb[j]);
   }
+  b[0] = b[2];
+  b[1] = b[2];
+  std::vector<RKCStage> stages(s);
+  // first stage: conc = conc + muTilde_1 dt dcdt
+  stages[0] = {1.0, 0.0, b[1] * w1, 0.0};
+  for (std::size_t j = 2; j <= s; ++j) {
+    auto &stage{stages[j - 1]};
+    stage.mu = 2.0 * b[j] * w0 / b[j - 1];
+    stage.nu = -b[j] / b[j - 2];
+    stage.muTilde = 2.0 * b[j] * w1 / b[j - 1];
+    stage.gammaTilde = -(1.0 - b[j - 1] * cheb[j - 1]) * stage.muTilde;
+  }
+  return stages;
+}
+
+void PixelSim::doRKC(double dt) {
+  // RKC: the stability interval along the negative real axis is roughly
+  // 0.653 s^2 for s stages, choose s such that it contains dt times the
+  // spectral radius of the diffusion operator, which is 2/maxStableTimestep
+  const double spectralRadius{2.0 / maxStableTimestep};
+  const std::size_t nStages{std::max(
+      std::size_t{2}, 1 + static_cast<std::size_t>(
+                              std::sqrt(1.0 + 1.54 * dt * spectralRadius)))};
+  SPDLOG_TRACE("RKC with {} stages", nStages);
+  if (nStages != rkcStages.size()) {
+    rkcStages = getRKCStages(nStages);
+  }
+  if (!isRKCDcdtCurrent) {
+    calculateDcdt();
+  }
+  for (auto &sim : simCompartments) {
+    sim->doRKCInit();
+  }
+  for (std::size_t j = 0; j < nStages; ++j) {
+    if (j > 0) {
+      calculateDcdt();
+    }
+    for (auto &sim : simCompartments) {
+      if (useTBB) {
+        sim->doRKCSubstep_tbb(dt, rkcStages[j]);
+      } else {
+        sim->doRKCSubstep(dt, rkcStages[j]);
+      }
+    }
+  }
+  // embedded error estimate of Sommeijer et al, see
+  // https://doi.org/10.1016/S0377-0427(97)00219-7, which uses dcdt at the end
+  // of the step
+  calculateDcdt();
+  isRKCDcdtCurrent = true;
+  QElapsedTimer timer;
+  timer.start();
+  rkError = {0.0, 0.0};
+  for (auto &sim : simCompartments) {
+    if (useTBB) {
+      rkError = maxError(rkError, sim->doRKCFinalise_tbb(dt, epsilon));
+    } else {
+      rkError = maxError(rkError, sim->doRKCFinalise(dt, epsilon));
+    }
+  }
+  timestepStatistics.errorEstimateSeconds +=
+      1e-9 * static_cast<double>(timer.nsecsElapsed());
 }
 
 void PixelSim::doRK101(double dt) {
   // RK1(0)1: Forwards Euler, no error estimate
   calculateDcdt();
-  for (auto &sim : simCompartments) {
+  for (auto *sim : steppedCompartments) {
     if (useTBB) {
       sim->doForwardsEulerTimestep_tbb(dt);
     } else {
@@ -52,8 +477,14 @@ void PixelSim::doRK212(double dt) {
   // RK2(1)2: Heun / Modified Euler, with embedded forwards Euler error
   // estimate Shu-Osher form used here taken from eq(2.15) of
   // https://doi.org/10.1016/0021-9991(88)90177-5
+  if (useFusedRKStages) {
+    // same update expressed as two general Shu-Osher stages
+    doFusedRKSubstep(dt, {1.0, 0.0, 0.0, 1.0, 0.0, true});
+    doFusedRKSubstep(dt, {0.5, 0.0, 0.5, 0.5, 1.0, false, true, 0.0, 1.0, 0.0});
+    return;
+  }
   calculateDcdt();
-  for (auto &sim : simCompartments) {
+  for (auto *sim : steppedCompartments) {
     if (useTBB) {
       sim->doRK212Substep1_tbb(dt);
     } else {
@@ -61,13 +492,18 @@ void PixelSim::doRK212(double dt) {
     }
   }
   calculateDcdt();
-  for (auto &sim : simCompartments) {
+  QElapsedTimer timer;
+  timer.start();
+  rkError = {0.0, 0.0};
+  for (auto *sim : steppedCompartments) {
     if (useTBB) {
-      sim->doRK212Substep2_tbb(dt);
+      rkError = maxError(rkError, sim->doRK212Substep2_tbb(dt, epsilon));
     } else {
-      sim->doRK212Substep2(dt);
+      rkError = maxError(rkError, sim->doRK212Substep2(dt, epsilon));
     }
   }
+  timestepStatistics.errorEstimateSeconds +=
+      1e-9 * static_cast<double>(timer.nsecsElapsed());
 }
 
 void PixelSim::doRK323(double dt) {
@@ -79,15 +515,20 @@ void PixelSim::doRK323(double dt) {
   constexpr std::array<double, 3> g3{0.0, 0.75, 0.333333333333333333333};
   constexpr std::array<double, 3> beta{1.0, 0.25, 0.6666666666666666666};
   constexpr std::array<double, 3> delta{0.0, 0.0, 1.0};
-  for (auto &sim : simCompartments) {
+  if (useFusedRKStages) {
+    for (std::size_t i = 0; i < 3; ++i) {
+      doFusedRKSubstep(dt, {g1[i], g2[i], g3[i], beta[i], delta[i], i == 0,
+                            i == 2, 0.0, 2.0, -1.0});
+    }
+    return;
+  }
+  for (auto *sim : steppedCompartments) {
     sim->doRKInit();
   }
   for (std::size_t i = 0; i < 3; ++i) {
     doRKSubstep(dt, g1[i], g2[i], g3[i], beta[i], delta[i]);
   }
-  for (auto &sim : simCompartments) {
-    sim->doRKFinalise(0.0, 2.0, -1.0);
-  }
+  doRKFinalise(0.0, 2.0, -1.0);
 }
 
 void PixelSim::doRK435(double dt) {
@@ -111,21 +552,27 @@ void PixelSim::doRK435(double dt) {
                                         -0.655568367959557,
                                         -0.194421504490852};
   double deltaSum = 1.0 / common::sum(delta);
-  for (auto &sim : simCompartments) {
+  if (useFusedRKStages) {
+    for (std::size_t i = 0; i < 5; ++i) {
+      doFusedRKSubstep(dt, {g1[i], g2[i], g3[i], beta[i], delta[i], i == 0,
+                            i == 4, deltaSum * delta[5], deltaSum,
+                            deltaSum * delta[6]});
+    }
+    return;
+  }
+  for (auto *sim : steppedCompartments) {
     sim->doRKInit();
   }
   for (std::size_t i = 0; i < 5; ++i) {
     doRKSubstep(dt, g1[i], g2[i], g3[i], beta[i], delta[i]);
   }
-  for (auto &sim : simCompartments) {
-    sim->doRKFinalise(deltaSum * delta[5], deltaSum, deltaSum * delta[6]);
-  }
+  doRKFinalise(deltaSum * delta[5], deltaSum, deltaSum * delta[6]);
 }
 
 void PixelSim::doRKSubstep(double dt, double g1, double g2, double g3,
                            double beta, double delta) {
   calculateDcdt();
-  for (auto &sim : simCompartments) {
+  for (auto *sim : steppedCompartments) {
     if (useTBB) {
       sim->doRKSubstep_tbb(dt, g1, g2, g3, beta, delta);
     } else {
@@ -134,6 +581,67 @@ void PixelSim::doRKSubstep(double dt, double g1, double g2, double g3,
   }
 }
 
+void PixelSim::doRKFinalise(double cFactor, double s2Factor,
+                            double s3Factor) {
+  // lower order solution and error estimate in a single pass
+  QElapsedTimer timer;
+  timer.start();
+  rkError = {0.0, 0.0};
+  for (auto *sim : steppedCompartments) {
+    if (useTBB) {
+      rkError = maxError(
+          rkError, sim->doRKFinalise_tbb(cFactor, s2Factor, s3Factor, epsilon));
+    } else {
+      rkError = maxError(
+          rkError, sim->doRKFinalise(cFactor, s2Factor, s3Factor, epsilon));
+    }
+  }
+  timestepStatistics.errorEstimateSeconds +=
+      1e-9 * static_cast<double>(timer.nsecsElapsed());
+}
+
+void PixelSim::doFusedRKSubstep(double dt, const FusedRKStage &stage) {
+  // only used if there are no membranes or non-spatial species, so the dcdt
+  // of each pixel only depends on the concentrations in its compartment
+  QElapsedTimer timer;
+  timer.start();
+  rkError = {0.0, 0.0};
+  for (auto *sim : steppedCompartments) {
+    if (useTBB) {
+      rkError =
+          maxError(rkError, sim->doFusedRKSubstep_tbb(dt, stage, epsilon));
+    } else {
+      rkError = maxError(rkError, sim->doFusedRKSubstep(dt, stage, epsilon));
+    }
+  }
+  if (stage.finalise) {
+    timestepStatistics.errorEstimateSeconds +=
+        1e-9 * static_cast<double>(timer.nsecsElapsed());
+  }
+}
+
+// PI controller limits on the factor by which the timestep can change in a
+// single step, and on the ratio of the allowed to the actual error
+static constexpr double maxStepIncrease{5.0};
+static constexpr double maxStepDecrease{0.2};
+static constexpr double maxStepErrFactor{1e4};
+
+// number of dcdt evaluations in each step of an adaptive RK integrator
+static std::size_t getNumberOfStages(PixelIntegratorType integrator) {
+  if (integrator == PixelIntegratorType::RK212) {
+    return 2;
+  } else if (integrator == PixelIntegratorType::RK323) {
+    return 3;
+  } else if (integrator == PixelIntegratorType::RK435) {
+    return 5;
+  } else if (integrator == PixelIntegratorType::IMEX ||
+             integrator == PixelIntegratorType::Rosenbrock) {
+    // step doubling: a step of dt and two steps of dt/2
+    return 3;
+  }
+  return 1;
+}
+
 static double getErrorPower(PixelIntegratorType integrator) {
   double errPower{1.0};
   if (integrator == PixelIntegratorType::RK212) {
@@ -142,6 +650,12 @@ static double getErrorPower(PixelIntegratorType integrator) {
     errPower = 1.0 / 3.0;
   } else if (integrator == PixelIntegratorType::RK435) {
     errPower = 1.0 / 4.0;
+  } else if (integrator == PixelIntegratorType::IMEX ||
+             integrator == PixelIntegratorType::Rosenbrock) {
+    // local error of a first order step is O(dt^2)
+    errPower = 1.0 / 2.0;
+  } else if (integrator == PixelIntegratorType::RKC) {
+    errPower = 1.0 / 3.0;
   }
   return errPower;
 }
@@ -153,32 +667,56 @@ double PixelSim::doRKAdaptive(double dtMax) {
   double errPower = getErrorPower(integrator);
   do {
     // do timestep
-    dt = std::min(nextTimestep, dtMax);
+    dt = std::min(timestepState.nextTimestep, dtMax);
     if (integrator == PixelIntegratorType::RK212) {
       doRK212(dt);
     } else if (integrator == PixelIntegratorType::RK323) {
       doRK323(dt);
     } else if (integrator == PixelIntegratorType::RK435) {
       doRK435(dt);
+    } else if (integrator == PixelIntegratorType::IMEX) {
+      // timestep not limited by stability of diffusion
+      doStepDoubling(dt);
+    } else if (integrator == PixelIntegratorType::Rosenbrock) {
+      // timestep not limited by stability of diffusion or stiff reactions
+      doStepDoubling(dt);
+    } else if (integrator == PixelIntegratorType::RKC) {
+      // number of stages increases with timestep to keep diffusion stable
+      doRKC(dt);
     }
-    // calculate error
-    err.abs = 0;
-    err.rel = 0;
-    for (const auto &sim : simCompartments) {
-      auto compErr = sim->calculateRKError(epsilon);
-      err.rel = std::max(err.rel, compErr.rel);
-      err.abs = std::max(err.abs, compErr.abs);
-    }
+    // error is calculated during the final stage of the timestep
+    err = rkError;
+    bool rejected{err.abs > errMax.abs || err.rel > errMax.rel};
     // calculate new timestep
     double errFactor = std::min(errMax.abs / err.abs, errMax.rel / err.rel);
-    errFactor = std::pow(errFactor, errPower);
-    nextTimestep = std::min(0.95 * dt * errFactor, dtMax);
+    double dtFactor{0.95 * std::pow(errFactor, errPower)};
+    if (stepController == PixelStepController::PI) {
+      // PI controller, see e.g. section IV.2 of Hairer & Wanner, Solving
+      // Ordinary Differential Equations II: errFactor is bounded to avoid a
+      // zero error giving an infinite timestep
+      errFactor = std::min(errFactor, maxStepErrFactor);
+      if (!rejected) {
+        dtFactor = 0.95 * std::pow(errFactor, 0.7 * errPower) *
+                   std::pow(timestepState.previousErrFactor, -0.4 * errPower);
+        timestepState.previousErrFactor = errFactor;
+      }
+      // don't increase the timestep straight after a rejected step
+      double maxFactor{rejected || timestepState.previousStepRejected
+                           ? 1.0
+                           : maxStepIncrease};
+      dtFactor = std::clamp(dtFactor, maxStepDecrease, maxFactor);
+    }
+    timestepState.previousStepRejected = rejected;
+    // a multirate sub-cycle ends with a short step to the synchronisation
+    // point, which shouldn't limit the size of the next sub-cycle steps
+    timestepState.nextTimestep =
+        std::min(dt * dtFactor, isMultirateSubstep ? maxTimestep : dtMax);
     SPDLOG_TRACE("dt = {} gave rel err = {}, abs err = {} -> new dt = {}", dt,
-                 err.rel, err.abs, nextTimestep);
-    if (nextTimestep / dtMax < 1e-20) {
+                 err.rel, err.abs, timestepState.nextTimestep);
+    if (timestepState.nextTimestep / dtMax < 1e-20) {
       currentErrorImage = {};
       std::string problemSpecies{"unknown"};
-      for (const auto &sim : simCompartments) {
+      for (const auto *sim : steppedCompartments) {
         auto speciesName{sim->plotRKError(currentErrorImage, epsilon, err.rel)};
         if (!speciesName.empty()) {
           problemSpecies = speciesName;
@@ -190,12 +728,20 @@ double PixelSim::doRKAdaptive(double dtMax) {
           "of the pixels with the largest relative integration error are shown "
           "below in red:",
           problemSpecies);
-      return nextTimestep;
+      return timestepState.nextTimestep;
     }
-    if (err.abs > errMax.abs || err.rel > errMax.rel) {
+    if (rejected) {
       SPDLOG_TRACE("discarding step");
       ++discardedSteps;
-      for (auto &sim : simCompartments) {
+      ++timestepStatistics.rejectedSteps;
+      if (integrator == PixelIntegratorType::RKC) {
+        // stages and the dcdt evaluation of the error estimate
+        timestepStatistics.wastedEvaluations += rkcStages.size() + 1;
+        isRKCDcdtCurrent = false;
+      } else {
+        timestepStatistics.wastedEvaluations += getNumberOfStages(integrator);
+      }
+      for (auto *sim : steppedCompartments) {
         sim->undoRKStep();
       }
     }
@@ -203,12 +749,163 @@ double PixelSim::doRKAdaptive(double dtMax) {
   return dt;
 }
 
+void PixelSim::addAcceptedStep(double dt) {
+  ++timestepStatistics.acceptedSteps;
+  timestepStatistics.minTimestep = std::min(timestepStatistics.minTimestep, dt);
+  timestepStatistics.maxTimestep = std::max(timestepStatistics.maxTimestep, dt);
+}
+
+void PixelSim::evaluateMembraneFluxes() {
+  for (auto &sim : simCompartments) {
+    sim->clearDcdt();
+  }
+  for (auto &sim : simMembranes) {
+    if (useTBB) {
+      sim->evaluateReactions_tbb();
+    } else {
+      sim->evaluateReactions();
+    }
+  }
+}
+
+double PixelSim::doMultirate(double dtMax) {
+  // synchronisation step: the largest timestep of any compartment, so the
+  // slowest compartment does a single step, the others sub-cycle
+  double dtSync{0.0};
+  for (std::size_t i = 0; i < simCompartments.size(); ++i) {
+    dtSync = std::max(dtSync, integrator == PixelIntegratorType::RK101
+                                  ? simCompartments[i]->getMaxStableTimestep()
+                                  : compartmentTimestepStates[i].nextTimestep);
+  }
+  // also limited by the error from holding the membrane fluxes constant
+  dtSync = std::min({dtSync, dtMax, maxSyncTimestep});
+  // membrane fluxes at the synchronisation point
+  if (!areMembraneFluxesCurrent) {
+    evaluateMembraneFluxes();
+    for (auto &sim : simCompartments) {
+      sim->storeMembraneFluxes();
+    }
+  }
+  for (auto &sim : simCompartments) {
+    sim->storeSyncConcentrations();
+  }
+  constexpr double relativeTolerance = 1e-12;
+  while (true) {
+    // advance each compartment independently to the synchronisation point
+    const std::size_t previousAcceptedSteps{timestepStatistics.acceptedSteps};
+    isMultirateSubstep = true;
+    for (std::size_t i = 0; i < simCompartments.size(); ++i) {
+      auto *sim{simCompartments[i].get()};
+      steppedCompartments = {sim};
+      std::swap(timestepState, compartmentTimestepStates[i]);
+      double t{0.0};
+      while (t + dtSync * relativeTolerance < dtSync &&
+             currentErrorMessage.empty()) {
+        double dt{dtSync - t};
+        if (integrator == PixelIntegratorType::RK101) {
+          dt = std::min(dt, sim->getMaxStableTimestep());
+          doRK101(dt);
+        } else {
+          dt = doRKAdaptive(dt);
+        }
+        if (currentErrorMessage.empty()) {
+          addAcceptedStep(dt);
+        }
+        t += dt;
+      }
+      std::swap(timestepState, compartmentTimestepStates[i]);
+    }
+    isMultirateSubstep = false;
+    steppedCompartments.clear();
+    for (auto &sim : simCompartments) {
+      steppedCompartments.push_back(sim.get());
+    }
+    if (!currentErrorMessage.empty()) {
+      return dtSync;
+    }
+    // coupling error: compare the constant membrane fluxes with those at the
+    // end of the synchronisation step
+    evaluateMembraneFluxes();
+    PixelIntegratorError err{0.0, 0.0};
+    for (const auto &sim : simCompartments) {
+      err = maxError(err, sim->calculateMembraneFluxError(dtSync, epsilon));
+    }
+    // the local error of holding the fluxes constant is O(dt^2)
+    double errFactor{std::min(
+        {errMax.abs / err.abs, errMax.rel / err.rel, maxStepErrFactor})};
+    maxSyncTimestep = dtSync * std::clamp(0.95 * std::sqrt(errFactor),
+                                          maxStepDecrease, maxStepIncrease);
+    SPDLOG_TRACE("dtSync = {} gave rel err = {}, abs err = {} -> new max "
+                 "dtSync = {}",
+                 dtSync, err.rel, err.abs, maxSyncTimestep);
+    if (err.abs <= errMax.abs && err.rel <= errMax.rel) {
+      // fluxes at the end of this step are used for the next one
+      for (auto &sim : simCompartments) {
+        sim->storeMembraneFluxes();
+      }
+      areMembraneFluxesCurrent = true;
+      return dtSync;
+    }
+    SPDLOG_TRACE("discarding synchronisation step");
+    // all sub-steps since the previous synchronisation point are discarded
+    const std::size_t discardedSubsteps{timestepStatistics.acceptedSteps -
+                                        previousAcceptedSteps};
+    timestepStatistics.acceptedSteps = previousAcceptedSteps;
+    timestepStatistics.rejectedSteps += discardedSubsteps;
+    timestepStatistics.wastedEvaluations +=
+        discardedSubsteps * getNumberOfStages(integrator);
+    discardedSteps += discardedSubsteps;
+    for (auto &sim : simCompartments) {
+      sim->restoreSyncConcentrations();
+    }
+    dtSync = maxSyncTimestep;
+    if (dtSync / dtMax < 1e-20) {
+      currentErrorMessage = "Failed to solve model to required accuracy: "
+                            "the membrane fluxes change too rapidly for "
+                            "multirate sub-cycling";
+      return dtSync;
+    }
+  }
+}
+
+static void checkEnsembleParameters(const model::Model &doc,
+                                    const EnsembleParameters &ensemble) {
+  if (!doc.getEvents().getIds().isEmpty()) {
+    throw std::runtime_error(
+        "Ensemble simulations do not support models with events");
+  }
+  if (ensemble.parameterIds.empty()) {
+    throw std::runtime_error("Ensemble simulation has no parameters");
+  }
+  const auto constants{doc.getParameters().getGlobalConstants()};
+  for (const auto &id : ensemble.parameterIds) {
+    if (!doc.getParameters().getIds().contains(id.c_str()) ||
+        std::none_of(constants.cbegin(), constants.cend(),
+                     [&id](const auto &c) { return c.id == id; })) {
+      throw std::runtime_error(
+          fmt::format("Ensemble parameter '{}' is not a constant parameter "
+                      "of the model",
+                      id));
+    }
+  }
+  for (const auto &values : ensemble.values) {
+    if (values.size() != ensemble.parameterIds.size()) {
+      throw std::runtime_error(
+          fmt::format("Ensemble member has {} parameter values, expected {}",
+                      values.size(), ensemble.parameterIds.size()));
+    }
+  }
+}
+
 PixelSim::PixelSim(
     const model::Model &sbmlDoc, const std::vector<std::string> &compartmentIds,
     const std::vector<std::vector<std::string>> &compartmentSpeciesIds,
-    const std::map<std::string, double, std::less<>> &substitutions)
+    const std::map<std::string, double, std::less<>> &substitutions,
+    const EnsembleParameters &ensemble)
     : doc{sbmlDoc},
       integrator{sbmlDoc.getSimulationSettings().options.pixel.integrator},
+      stepController{
+          sbmlDoc.getSimulationSettings().options.pixel.stepController},
       errMax{sbmlDoc.getSimulationSettings().options.pixel.maxErr},
       maxTimestep{sbmlDoc.getSimulationSettings().options.pixel.maxTimestep},
       numMaxThreads{sbmlDoc.getSimulationSettings().options.pixel.maxThreads} {
@@ -225,6 +922,10 @@ PixelSim::PixelSim(
     if (spaceDependent) {
       nExtraVars += 2;
     }
+    if (ensemble.size() > 0) {
+      checkEnsembleParameters(doc, ensemble);
+      ensembleSize = ensemble.size();
+    }
     // add compartments
     for (std::size_t compIndex = 0; compIndex < compartmentIds.size();
          ++compIndex) {
@@ -235,9 +936,29 @@ PixelSim::PixelSim(
           doc, compartment, speciesIds,
           sbmlDoc.getSimulationSettings().options.pixel.doCSE,
           sbmlDoc.getSimulationSettings().options.pixel.optLevel, timeDependent,
-          spaceDependent, substitutions));
+          spaceDependent, substitutions,
+          sbmlDoc.getSimulationSettings().options.pixel.storageLayout,
+          sbmlDoc.getSimulationSettings().options.pixel.pixelOrdering,
+          integrator == PixelIntegratorType::Rosenbrock, ensemble));
+      if (ensemble.size() > 0 &&
+          simCompartments.back()->hasNonSpatialSpecies()) {
+        throw std::runtime_error(
+            "Ensemble simulations do not support non-spatial species");
+      }
       maxStableTimestep = std::min(
           maxStableTimestep, simCompartments.back()->getMaxStableTimestep());
+      // must be done before the membranes are constructed, as the quadtree
+      // changes the storage indices of the pixels
+      if (auto maxLevel{sbmlDoc.getSimulationSettings()
+                            .options.pixel.quadtreeMaxLevel};
+          maxLevel > 0 && !hasImplicitDiffusion(integrator) &&
+          !simCompartments.back()->hasNonSpatialSpecies() &&
+          ensemble.size() == 0) {
+        simCompartments.back()->setQuadtree(
+            maxLevel,
+            sbmlDoc.getSimulationSettings().options.pixel.quadtreeTolerance);
+        useQuadtree = true;
+      }
     }
     // add membranes
     for (const auto &membrane : doc.getMembranes().getMembranes()) {
@@ -269,20 +990,87 @@ PixelSim::PixelSim(
             doc, &membrane, compA, compB,
             sbmlDoc.getSimulationSettings().options.pixel.doCSE,
             sbmlDoc.getSimulationSettings().options.pixel.optLevel,
-            timeDependent, spaceDependent, substitutions));
+            timeDependent, spaceDependent, substitutions,
+            ensemble.parameterIds));
       }
     }
     // apply existing simulation concentrations if present
     const auto &data{sbmlDoc.getSimulationData()};
     if (data.concentration.size() > 1 && !data.concentration.back().empty() &&
-        (data.concentration.back().size() == simCompartments.size())) {
+        (data.concentration.back().size() == simCompartments.size()) &&
+        ensemble.size() == 0) {
       SPDLOG_INFO("Applying supplied initial concentrations");
+      const auto frame{data.concentration.back()};
       for (std::size_t i = 0; i < simCompartments.size(); ++i) {
-        simCompartments[i]->setConcentrations(data.concentration.back()[i]);
+        // stored concentrations don't include the extra variables
+        const std::size_t nSpecies{compartmentSpeciesIds[i].size()};
+        const std::size_t stride{nSpecies + nExtraVars};
+        auto c{simCompartments[i]->getConcentrations()};
+        const auto &stored{frame[i]};
+        if (nSpecies == 0 || stored.size() / nSpecies * stride != c.size()) {
+          continue;
+        }
+        for (std::size_t ix = 0; ix < stored.size() / nSpecies; ++ix) {
+          for (std::size_t is = 0; is < nSpecies; ++is) {
+            c[ix * stride + is] = stored[ix * nSpecies + is];
+          }
+          if (timeDependent) {
+            c[ix * stride + nSpecies] = data.timePoints.back();
+          }
+        }
+        simCompartments[i]->setConcentrations(c);
+      }
+    }
+    for (auto &sim : simCompartments) {
+      steppedCompartments.push_back(sim.get());
+    }
+    if (hasImplicitDiffusion(integrator) && ensemble.size() == 0) {
+      // rectangular compartments: exact diffusion, any timestep
+      for (auto &sim : simCompartments) {
+        sim->enableSpectralDiffusion();
+      }
+    }
+    if (sbmlDoc.getSimulationSettings().options.pixel.multirate) {
+      useMultirate = simCompartments.size() > 1 &&
+                     !hasImplicitDiffusion(integrator) &&
+                     integrator != PixelIntegratorType::RKC;
+      if (useMultirate) {
+        compartmentTimestepStates.resize(simCompartments.size());
+      } else {
+        SPDLOG_INFO("Model has a single compartment or integrator is not an "
+                    "explicit RK integrator: not using multirate");
       }
     }
     if (sbmlDoc.getSimulationSettings().options.pixel.enableMultiThreading) {
       useTBB = true;
+      buildDcdtGraph();
+    }
+    if (sbmlDoc.getSimulationSettings().options.pixel.fuseRKStages) {
+      useFusedRKStages =
+          simMembranes.empty() &&
+          std::none_of(simCompartments.cbegin(), simCompartments.cend(),
+                       [](const auto &c) { return c->hasNonSpatialSpecies(); });
+      if (!useFusedRKStages) {
+        SPDLOG_INFO("Model has membrane reactions or non-spatial species: "
+                    "not using fused RK stages");
+      }
+    }
+    if (double tol{sbmlDoc.getSimulationSettings()
+                       .options.pixel.activeTileTolerance};
+        tol > 0.0) {
+      if (hasImplicitDiffusion(integrator) || useFusedRKStages ||
+          useQuadtree || timeDependent) {
+        SPDLOG_INFO("Integrator has implicit diffusion, fused RK stages or "
+                    "quadtree cells are used, or reactions depend on time: "
+                    "not using active tiles");
+      } else {
+        for (auto &sim : simCompartments) {
+          // non-spatial species couple all pixels in the compartment
+          if (!sim->hasNonSpatialSpecies()) {
+            sim->setActiveTileTolerance(tol);
+          }
+        }
+      }
     }
     if (numMaxThreads == 0) {
       // 0 means use all available threads
@@ -310,21 +1098,43 @@ std::size_t PixelSim::run(double time, double timeout_ms,
   double tNow = 0;
   std::size_t steps = 0;
   discardedSteps = 0;
+  [[maybe_unused]] const double errorEstimateSeconds{
+      timestepStatistics.errorEstimateSeconds};
+  // concentrations may have been modified since the last call
+  isRKCDcdtCurrent = false;
+  areMembraneFluxesCurrent = false;
+  if (useQuadtree) {
+    // merge or split quadtree cells using the current concentrations
+    for (auto &sim : simCompartments) {
+      sim->regrid();
+    }
+  }
   // do timesteps until we reach t
   constexpr double relativeTolerance = 1e-12;
   while (tNow + time * relativeTolerance < time) {
     double maxDt = std::min(maxTimestep, time - tNow);
-    if (integrator == PixelIntegratorType::RK101) {
-      double timestep = std::min(maxDt, maxStableTimestep);
+    double timestep{maxDt};
+    if (useMultirate) {
+      // each compartment sub-cycles with its own timestep: these sub-steps
+      // are added to the timestep statistics by doMultirate
+      timestep = doMultirate(maxDt);
+      if (!currentErrorMessage.empty()) {
+        return steps;
+      }
+    } else if (integrator == PixelIntegratorType::RK101) {
+      timestep = std::min(maxDt, maxStableTimestep);
       doRK101(timestep);
-      tNow += timestep;
     } else {
-      tNow += doRKAdaptive(maxDt);
+      timestep = doRKAdaptive(maxDt);
       if (!currentErrorMessage.empty()) {
         return steps;
       }
     }
+    tNow += timestep;
     ++steps;
+    if (!useMultirate) {
+      addAcceptedStep(timestep);
+    }
     if (timeout_ms >= 0.0 &&
         static_cast<double>(timer.elapsed()) >= timeout_ms) {
       SPDLOG_DEBUG("Simulation timeout: requesting stop");
@@ -344,9 +1154,129 @@ std::size_t PixelSim::run(double time, double timeout_ms,
                steps + discardedSteps,
                static_cast<double>(100 * discardedSteps) /
                    static_cast<double>(steps + discardedSteps));
+  SPDLOG_DEBUG(
+      "  - {:.1f}ms of {}ms spent in final RK stage & error estimate",
+      (timestepStatistics.errorEstimateSeconds - errorEstimateSeconds) * 1e3,
+      timer.elapsed());
   return steps;
 }
 
+void PixelSim::evaluateDcdt() {
+  oneapi::tbb::global_control control(
+      oneapi::tbb::global_control::max_allowed_parallelism, numMaxThreads);
+  // evaluate every pixel, including the tiles that the integrator skips
+  for (auto &sim : simCompartments) {
+    if (useTBB) {
+      sim->evaluateReactionsAndDiffusion_tbb(true);
+    } else {
+      sim->evaluateReactionsAndDiffusion(true);
+    }
+  }
+  for (auto &sim : simMembranes) {
+    if (useTBB) {
+      sim->evaluateReactions_tbb();
+    } else {
+      sim->evaluateReactions();
+    }
+  }
+  for (auto &sim : simCompartments) {
+    sim->spatiallyAverageDcdt();
+  }
+}
+
+std::pair<double, std::size_t>
+PixelSim::solveSteadyState(double tolerance, std::size_t maxIterations) {
+  // unknowns x are the concentrations of all compartments, residual f is the
+  // corresponding dcdt
+  std::vector<std::size_t> offsets{0};
+  for (const auto &sim : simCompartments) {
+    offsets.push_back(offsets.back() + sim->getStateSize(nExtraVars));
+  }
+  const std::size_t n{offsets.back()};
+  auto evaluateResidual{[this, &offsets](const std::vector<double> &x,
+                                         std::vector<double> &f) {
+    for (std::size_t i = 0; i < simCompartments.size(); ++i) {
+      simCompartments[i]->setState(x.data() + offsets[i], nExtraVars);
+    }
+    evaluateDcdt();
+    for (std::size_t i = 0; i < simCompartments.size(); ++i) {
+      simCompartments[i]->getStateDcdt(f.data() + offsets[i], nExtraVars);
+    }
+  }};
+  std::vector<double> x(n, 0.0);
+  for (std::size_t i = 0; i < simCompartments.size(); ++i) {
+    simCompartments[i]->getState(x.data() + offsets[i], nExtraVars);
+  }
+  std::vector<double> f(n, 0.0);
+  evaluateResidual(x, f);
+  const std::vector<double> x0{x};
+  const double fNormInf0{normInf(f)};
+  std::vector<double> rhs(n, 0.0);
+  std::vector<double> dx(n, 0.0);
+  std::vector<double> xTrial(n, 0.0);
+  std::vector<double> fTrial(n, 0.0);
+  // Jacobian-vector product J v = (f(x + eps v) - f(x)) / eps
+  std::vector<double> xEps(n, 0.0);
+  auto applyJacobian{[&](const std::vector<double> &v,
+                         std::vector<double> &jv) {
+    const double vNorm{norm2(v)};
+    if (vNorm == 0.0) {
+      std::fill(jv.begin(), jv.end(), 0.0);
+      return;
+    }
+    const double eps{
+        std::sqrt((1.0 + norm2(x)) * std::numeric_limits<double>::epsilon()) /
+        vNorm};
+    for (std::size_t i = 0; i < n; ++i) {
+      xEps[i] = x[i] + eps * v[i];
+    }
+    evaluateResidual(xEps, jv);
+    for (std::size_t i = 0; i < n; ++i) {
+      jv[i] = (jv[i] - f[i]) / eps;
+    }
+  }};
+  constexpr double krylovRelTol{1e-3};
+  constexpr std::size_t maxKrylovIterations{200};
+  constexpr std::size_t maxLineSearchSteps{10};
+  std::size_t iteration{0};
+  while (iteration < maxIterations && normInf(f) >= tolerance &&
+         !stopRequested.load()) {
+    // solve J dx = -f
+    for (std::size_t i = 0; i < n; ++i) {
+      rhs[i] = -f[i];
+    }
+    solveGMRES(applyJacobian, rhs, dx, krylovRelTol, maxKrylovIterations);
+    // backtracking line search on |f|
+    const double fNorm{norm2(f)};
+    double lambda{1.0};
+    bool accepted{false};
+    for (std::size_t k = 0; k < maxLineSearchSteps && !accepted; ++k) {
+      for (std::size_t i = 0; i < n; ++i) {
+        xTrial[i] = x[i] + lambda * dx[i];
+      }
+      evaluateResidual(xTrial, fTrial);
+      accepted = norm2(fTrial) < (1.0 - 1e-4 * lambda) * fNorm;
+      lambda *= 0.5;
+    }
+    if (!accepted) {
+      SPDLOG_DEBUG("Newton-Krylov: line search failed");
+      break;
+    }
+    std::swap(x, xTrial);
+    std::swap(f, fTrial);
+    ++iteration;
+    SPDLOG_DEBUG("Newton-Krylov iteration {}: max |dcdt| = {}", iteration,
+                 normInf(f));
+  }
+  if (!(normInf(f) < fNormInf0)) {
+    // no improvement: keep the original concentrations
+    x = x0;
+  }
+  // ensure conc & dcdt correspond to the final solution
+  evaluateResidual(x, f);
+  return {normInf(f), iteration};
+}
+
 const std::vector<double> &
 PixelSim::getConcentrations(std::size_t compartmentIndex) const {
   return simCompartments[compartmentIndex]->getConcentrations();
@@ -359,6 +1289,20 @@ PixelSim::getDcdt(std::size_t compartmentIndex) const {
   return simCompartments[compartmentIndex]->getDcdt();
 }
 
+std::size_t PixelSim::getEnsembleSize() const { return ensembleSize; }
+
+const std::vector<double> &
+PixelSim::getEnsembleConcentrations(std::size_t compartmentIndex,
+                                    std::size_t member) const {
+  return simCompartments[compartmentIndex]->getEnsembleConcentrations(member);
+}
+
+const std::vector<double> &
+PixelSim::getEnsembleDcdt(std::size_t compartmentIndex,
+                          std::size_t member) const {
+  return simCompartments[compartmentIndex]->getEnsembleDcdt(member);
+}
+
 double PixelSim::getLowerOrderConcentration(std::size_t compartmentIndex,
                                             std::size_t speciesIndex,
                                             std::size_t pixelIndex) const {
@@ -372,6 +1316,10 @@ const std::string &PixelSim::errorMessage() const {
 
 const QImage &PixelSim::errorImage() const { return currentErrorImage; }
 
+const TimestepStatistics &PixelSim::getTimestepStatistics() const {
+  return timestepStatistics;
+}
+
 void PixelSim::setStopRequested(bool stop) { stopRequested.store(stop); }
 
 } // namespace sme::simulate
@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace sme {
@@ -23,40 +24,97 @@ namespace simulate {
 
 class SimCompartment;
 class SimMembrane;
+struct FusedRKStage;
+struct RKCStage;
 
 class PixelSim : public BaseSim {
 private:
   std::vector<std::unique_ptr<SimCompartment>> simCompartments;
   std::vector<std::unique_ptr<SimMembrane>> simMembranes;
+  // compartments advanced by the RK integrators: all compartments, or a single
+  // compartment while it is sub-cycling in multirate mode
+  std::vector<SimCompartment *> steppedCompartments;
+  // dependency graph of compartment & membrane dcdt evaluations, used to
+  // evaluate them concurrently when multithreading is enabled
+  struct DcdtGraph;
+  std::unique_ptr<DcdtGraph> dcdtGraph;
+  void buildDcdtGraph();
   const model::Model &doc;
   double maxStableTimestep{std::numeric_limits<double>::max()};
   void calculateDcdt();
   void doRK101(double dt);
+  // diffusion part of a splitting step for a single compartment
+  void doDiffusionTimestep(SimCompartment *sim, double dt,
+                           bool isFirstHalfStep);
+  void doIMEX(double dt);
+  void doRosenbrock(double dt);
+  // IMEX or Rosenbrock step of dt as two steps of dt/2, with the difference
+  // from a single step of dt as the error estimate
+  void doStepDoubling(double dt);
+  void doRKC(double dt);
+  // coefficients of the current number of RKC stages
+  std::vector<RKCStage> rkcStages;
+  // RKC: dcdt was evaluated at the current concentrations for the error
+  // estimate of the previous step, so is reused for its first stage
+  bool isRKCDcdtCurrent{false};
   void doRK212(double dt);
   void doRK323(double dt);
   void doRK435(double dt);
   void doRKSubstep(double dt, double g1, double g2, double g3, double beta,
                    double delta);
+  void doRKFinalise(double cFactor, double s2Factor, double s3Factor);
+  void doFusedRKSubstep(double dt, const FusedRKStage &stage);
   double doRKAdaptive(double dtMax);
   std::size_t discardedSteps{0};
   PixelIntegratorType integrator;
+  PixelStepController stepController;
+  struct AdaptiveTimestepState {
+    double nextTimestep{1e-7};
+    // PI controller: errFactor of the previous accepted step, and whether the
+    // previous step was rejected
+    double previousErrFactor{1.0};
+    bool previousStepRejected{false};
+  };
+  AdaptiveTimestepState timestepState{};
+  // multirate: each compartment is sub-cycled with its own timestep between
+  // synchronisation points, where the membrane fluxes are updated
+  bool useMultirate{false};
+  bool isMultirateSubstep{false};
+  std::vector<AdaptiveTimestepState> compartmentTimestepStates;
+  // limit on the synchronisation step from the error of holding the membrane
+  // fluxes constant over the previous synchronisation step
+  double maxSyncTimestep{std::numeric_limits<double>::max()};
+  // membrane fluxes were evaluated at the current concentrations at the end
+  // of the previous synchronisation step
+  bool areMembraneFluxesCurrent{false};
+  // dcdt = membrane reaction terms
+  void evaluateMembraneFluxes();
+  double doMultirate(double dtMax);
+  // compartments are discretized using quadtree cells instead of pixels
+  bool useQuadtree{false};
+  TimestepStatistics timestepStatistics{};
+  void addAcceptedStep(double dt);
   PixelIntegratorError errMax;
   double maxTimestep{std::numeric_limits<double>::max()};
-  double nextTimestep{1e-7};
   double epsilon{1e-14};
   bool useTBB{false};
+  bool useFusedRKStages{false};
+  // RK error estimate, calculated in the final stage of each step
+  PixelIntegratorError rkError{0.0, 0.0};
   std::size_t numMaxThreads{1};
   std::string currentErrorMessage{};
   QImage currentErrorImage{};
   std::atomic<bool> stopRequested{false};
   std::size_t nExtraVars{0};
+  std::size_t ensembleSize{1};
 
 public:
   explicit PixelSim(
       const model::Model &sbmlDoc,
       const std::vector<std::string> &compartmentIds,
       const std::vector<std::vector<std::string>> &compartmentSpeciesIds,
-      const std::map<std::string, double, std::less<>> &substitutions = {});
+      const std::map<std::string, double, std::less<>> &substitutions = {},
+      const EnsembleParameters &ensemble = {});
   ~PixelSim() override;
   std::size_t run(double time, double timeout_ms,
                   const std::function<bool()> &stopRunningCallback) override;
@@ -65,11 +123,28 @@ public:
   [[nodiscard]] std::size_t getConcentrationPadding() const override;
   [[nodiscard]] const std::vector<double> &
   getDcdt(std::size_t compartmentIndex) const;
+  // number of ensemble members, each simulated with its own parameter set
+  // (getConcentrations & getDcdt return the first member)
+  [[nodiscard]] std::size_t getEnsembleSize() const;
+  [[nodiscard]] const std::vector<double> &
+  getEnsembleConcentrations(std::size_t compartmentIndex,
+                            std::size_t member) const;
+  [[nodiscard]] const std::vector<double> &
+  getEnsembleDcdt(std::size_t compartmentIndex, std::size_t member) const;
+  // dcdt at the current concentrations, including the diffusion term, at
+  // every pixel (including tiles skipped by the active tile optimisation)
+  void evaluateDcdt();
+  // Jacobian-free Newton-Krylov solve of dcdt = 0, starting from the current
+  // concentrations, returns the largest |dcdt| and the number of iterations
+  std::pair<double, std::size_t> solveSteadyState(double tolerance,
+                                                  std::size_t maxIterations);
   [[nodiscard]] double getLowerOrderConcentration(std::size_t compartmentIndex,
                                                   std::size_t speciesIndex,
                                                   std::size_t pixelIndex) const;
   [[nodiscard]] const std::string &errorMessage() const override;
   [[nodiscard]] const QImage &errorImage() const override;
+  [[nodiscard]] const TimestepStatistics &
+  getTimestepStatistics() const override;
   void setStopRequested(bool stop) override;
 };
 
@@ -9,38 +9,96 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <numeric>
 #include <utility>
 // Qt defines emit keyword which interferes with a tbb emit() function
 #ifdef emit
 #undef emit
 #include <oneapi/tbb/global_control.h>
 #include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/parallel_reduce.h>
 #include <oneapi/tbb/tick_count.h>
 #define emit // restore the Qt empty definition of "emit"
 #else
 #include <oneapi/tbb/global_control.h>
 #include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/parallel_reduce.h>
 #include <oneapi/tbb/tick_count.h>
 #endif
 
 namespace sme::simulate {
 
+// number of locations passed to each batched reaction evaluation
+static constexpr std::size_t reactionBlockSize{64};
+// number of locations evaluated by each call of the compiled reaction terms
+// within a block
+static constexpr std::size_t reactionBatchSize{4};
+
+static constexpr std::size_t tbbGrainSize{64};
+
+// number of pixels processed in each block of a serial fused RK stage
+static constexpr std::size_t fusedRKBlockSize{64};
+
+// relative residual & max number of iterations of the conjugate gradient
+// solver used for implicit diffusion
+static constexpr double implicitDiffusionTolerance{1e-12};
+static constexpr std::size_t implicitDiffusionMaxIterations{10000};
+// number of pixels in each block of the conjugate gradient solver
+static constexpr std::size_t implicitDiffusionBlockSize{1024};
+
+// minimum number of consecutive pixels with the same neighbour offsets to use
+// the fixed offset diffusion operator instead of the nearest neighbours table
+static constexpr std::size_t minStencilRunLength{8};
+
 template <typename Body>
-static void tbbParallelFor(std::size_t n, const Body &body) {
-  constexpr std::size_t tbbGrainSize{64};
+static void tbbParallelFor(std::size_t n, const Body &body,
+                           std::size_t grainSize = tbbGrainSize) {
   static oneapi::tbb::static_partitioner partitioner;
   oneapi::tbb::parallel_for(
-      oneapi::tbb::blocked_range<std::size_t>(0, n, tbbGrainSize), body,
+      oneapi::tbb::blocked_range<std::size_t>(0, n, grainSize), body,
       partitioner);
 }
 
+// body returns the PixelIntegratorError for a range, result is the max over
+// all ranges
+template <typename Body>
+static PixelIntegratorError tbbParallelMaxError(std::size_t n,
+                                                const Body &body) {
+  static oneapi::tbb::static_partitioner partitioner;
+  return oneapi::tbb::parallel_reduce(
+      oneapi::tbb::blocked_range<std::size_t>(0, n, tbbGrainSize),
+      PixelIntegratorError{0.0, 0.0},
+      [&body](const oneapi::tbb::blocked_range<std::size_t> &r,
+              const PixelIntegratorError &err) {
+        return maxError(err, body(r));
+      },
+      maxError, partitioner);
+}
+
+// include a single element in the RK error estimate, where c is the new
+// concentration, cLower the embedded lower order result and cPrevious the
+// concentration at the start of the step
+static inline void updateRKError(PixelIntegratorError &err, double c,
+                                 double cLower, double cPrevious,
+                                 double epsilon) {
+  double localErr = std::abs(c - cLower);
+  err.abs = std::max(err.abs, localErr);
+  // average current and previous concentrations and add a (hopefully) small
+  // constant term to avoid dividing by c=0 issues
+  double localNorm = 0.5 * (c + cPrevious + epsilon);
+  err.rel = std::max(err.rel, localErr / localNorm);
+}
+
 ReacEval::ReacEval(
     const model::Model &doc, const std::vector<std::string> &speciesIDs,
     const std::vector<std::string> &reactionIDs, double reactionScaleFactor,
     bool doCSE, unsigned optLevel, bool timeDependent, bool spaceDependent,
-    const std::map<std::string, double, std::less<>> &substitutions) {
+    const std::map<std::string, double, std::less<>> &substitutions,
+    bool compileJacobian,
+    const std::vector<std::string> &ensembleParameterIds) {
   // construct reaction expressions and stoich matrix
   PdeScaleFactors pdeScaleFactors;
   pdeScaleFactors.reaction = reactionScaleFactor;
@@ -54,6 +112,10 @@ ReacEval::ReacEval(
     extraVars.push_back(doc.getParameters().getSpatialCoordinates().x.id);
     extraVars.push_back(doc.getParameters().getSpatialCoordinates().y.id);
   }
+  // ensemble parameters are not replaced by their values, but passed as
+  // extra variables after t, x, y
+  extraVars.insert(extraVars.end(), ensembleParameterIds.cbegin(),
+                   ensembleParameterIds.cend());
   Pde pde(&doc, speciesIDs, reactionIDs, {}, pdeScaleFactors, extraVars, {},
           substitutions);
   // add dt/dt = 1 reaction term, and t,x,y "species"
@@ -67,10 +129,13 @@ ReacEval::ReacEval(
     rhs.push_back("0"); // dx/dt = 0
     rhs.push_back("0"); // dy/dt = 0
   }
+  // ensemble parameters are constant: the results for them are not used, but
+  // keep the number of results equal to the number of variables
+  rhs.insert(rhs.end(), ensembleParameterIds.size(), "0");
   // compile all expressions with symengine
   sym = common::Symbolic(rhs, sIds);
   if (sym.isValid()) {
-    sym.compile(doCSE, optLevel);
+    sym.compile(doCSE, optLevel, reactionBatchSize);
   }
   if (!sym.isCompiled()) {
     std::string msg{sym.getErrorMessage()};
@@ -79,23 +144,122 @@ ReacEval::ReacEval(
     msg.append("\"");
     throw ReacEvalError(msg);
   }
+  if (!compileJacobian || speciesIDs.empty()) {
+    return;
+  }
+  // flatten Jacobian into row-major nSpecies x nSpecies expressions
+  std::vector<std::string> jac;
+  jac.reserve(speciesIDs.size() * speciesIDs.size());
+  for (const auto &row : pde.getJacobian()) {
+    jac.insert(jac.end(), row.cbegin(), row.cend());
+  }
+  jacobianSym = common::Symbolic(jac, sIds);
+  if (jacobianSym.isValid()) {
+    jacobianSym.compile(doCSE, optLevel);
+  }
+  if (!jacobianSym.isCompiled()) {
+    std::string msg{jacobianSym.getErrorMessage()};
+    msg.append("\nJacobian: \"");
+    msg.append(jacobianSym.expr());
+    msg.append("\"");
+    throw ReacEvalError(msg);
+  }
 }
 
 void ReacEval::evaluate(double *output, const double *input) const {
   sym.eval(output, input);
 }
 
+void ReacEval::evaluate(double *output, const double *input,
+                        std::size_t n) const {
+  sym.eval(output, input, n);
+}
+
+void ReacEval::evaluateJacobian(double *output, const double *input,
+                                std::size_t n) const {
+  jacobianSym.eval(output, input, n);
+}
+
 void SimCompartment::spatiallyAverageDcdt() {
   // for any non-spatial species: spatially average dc/dt:
   // roughly equivalent to infinite rate of diffusion
-  for (std::size_t is : nonSpatialSpeciesIndices) {
-    double av = 0;
-    for (std::size_t ix = 0; ix < nPixels; ++ix) {
-      av += dcdt[ix * nSpecies + is];
+  // the single stored dc/dt value already contains any membrane contributions,
+  // add the block sums of the reaction terms in a fixed order so that the
+  // result doesn't depend on how the blocks were distributed between threads
+  const std::size_t nNonSpatial{nonSpatialSpeciesIndices.size()};
+  for (std::size_t k = 0; k < nNonSpatial; ++k) {
+    double &dc{dcdt[speciesOffsets[nonSpatialSpeciesIndices[k]]]};
+    for (std::size_t i = k; i < nonSpatialDcdtBlockSums.size();
+         i += nNonSpatial) {
+      dc += nonSpatialDcdtBlockSums[i];
     }
-    av /= static_cast<double>(nPixels);
-    for (std::size_t ix = 0; ix < nPixels; ++ix) {
-      dcdt[ix * nSpecies + is] = av;
+    dc /= static_cast<double>(nPixels);
+  }
+}
+
+void SimCompartment::clearDcdt() { std::fill(dcdt.begin(), dcdt.end(), 0.0); }
+
+void SimCompartment::storeMembraneFluxes() { membraneFluxes = dcdt; }
+
+void SimCompartment::addMembraneFluxes() {
+  for (std::size_t i = 0; i < dcdt.size(); ++i) {
+    dcdt[i] += membraneFluxes[i];
+  }
+}
+
+void SimCompartment::storeSyncConcentrations() { concSync = conc; }
+
+void SimCompartment::restoreSyncConcentrations() { conc = concSync; }
+
+PixelIntegratorError
+SimCompartment::calculateMembraneFluxError(double dt, double epsilon) const {
+  PixelIntegratorError err{0.0, 0.0};
+  for (std::size_t i = 0; i < conc.size(); ++i) {
+    const double fluxErr{0.5 * dt * (dcdt[i] - membraneFluxes[i])};
+    updateRKError(err, conc[i], conc[i] + fluxErr, concSync[i], epsilon);
+  }
+  return err;
+}
+
+// interleave the bits of x and y to give the position on a Morton Z-order
+// curve
+static std::uint64_t mortonIndex(const QPoint &p) {
+  auto spreadBits{[](std::uint64_t v) {
+    v &= 0xffffffff;
+    v = (v | (v << 16)) & 0x0000ffff0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0f;
+    v = (v | (v << 2)) & 0x3333333333333333;
+    v = (v | (v << 1)) & 0x5555555555555555;
+    return v;
+  }};
+  return spreadBits(static_cast<std::uint64_t>(p.x())) |
+         (spreadBits(static_cast<std::uint64_t>(p.y())) << 1);
+}
+
+void SimCompartment::setStorageOffsets() {
+  if (storageLayout == PixelStorageLayout::SpeciesMajor) {
+    pixelStride = 1;
+    speciesStride = nPixels;
+  } else {
+    pixelStride = nStored;
+    speciesStride = 1;
+  }
+  // non-spatial species have a single value, stored after the pixels
+  speciesOffsets.clear();
+  speciesPixelStrides.clear();
+  std::size_t iStored{0};
+  std::size_t iNonSpatial{0};
+  for (std::size_t is = 0; is < nSpecies; ++is) {
+    if (iNonSpatial < nonSpatialSpeciesIndices.size() &&
+        nonSpatialSpeciesIndices[iNonSpatial] == is) {
+      speciesOffsets.push_back(nPixels * nStored + iNonSpatial);
+      speciesPixelStrides.push_back(0);
+      ++iNonSpatial;
+    } else {
+      speciesOffsets.push_back(iStored * speciesStride);
+      speciesPixelStrides.push_back(pixelStride);
+      ++iStored;
     }
   }
 }
@@ -104,9 +268,12 @@ SimCompartment::SimCompartment(
     const model::Model &doc, const geometry::Compartment *compartment,
     std::vector<std::string> sIds, bool doCSE, unsigned optLevel,
     bool timeDependent, bool spaceDependent,
-    const std::map<std::string, double, std::less<>> &substitutions)
+    const std::map<std::string, double, std::less<>> &substitutions,
+    PixelStorageLayout layout, PixelOrdering ordering, bool compileJacobian,
+    const EnsembleParameters &ensemble)
     : comp{compartment}, nPixels{compartment->nPixels()}, nSpecies{sIds.size()},
-      compartmentId{compartment->getId()}, speciesIds{std::move(sIds)} {
+      compartmentId{compartment->getId()}, speciesIds{std::move(sIds)},
+      storageLayout{layout} {
   // get species in compartment
   speciesNames.reserve(nSpecies);
   SPDLOG_DEBUG("compartment: {}", compartmentId);
@@ -116,12 +283,14 @@ SimCompartment::SimCompartment(
     const auto *field = doc.getSpecies().getField(s.c_str());
     diffConstants.push_back(field->getDiffusionConstant() / pixelWidth /
                             pixelWidth);
-    // forwards euler stability bound: dt < a^2/4D
-    maxStableTimestep =
-        std::min(maxStableTimestep, 1.0 / (4.0 * diffConstants.back()));
     fields.push_back(field);
     speciesNames.push_back(doc.getSpecies().getName(s.c_str()).toStdString());
-    if (!field->getIsSpatial()) {
+    if (field->getIsSpatial()) {
+      storedDiffConstants.push_back(diffConstants.back());
+      // forwards euler stability bound: dt < a^2/4D
+      maxStableTimestep =
+          std::min(maxStableTimestep, 1.0 / (4.0 * diffConstants.back()));
+    } else {
       nonSpatialSpeciesIndices.push_back(fields.size() - 1);
     }
     SPDLOG_DEBUG("  - adding species: {}, diff constant {}", s,
@@ -135,10 +304,15 @@ SimCompartment::SimCompartment(
     reactionIDs = common::toStdString(reacsInCompartment);
   }
   reacEval = ReacEval(doc, speciesIds, reactionIDs, 1.0, doCSE, optLevel,
-                      timeDependent, spaceDependent, substitutions);
+                      timeDependent, spaceDependent, substitutions,
+                      compileJacobian, ensemble.parameterIds);
+  if (compileJacobian) {
+    nJacobian = nSpecies;
+  }
   if (timeDependent) {
     speciesIds.push_back("time");
     diffConstants.push_back(0);
+    storedDiffConstants.push_back(0);
     ++nSpecies;
   }
   if (spaceDependent) {
@@ -146,69 +320,1088 @@ SimCompartment::SimCompartment(
     diffConstants.push_back(0);
     speciesIds.push_back(doc.getParameters().getSpatialCoordinates().y.id);
     diffConstants.push_back(0);
+    storedDiffConstants.push_back(0);
+    storedDiffConstants.push_back(0);
     nSpecies += 2;
   }
+  nStored = storedDiffConstants.size();
+  setStorageOffsets();
+  nonSpatialDcdtBlockSums.assign(
+      (nPixels + reactionBlockSize - 1) / reactionBlockSize *
+          nonSpatialSpeciesIndices.size(),
+      0.0);
+  if (ordering == PixelOrdering::Morton) {
+    const auto &pixels{compartment->getPixels()};
+    pixelIndices.resize(nPixels);
+    std::iota(pixelIndices.begin(), pixelIndices.end(), 0);
+    std::stable_sort(pixelIndices.begin(), pixelIndices.end(),
+                     [&pixels](std::size_t a, std::size_t b) {
+                       return mortonIndex(pixels[a]) < mortonIndex(pixels[b]);
+                     });
+    storageIndices.resize(nPixels);
+    for (std::size_t i = 0; i < nPixels; ++i) {
+      storageIndices[pixelIndices[i]] = i;
+    }
+  }
+  // nearest neighbours in storage order
+  nn.reserve(4 * nPixels);
+  for (std::size_t i = 0; i < nPixels; ++i) {
+    std::size_t ix{pixelIndices.empty() ? i : pixelIndices[i]};
+    for (std::size_t n : {compartment->up_x(ix), compartment->dn_x(ix),
+                          compartment->up_y(ix), compartment->dn_y(ix)}) {
+      nn.push_back(getStorageIndex(n));
+    }
+  }
+  // find runs of pixels whose neighbours are all at the same offsets, e.g.
+  // the interior of each column of pixels
+  auto neighbourOffsets{[this](std::size_t i) {
+    std::array<std::ptrdiff_t, 4> offsets{};
+    for (std::size_t k = 0; k < 4; ++k) {
+      offsets[k] = static_cast<std::ptrdiff_t>(nn[4 * i + k]) -
+                   static_cast<std::ptrdiff_t>(i);
+    }
+    return offsets;
+  }};
+  std::size_t tableBegin{0};
+  std::size_t nFixedOffsetPixels{0};
+  for (std::size_t i = 0; i < nPixels;) {
+    auto offsets{neighbourOffsets(i)};
+    std::size_t j{i + 1};
+    while (j < nPixels && neighbourOffsets(j) == offsets) {
+      ++j;
+    }
+    if (j - i >= minStencilRunLength) {
+      if (tableBegin < i) {
+        stencilRuns.push_back({tableBegin, i, false, {}});
+      }
+      stencilRuns.push_back({i, j, true, offsets});
+      nFixedOffsetPixels += j - i;
+      tableBegin = j;
+    }
+    i = j;
+  }
+  if (tableBegin < nPixels) {
+    stencilRuns.push_back({tableBegin, nPixels, false, {}});
+  }
+  SPDLOG_DEBUG("  - {}/{} pixels use fixed offset diffusion operator",
+               nFixedOffsetPixels, nPixels);
   // setup concentrations vector with initial values
-  conc.resize(nSpecies * nPixels);
+  conc.assign(nStored * nPixels + nonSpatialSpeciesIndices.size(), 0.0);
   dcdt.resize(conc.size(), 0.0);
   auto origin{doc.getGeometry().getPhysicalOrigin()};
-  auto concIter = conc.begin();
   for (std::size_t ix = 0; ix < compartment->nPixels(); ++ix) {
+    const std::size_t i{getStorageIndex(ix)};
+    std::size_t is{0};
     for (const auto *field : fields) {
-      *concIter = field->getConcentration()[ix];
-      ++concIter;
+      // non-spatial species are initialised to their spatial average
+      double w{speciesPixelStrides[is] == 0 ? 1.0 / static_cast<double>(nPixels)
+                                            : 1.0};
+      conc[speciesOffsets[is] + i * speciesPixelStrides[is]] +=
+          w * field->getConcentration()[ix];
+      ++is;
     }
     if (timeDependent) {
-      *concIter = 0; // t
-      ++concIter;
+      conc[speciesOffsets[is] + i * pixelStride] = 0; // t
+      ++is;
     }
     if (spaceDependent) {
       auto pixel{compartment->getPixel(ix)};
       // pixels have y=0 in top-left, convert to bottom-left:
       pixel.ry() = compartment->getCompartmentImage().height() - 1 - pixel.y();
-      *concIter = origin.x() + static_cast<double>(pixel.x()) * pixelWidth; // x
-      ++concIter;
-      *concIter = origin.y() + static_cast<double>(pixel.y()) * pixelWidth; // y
-      ++concIter;
+      conc[speciesOffsets[is] + i * pixelStride] =
+          origin.x() + static_cast<double>(pixel.x()) * pixelWidth; // x
+      ++is;
+      conc[speciesOffsets[is] + i * pixelStride] =
+          origin.y() + static_cast<double>(pixel.y()) * pixelWidth; // y
+      ++is;
+    }
+    assert(is == nSpecies);
+  }
+  if (ensemble.size() > 0) {
+    addEnsembleMembers(ensemble);
+  }
+}
+
+void SimCompartment::addEnsembleMembers(const EnsembleParameters &ensemble) {
+  const std::size_t n{nPixels};
+  nEnsembleParameters = ensemble.parameterIds.size();
+  nEnsemble = ensemble.size();
+  nPixels = nEnsemble * n;
+  ensembleParameterValues.clear();
+  ensembleParameterValues.reserve(nEnsemble * nEnsembleParameters);
+  for (const auto &values : ensemble.values) {
+    ensembleParameterValues.insert(ensembleParameterValues.end(),
+                                   values.cbegin(), values.cend());
+  }
+  // copy the pixels of the first member to all members
+  const auto memberConc{conc};
+  const auto memberOffsets{speciesOffsets};
+  setStorageOffsets();
+  conc.assign(nStored * nPixels + nonSpatialSpeciesIndices.size(), 0.0);
+  for (std::size_t k = 0; k < nEnsemble; ++k) {
+    for (std::size_t is = 0; is < nSpecies; ++is) {
+      const std::size_t stride{speciesPixelStrides[is]};
+      for (std::size_t i = 0; i < n; ++i) {
+        conc[speciesOffsets[is] + (k * n + i) * stride] =
+            memberConc[memberOffsets[is] + i * stride];
+      }
     }
   }
-  assert(concIter == conc.end());
+  dcdt.assign(conc.size(), 0.0);
+  // members don't interact: shift the neighbours & stencil runs of the first
+  // member to each member
+  const auto memberNn{nn};
+  const auto memberStencilRuns{stencilRuns};
+  nn.clear();
+  nn.reserve(4 * nPixels);
+  stencilRuns.clear();
+  for (std::size_t k = 0; k < nEnsemble; ++k) {
+    for (auto ix : memberNn) {
+      nn.push_back(ix + k * n);
+    }
+    for (auto run : memberStencilRuns) {
+      run.begin += k * n;
+      run.end += k * n;
+      stencilRuns.push_back(run);
+    }
+  }
+  SPDLOG_DEBUG("  - {} ensemble members", nEnsemble);
 }
 
-void SimCompartment::evaluateDiffusionOperator(std::size_t begin,
-                                               std::size_t end) {
+const double *
+SimCompartment::getEnsembleParameters(std::size_t storageIndex) const {
+  return ensembleParameterValues.data() +
+         storageIndex / (nPixels / nEnsemble) * nEnsembleParameters;
+}
+
+void SimCompartment::gatherReactionVariables(std::size_t i0, std::size_t n,
+                                             std::vector<double> &c) const {
+  const std::size_t nVars{nSpecies + nEnsembleParameters};
+  c.resize(reactionBlockSize * nVars);
+  for (std::size_t is = 0; is < nSpecies; ++is) {
+    const std::size_t stride{speciesPixelStrides[is]};
+    const double *src{conc.data() + speciesOffsets[is] + i0 * stride};
+    for (std::size_t i = 0; i < n; ++i) {
+      c[i * nVars + is] = src[i * stride];
+    }
+  }
+  if (nEnsembleParameters == 0) {
+    return;
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    std::copy_n(getEnsembleParameters(i0 + i), nEnsembleParameters,
+                c.begin() + static_cast<std::ptrdiff_t>(i * nVars + nSpecies));
+  }
+}
+
+void SimCompartment::evaluateDiffusionFixedOffsets(
+    std::size_t begin, std::size_t end,
+    const std::array<std::ptrdiff_t, 4> &offsets) {
+  // neighbours are at fixed offsets: no indirection through nn table
+  const auto b{static_cast<std::ptrdiff_t>(begin)};
+  const std::size_t n{end - begin};
+  if (storageLayout == PixelStorageLayout::SpeciesMajor) {
+    for (std::size_t is = 0; is < nStored; ++is) {
+      const double d{storedDiffConstants[is]};
+      const double *c{conc.data() + is * nPixels};
+      const double *c0{c + b + offsets[0]};
+      const double *c1{c + b + offsets[1]};
+      const double *c2{c + b + offsets[2]};
+      const double *c3{c + b + offsets[3]};
+      c += begin;
+      double *dc{dcdt.data() + is * nPixels + begin};
+      for (std::size_t i = 0; i < n; ++i) {
+        dc[i] += d * (c0[i] + c1[i] + c2[i] + c3[i] - 4.0 * c[i]);
+      }
+    }
+    return;
+  }
+  const auto stride{static_cast<std::ptrdiff_t>(nStored)};
+  const double *c{conc.data() + b * stride};
+  const double *c0{c + offsets[0] * stride};
+  const double *c1{c + offsets[1] * stride};
+  const double *c2{c + offsets[2] * stride};
+  const double *c3{c + offsets[3] * stride};
+  double *dc{dcdt.data() + begin * nStored};
+  for (std::size_t i = 0; i < n * nStored; i += nStored) {
+    for (std::size_t is = 0; is < nStored; ++is) {
+      dc[i + is] += storedDiffConstants[is] *
+                    (c0[i + is] + c1[i + is] + c2[i + is] + c3[i + is] -
+                     4.0 * c[i + is]);
+    }
+  }
+}
+
+void SimCompartment::evaluateDiffusionNeighbourTable(std::size_t begin,
+                                                     std::size_t end) {
+  if (storageLayout == PixelStorageLayout::SpeciesMajor) {
+    // contiguous sweep over pixels for each species in turn
+    for (std::size_t is = 0; is < nStored; ++is) {
+      const double d{storedDiffConstants[is]};
+      const double *c{conc.data() + is * nPixels};
+      double *dc{dcdt.data() + is * nPixels};
+      for (std::size_t i = begin; i < end; ++i) {
+        const std::size_t *n{nn.data() + 4 * i};
+        dc[i] += d * (c[n[0]] + c[n[1]] + c[n[2]] + c[n[3]] - 4.0 * c[i]);
+      }
+    }
+    return;
+  }
   for (std::size_t i = begin; i < end; ++i) {
-    std::size_t ix = i * nSpecies;
-    std::size_t ix_upx = comp->up_x(i) * nSpecies;
-    std::size_t ix_dnx = comp->dn_x(i) * nSpecies;
-    std::size_t ix_upy = comp->up_y(i) * nSpecies;
-    std::size_t ix_dny = comp->dn_y(i) * nSpecies;
-    for (std::size_t is = 0; is < nSpecies; ++is) {
+    std::size_t ix = i * nStored;
+    std::size_t ix_upx = nn[4 * i] * nStored;
+    std::size_t ix_dnx = nn[4 * i + 1] * nStored;
+    std::size_t ix_upy = nn[4 * i + 2] * nStored;
+    std::size_t ix_dny = nn[4 * i + 3] * nStored;
+    for (std::size_t is = 0; is < nStored; ++is) {
       dcdt[ix + is] +=
-          diffConstants[is] *
+          storedDiffConstants[is] *
           (conc[ix_upx + is] + conc[ix_dnx + is] + conc[ix_upy + is] +
            conc[ix_dny + is] - 4.0 * conc[ix + is]);
     }
   }
 }
 
-void SimCompartment::evaluateReactions(std::size_t begin, std::size_t end) {
+void SimCompartment::evaluateDiffusionCells(std::size_t begin,
+                                            std::size_t end) {
   for (std::size_t i = begin; i < end; ++i) {
-    reacEval.evaluate(dcdt.data() + i * nSpecies, conc.data() + i * nSpecies);
+    const double *c{conc.data() + i * pixelStride};
+    double *dc{dcdt.data() + i * pixelStride};
+    for (std::size_t k = cellNeighbourOffsets[i];
+         k < cellNeighbourOffsets[i + 1]; ++k) {
+      const double *cn{conc.data() + cellNeighbours[k] * pixelStride};
+      const double w{cellNeighbourWeights[k]};
+      for (std::size_t is = 0; is < nStored; ++is) {
+        const std::size_t j{is * speciesStride};
+        dc[j] += storedDiffConstants[is] * w * (cn[j] - c[j]);
+      }
+    }
+  }
+}
+
+void SimCompartment::evaluateDiffusionOperator(std::size_t begin,
+                                               std::size_t end) {
+  // non-spatial species have no diffusion term
+  if (!cellSizes.empty()) {
+    evaluateDiffusionCells(begin, end);
+    return;
+  }
+  // find first run that ends after begin
+  auto run{std::upper_bound(
+      stencilRuns.cbegin(), stencilRuns.cend(), begin,
+      [](std::size_t i, const StencilRun &r) { return i < r.end; })};
+  for (; run != stencilRuns.cend() && run->begin < end; ++run) {
+    const std::size_t b{std::max(begin, run->begin)};
+    const std::size_t e{std::min(end, run->end)};
+    if (run->fixedOffsets) {
+      evaluateDiffusionFixedOffsets(b, e, run->offsets);
+    } else {
+      evaluateDiffusionNeighbourTable(b, e);
+    }
+  }
+}
+
+void SimCompartment::evaluateReactions(std::size_t begin, std::size_t end) {
+  if (storageLayout == PixelStorageLayout::SpeciesMajor ||
+      !nonSpatialSpeciesIndices.empty() || nEnsembleParameters > 0) {
+    // gather a block of pixels into pixel-major order, evaluate the block,
+    // then scatter the results
+    const std::size_t nNonSpatial{nonSpatialSpeciesIndices.size()};
+    const std::size_t nVars{nSpecies + nEnsembleParameters};
+    auto &workspace{reactionWorkspaces.local()};
+    auto &c{workspace.c};
+    auto &dc{workspace.dc};
+    dc.resize(reactionBlockSize * nVars);
+    for (std::size_t i0 = begin; i0 < end; i0 += reactionBlockSize) {
+      const std::size_t n{std::min(reactionBlockSize, end - i0)};
+      gatherReactionVariables(i0, n, c);
+      reacEval.evaluate(dc.data(), c.data(), n);
+      for (std::size_t is = 0; is < nSpecies; ++is) {
+        const std::size_t stride{speciesPixelStrides[is]};
+        if (stride == 0) {
+          continue;
+        }
+        double *dst{dcdt.data() + speciesOffsets[is] + i0 * stride};
+        for (std::size_t i = 0; i < n; ++i) {
+          dst[i * stride] = dc[i * nVars + is];
+        }
+      }
+      // non-spatial species: sum of reaction terms for this block
+      double *sums{nonSpatialDcdtBlockSums.data() +
+                   i0 / reactionBlockSize * nNonSpatial};
+      for (std::size_t k = 0; k < nNonSpatial; ++k) {
+        const std::size_t is{nonSpatialSpeciesIndices[k]};
+        double sum{0.0};
+        for (std::size_t i = 0; i < n; ++i) {
+          sum += dc[i * nVars + is];
+        }
+        sums[k] = sum;
+      }
+    }
+    return;
+  }
+  if (end > begin) {
+    reacEval.evaluate(dcdt.data() + begin * nSpecies,
+                      conc.data() + begin * nSpecies, end - begin);
+  }
+}
+
+void SimCompartment::evaluateTile(std::size_t tile) {
+  const std::size_t begin{tile * reactionBlockSize};
+  const std::size_t end{std::min(begin + reactionBlockSize, nPixels)};
+  evaluateReactions(begin, end);
+  evaluateDiffusionOperator(begin, end);
+}
+
+void SimCompartment::clearTileDcdt(std::size_t tile) {
+  const auto begin{static_cast<std::ptrdiff_t>(tile * reactionBlockSize)};
+  const auto end{static_cast<std::ptrdiff_t>(
+      std::min(tile * reactionBlockSize + reactionBlockSize, nPixels))};
+  if (storageLayout == PixelStorageLayout::SpeciesMajor) {
+    for (std::size_t is = 0; is < nStored; ++is) {
+      auto dc{dcdt.begin() + static_cast<std::ptrdiff_t>(is * nPixels)};
+      std::fill(dc + begin, dc + end, 0.0);
+    }
+    return;
+  }
+  const auto stride{static_cast<std::ptrdiff_t>(nStored)};
+  std::fill(dcdt.begin() + begin * stride, dcdt.begin() + end * stride, 0.0);
+}
+
+bool SimCompartment::isTileActive(std::size_t tile) const {
+  const std::size_t begin{tile * reactionBlockSize};
+  const std::size_t end{std::min(begin + reactionBlockSize, nPixels)};
+  auto aboveTolerance{
+      [tol = activeTileTolerance](double dc) { return std::abs(dc) > tol; }};
+  if (storageLayout == PixelStorageLayout::SpeciesMajor) {
+    for (std::size_t is = 0; is < nStored; ++is) {
+      const double *dc{dcdt.data() + is * nPixels};
+      if (std::any_of(dc + begin, dc + end, aboveTolerance)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  return std::any_of(dcdt.data() + begin * nStored, dcdt.data() + end * nStored,
+                     aboveTolerance);
+}
+
+void SimCompartment::updateEvaluatedTiles() {
+  evaluatedTiles.clear();
+  skippedTiles.clear();
+  for (std::size_t t = 0; t < nTiles; ++t) {
+    bool evaluate{activeTiles[t] != 0};
+    for (std::size_t k = tileNeighbourOffsets[t];
+         !evaluate && k < tileNeighbourOffsets[t + 1]; ++k) {
+      evaluate = activeTiles[tileNeighbours[k]] != 0;
+    }
+    if (evaluate) {
+      evaluatedTiles.push_back(t);
+    } else {
+      skippedTiles.push_back(t);
+    }
+  }
+}
+
+void SimCompartment::setActiveTileTolerance(double tolerance) {
+  activeTileTolerance = tolerance;
+  nTiles = (nPixels + reactionBlockSize - 1) / reactionBlockSize;
+  // initially all tiles are active
+  activeTiles.assign(nTiles, 1);
+  // tiles containing the nearest neighbours of any pixel in each tile
+  tileNeighbourOffsets.assign(1, 0);
+  tileNeighbours.clear();
+  for (std::size_t t = 0; t < nTiles; ++t) {
+    const std::size_t begin{t * reactionBlockSize};
+    const std::size_t end{std::min(begin + reactionBlockSize, nPixels)};
+    const auto first{static_cast<std::ptrdiff_t>(tileNeighbours.size())};
+    for (std::size_t i = 4 * begin; i < 4 * end; ++i) {
+      if (std::size_t n{nn[i] / reactionBlockSize}; n != t) {
+        tileNeighbours.push_back(n);
+      }
+    }
+    std::sort(tileNeighbours.begin() + first, tileNeighbours.end());
+    tileNeighbours.erase(
+        std::unique(tileNeighbours.begin() + first, tileNeighbours.end()),
+        tileNeighbours.end());
+    tileNeighbourOffsets.push_back(tileNeighbours.size());
+  }
+  updateEvaluatedTiles();
+}
+
+void SimCompartment::updateActiveTiles() {
+  if (activeTileTolerance <= 0.0) {
+    return;
+  }
+  for (std::size_t t = 0; t < nTiles; ++t) {
+    activeTiles[t] = isTileActive(t) ? 1 : 0;
+  }
+  updateEvaluatedTiles();
+}
+
+void SimCompartment::updateActiveTiles_tbb() {
+  if (activeTileTolerance <= 0.0) {
+    return;
   }
+  tbbParallelFor(
+      nTiles,
+      [this](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        for (std::size_t t = r.begin(); t < r.end(); ++t) {
+          activeTiles[t] = isTileActive(t) ? 1 : 0;
+        }
+      },
+      1);
+  updateEvaluatedTiles();
+}
+
+void SimCompartment::setQuadtree(std::size_t maxLevel, double tolerance) {
+  quadtreeMaxLevel = maxLevel;
+  quadtreeTolerance = tolerance;
+  regrid();
+}
+
+void SimCompartment::regrid() {
+  if (quadtreeMaxLevel == 0) {
+    return;
+  }
+  const std::vector<double> pixelConc{getConcentrations()};
+  const std::size_t n{comp->nPixels()};
+  const auto imageSize{comp->getCompartmentImage().size()};
+  const auto width{static_cast<std::size_t>(imageSize.width())};
+  const auto height{static_cast<std::size_t>(imageSize.height())};
+  // compartment pixel index of each image pixel, n if not in compartment
+  std::vector<std::size_t> imagePixelIndex(width * height, n);
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    const auto &p{comp->getPixel(ix)};
+    imagePixelIndex[static_cast<std::size_t>(p.y()) * width +
+                    static_cast<std::size_t>(p.x())] = ix;
+  }
+  auto isBoundary{[this](std::size_t ix) {
+    return comp->up_x(ix) == ix || comp->dn_x(ix) == ix ||
+           comp->up_y(ix) == ix || comp->dn_y(ix) == ix;
+  }};
+  // boundary pixels are single pixel cells, stored first in pixel order, so
+  // that their storage indices (used by the membranes) don't change
+  storageIndices.assign(n, 0);
+  cellSizes.clear();
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    if (isBoundary(ix)) {
+      storageIndices[ix] = cellSizes.size();
+      cellSizes.push_back(1);
+    }
+  }
+  // a block can be merged if it only contains interior pixels, and the
+  // relative variation of each species over the block and the pixels around
+  // it is within tolerance (extra variables are not checked)
+  const std::size_t nModelSpecies{speciesNames.size()};
+  std::vector<double> cMin(nModelSpecies);
+  std::vector<double> cMax(nModelSpecies);
+  auto canMerge{[&](std::size_t x0, std::size_t y0, std::size_t size) {
+    if (x0 + size > width || y0 + size > height) {
+      return false;
+    }
+    for (std::size_t y = y0; y < y0 + size; ++y) {
+      for (std::size_t x = x0; x < x0 + size; ++x) {
+        auto ix{imagePixelIndex[y * width + x]};
+        if (ix == n || isBoundary(ix)) {
+          return false;
+        }
+      }
+    }
+    std::fill(cMin.begin(), cMin.end(), std::numeric_limits<double>::max());
+    std::fill(cMax.begin(), cMax.end(), std::numeric_limits<double>::lowest());
+    for (std::size_t y = y0 - 1; y < y0 + size + 1; ++y) {
+      for (std::size_t x = x0 - 1; x < x0 + size + 1; ++x) {
+        // block only contains interior pixels, so x, y are in the image
+        auto ix{imagePixelIndex[y * width + x]};
+        if (ix == n) {
+          continue;
+        }
+        for (std::size_t is = 0; is < nModelSpecies; ++is) {
+          const double c{pixelConc[ix * nSpecies + is]};
+          cMin[is] = std::min(cMin[is], c);
+          cMax[is] = std::max(cMax[is], c);
+        }
+      }
+    }
+    for (std::size_t is = 0; is < nModelSpecies; ++is) {
+      const double cAbsMax{std::max(std::abs(cMin[is]), std::abs(cMax[is]))};
+      if (cMax[is] - cMin[is] > quadtreeTolerance * cAbsMax) {
+        return false;
+      }
+    }
+    return true;
+  }};
+  // top-down over blocks of each level, children in Morton order
+  const std::size_t maxSize{std::size_t{1} << quadtreeMaxLevel};
+  std::vector<std::array<std::size_t, 3>> blocks;
+  for (std::size_t y0 = 0; y0 < height; y0 += maxSize) {
+    for (std::size_t x0 = 0; x0 < width; x0 += maxSize) {
+      blocks.push_back({x0, y0, maxSize});
+      while (!blocks.empty()) {
+        auto [x, y, size] = blocks.back();
+        blocks.pop_back();
+        if (x >= width || y >= height) {
+          continue;
+        }
+        if (size == 1) {
+          auto ix{imagePixelIndex[y * width + x]};
+          if (ix != n && !isBoundary(ix)) {
+            storageIndices[ix] = cellSizes.size();
+            cellSizes.push_back(1);
+          }
+          continue;
+        }
+        if (canMerge(x, y, size)) {
+          for (std::size_t yy = y; yy < y + size; ++yy) {
+            for (std::size_t xx = x; xx < x + size; ++xx) {
+              storageIndices[imagePixelIndex[yy * width + xx]] =
+                  cellSizes.size();
+            }
+          }
+          cellSizes.push_back(size);
+          continue;
+        }
+        const std::size_t h{size / 2};
+        blocks.push_back({x + h, y + h, h});
+        blocks.push_back({x, y + h, h});
+        blocks.push_back({x + h, y, h});
+        blocks.push_back({x, y, h});
+      }
+    }
+  }
+  nPixels = cellSizes.size();
+  pixelIndices.clear();
+  stencilRuns.clear();
+  // each pixel face between two cells contributes a flux
+  // D (c_B - c_A) / (distance between cell centres), divided by the area of
+  // cell A, so the total amount of each species is conserved
+  std::vector<std::pair<std::size_t, std::size_t>> faces;
+  for (std::size_t ix = 0; ix < n; ++ix) {
+    const std::size_t a{storageIndices[ix]};
+    for (std::size_t nb :
+         {comp->up_x(ix), comp->dn_x(ix), comp->up_y(ix), comp->dn_y(ix)}) {
+      if (const std::size_t b{storageIndices[nb]}; b != a) {
+        faces.emplace_back(a, b);
+      }
+    }
+  }
+  std::sort(faces.begin(), faces.end());
+  cellNeighbourOffsets.assign(nPixels + 1, 0);
+  cellNeighbours.clear();
+  cellNeighbourWeights.clear();
+  for (std::size_t k = 0; k < faces.size();) {
+    const auto [a, b] = faces[k];
+    std::size_t faceLength{0};
+    for (; k < faces.size() && faces[k] == std::make_pair(a, b); ++k) {
+      ++faceLength;
+    }
+    const auto sizeA{static_cast<double>(cellSizes[a])};
+    const auto sizeB{static_cast<double>(cellSizes[b])};
+    cellNeighbours.push_back(b);
+    cellNeighbourWeights.push_back(static_cast<double>(faceLength) /
+                                   (0.5 * (sizeA + sizeB) * sizeA * sizeA));
+    ++cellNeighbourOffsets[a + 1];
+  }
+  std::partial_sum(cellNeighbourOffsets.cbegin(), cellNeighbourOffsets.cend(),
+                   cellNeighbourOffsets.begin());
+  SPDLOG_DEBUG("  - {} quadtree cells for {} pixels", nPixels, n);
+  setStorageOffsets();
+  setConcentrations(pixelConc);
+  dcdt.assign(conc.size(), 0.0);
+  s2.assign(conc.size(), 0.0);
+  s3 = conc;
+  concNext.assign(conc.size(), 0.0);
+  dcdt0.assign(conc.size(), 0.0);
+  membraneFluxes.assign(conc.size(), 0.0);
+  nonSpatialDcdtBlockSums.assign(
+      (nPixels + reactionBlockSize - 1) / reactionBlockSize *
+          nonSpatialSpeciesIndices.size(),
+      0.0);
 }
 
-void SimCompartment::evaluateReactionsAndDiffusion() {
+void SimCompartment::evaluateReactionsAndDiffusion(bool allTiles) {
+  std::fill(dcdt.begin() + static_cast<std::ptrdiff_t>(nPixels * nStored),
+            dcdt.end(), 0.0);
+  if (activeTileTolerance > 0.0 && !allTiles) {
+    for (auto tile : evaluatedTiles) {
+      evaluateTile(tile);
+    }
+    for (auto tile : skippedTiles) {
+      clearTileDcdt(tile);
+    }
+    return;
+  }
   evaluateReactions(0, nPixels);
   evaluateDiffusionOperator(0, nPixels);
 }
 
-void SimCompartment::evaluateReactionsAndDiffusion_tbb() {
-  tbbParallelFor(nPixels,
-                 [this](const oneapi::tbb::blocked_range<std::size_t> &r) {
-                   evaluateReactions(r.begin(), r.end());
-                   evaluateDiffusionOperator(r.begin(), r.end());
-                 });
+void SimCompartment::evaluateReactionsAndDiffusion_tbb(bool allTiles) {
+  std::fill(dcdt.begin() + static_cast<std::ptrdiff_t>(nPixels * nStored),
+            dcdt.end(), 0.0);
+  if (activeTileTolerance > 0.0 && !allTiles) {
+    tbbParallelFor(
+        evaluatedTiles.size(),
+        [this](const oneapi::tbb::blocked_range<std::size_t> &r) {
+          for (std::size_t k = r.begin(); k < r.end(); ++k) {
+            evaluateTile(evaluatedTiles[k]);
+          }
+        },
+        1);
+    for (auto tile : skippedTiles) {
+      clearTileDcdt(tile);
+    }
+    return;
+  }
+  // split into ranges of whole reaction blocks
+  const std::size_t nBlocks{(nPixels + reactionBlockSize - 1) /
+                            reactionBlockSize};
+  tbbParallelFor(
+      nBlocks,
+      [this](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        const std::size_t begin{r.begin() * reactionBlockSize};
+        const std::size_t end{std::min(r.end() * reactionBlockSize, nPixels)};
+        evaluateReactions(begin, end);
+        evaluateDiffusionOperator(begin, end);
+      },
+      1);
+}
+
+void SimCompartment::evaluateReactions() {
+  std::fill(dcdt.begin() + static_cast<std::ptrdiff_t>(nPixels * nStored),
+            dcdt.end(), 0.0);
+  evaluateReactions(0, nPixels);
+}
+
+void SimCompartment::evaluateReactions_tbb() {
+  std::fill(dcdt.begin() + static_cast<std::ptrdiff_t>(nPixels * nStored),
+            dcdt.end(), 0.0);
+  const std::size_t nBlocks{(nPixels + reactionBlockSize - 1) /
+                            reactionBlockSize};
+  tbbParallelFor(
+      nBlocks,
+      [this](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        evaluateReactions(r.begin() * reactionBlockSize,
+                          std::min(r.end() * reactionBlockSize, nPixels));
+      },
+      1);
+}
+
+std::size_t SimCompartment::solveImplicitDiffusion(std::size_t storedIndex,
+                                                   double dt, bool parallel) {
+  // Jacobi preconditioned conjugate gradient solve of A x = b, where
+  // A = 1 - dt D L is symmetric positive definite
+  const double d{dt * storedDiffConstants[storedIndex]};
+  double *c{conc.data() + storedIndex * speciesStride};
+  auto &w{implicitDiffusionWorkspaces[storedIndex]};
+  auto &x{w.x};
+  auto &invDiag{w.invDiag};
+  auto &r{w.r};
+  auto &z{w.z};
+  auto &p{w.p};
+  auto &ap{w.ap};
+  auto &blockSums{w.blockSums};
+  // each pass over the pixels is split into blocks, which are done in
+  // parallel if requested. Dot products are summed within each block, then
+  // the block sums are added in order, so the result doesn't depend on the
+  // number of threads
+  const std::size_t nBlocks{(nPixels + implicitDiffusionBlockSize - 1) /
+                            implicitDiffusionBlockSize};
+  auto forEachBlock{[this, nBlocks, parallel](const auto &body) {
+    auto doBlocks{[this, &body](std::size_t b0, std::size_t b1) {
+      for (std::size_t b = b0; b < b1; ++b) {
+        body(b, b * implicitDiffusionBlockSize,
+             std::min((b + 1) * implicitDiffusionBlockSize, nPixels));
+      }
+    }};
+    if (parallel) {
+      tbbParallelFor(
+          nBlocks,
+          [&doBlocks](const oneapi::tbb::blocked_range<std::size_t> &br) {
+            doBlocks(br.begin(), br.end());
+          },
+          1);
+    } else {
+      doBlocks(0, nBlocks);
+    }
+  }};
+  // sum of the first (and second) partial sums of each block
+  auto sumBlocks{[&blockSums, nBlocks](std::size_t k) {
+    double sum{0.0};
+    for (std::size_t b = 0; b < nBlocks; ++b) {
+      sum += blockSums[2 * b + k];
+    }
+    return sum;
+  }};
+  auto applyA{[this, d](const std::vector<double> &v, std::vector<double> &y,
+                        std::size_t i0, std::size_t i1) {
+    for (std::size_t i = i0; i < i1; ++i) {
+      const std::size_t *n{nn.data() + 4 * i};
+      y[i] = v[i] - d * (v[n[0]] + v[n[1]] + v[n[2]] + v[n[3]] - 4.0 * v[i]);
+    }
+  }};
+  forEachBlock([&, c](std::size_t b, std::size_t i0, std::size_t i1) {
+    double xx{0.0};
+    for (std::size_t i = i0; i < i1; ++i) {
+      x[i] = c[i * pixelStride];
+      xx += x[i] * x[i];
+      // neighbours outside the compartment are the pixel itself
+      double nNeighbours{0};
+      for (std::size_t k = 0; k < 4; ++k) {
+        if (nn[4 * i + k] != i) {
+          ++nNeighbours;
+        }
+      }
+      invDiag[i] = 1.0 / (1.0 + d * nNeighbours);
+    }
+    blockSums[2 * b] = xx;
+  });
+  const double tolerance2{implicitDiffusionTolerance *
+                          implicitDiffusionTolerance * sumBlocks(0)};
+  // initial guess: x = b, so residual r = b - A b
+  forEachBlock([&](std::size_t b, std::size_t i0, std::size_t i1) {
+    applyA(x, r, i0, i1);
+    double rz{0.0};
+    double rr{0.0};
+    for (std::size_t i = i0; i < i1; ++i) {
+      r[i] = x[i] - r[i];
+      z[i] = invDiag[i] * r[i];
+      p[i] = z[i];
+      rz += r[i] * z[i];
+      rr += r[i] * r[i];
+    }
+    blockSums[2 * b] = rz;
+    blockSums[2 * b + 1] = rr;
+  });
+  double rz{sumBlocks(0)};
+  double rr{sumBlocks(1)};
+  std::size_t iteration{0};
+  while (rr > tolerance2 && iteration < implicitDiffusionMaxIterations) {
+    forEachBlock([&](std::size_t b, std::size_t i0, std::size_t i1) {
+      applyA(p, ap, i0, i1);
+      blockSums[2 * b] = std::inner_product(
+          p.cbegin() + static_cast<std::ptrdiff_t>(i0),
+          p.cbegin() + static_cast<std::ptrdiff_t>(i1),
+          ap.cbegin() + static_cast<std::ptrdiff_t>(i0), 0.0);
+    });
+    const double alpha{rz / sumBlocks(0)};
+    forEachBlock([&](std::size_t b, std::size_t i0, std::size_t i1) {
+      double rzBlock{0.0};
+      double rrBlock{0.0};
+      for (std::size_t i = i0; i < i1; ++i) {
+        x[i] += alpha * p[i];
+        r[i] -= alpha * ap[i];
+        z[i] = invDiag[i] * r[i];
+        rzBlock += r[i] * z[i];
+        rrBlock += r[i] * r[i];
+      }
+      blockSums[2 * b] = rzBlock;
+      blockSums[2 * b + 1] = rrBlock;
+    });
+    const double rzNew{sumBlocks(0)};
+    const double beta{rzNew / rz};
+    rz = rzNew;
+    rr = sumBlocks(1);
+    forEachBlock([&](std::size_t, std::size_t i0, std::size_t i1) {
+      for (std::size_t i = i0; i < i1; ++i) {
+        p[i] = z[i] + beta * p[i];
+      }
+    });
+    ++iteration;
+  }
+  if (iteration == implicitDiffusionMaxIterations) {
+    SPDLOG_WARN("Implicit diffusion in compartment {} did not converge after "
+                "{} iterations",
+                compartmentId, iteration);
+  }
+  forEachBlock([&, c](std::size_t, std::size_t i0, std::size_t i1) {
+    for (std::size_t i = i0; i < i1; ++i) {
+      c[i * pixelStride] = x[i];
+    }
+  });
+  return iteration;
+}
+
+void SimCompartment::resizeImplicitDiffusionWorkspaces() {
+  implicitDiffusionWorkspaces.resize(nStored);
+  for (std::size_t is = 0; is < nStored; ++is) {
+    if (storedDiffConstants[is] > 0) {
+      auto &w{implicitDiffusionWorkspaces[is]};
+      for (auto *v : {&w.x, &w.invDiag, &w.r, &w.z, &w.p, &w.ap}) {
+        v->resize(nPixels);
+      }
+      w.blockSums.resize(2 * ((nPixels + implicitDiffusionBlockSize - 1) /
+                              implicitDiffusionBlockSize));
+    }
+  }
+}
+
+void SimCompartment::doImplicitDiffusionTimestep(double dt) {
+  resizeImplicitDiffusionWorkspaces();
+  for (std::size_t is = 0; is < nStored; ++is) {
+    if (storedDiffConstants[is] > 0) {
+      solveImplicitDiffusion(is, dt, false);
+    }
+  }
+}
+
+void SimCompartment::doImplicitDiffusionTimestep_tbb(double dt) {
+  resizeImplicitDiffusionWorkspaces();
+  // each species is independent, and each solve is also split into blocks
+  // of pixels, so a single species also uses multiple threads
+  tbbParallelFor(
+      nStored,
+      [this, dt](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        for (std::size_t is = r.begin(); is < r.end(); ++is) {
+          if (storedDiffConstants[is] > 0) {
+            solveImplicitDiffusion(is, dt, true);
+          }
+        }
+      },
+      1);
+}
+
+// eigenvalues of the 1d diffusion operator on n pixels with zero-flux
+// boundaries are -lambda[k], where the k-th eigenvector is row k of the
+// orthonormal DCT-II matrix
+static std::vector<double> dctEigenvalues(std::size_t n) {
+  const double pi{std::acos(-1.0)};
+  std::vector<double> lambda(n);
+  for (std::size_t k = 0; k < n; ++k) {
+    lambda[k] = 2.0 - 2.0 * std::cos(pi * static_cast<double>(k) /
+                                     static_cast<double>(n));
+  }
+  return lambda;
+}
+
+bool SimCompartment::enableSpectralDiffusion() {
+  const auto &pixels{comp->getPixels()};
+  if (pixels.empty() || !cellSizes.empty()) {
+    return false;
+  }
+  int xMin{pixels.front().x()};
+  int xMax{xMin};
+  int yMin{pixels.front().y()};
+  int yMax{yMin};
+  for (const auto &p : pixels) {
+    xMin = std::min(xMin, p.x());
+    xMax = std::max(xMax, p.x());
+    yMin = std::min(yMin, p.y());
+    yMax = std::max(yMax, p.y());
+  }
+  const auto nx{static_cast<std::size_t>(xMax - xMin + 1)};
+  const auto ny{static_cast<std::size_t>(yMax - yMin + 1)};
+  // each pixel is unique, so the compartment is a full rectangle if the
+  // number of pixels equals the area of the bounding box
+  if (nx * ny != nPixels) {
+    return false;
+  }
+  spectralNx = nx;
+  spectralNy = ny;
+  spectralStorageIndices.resize(nPixels);
+  for (std::size_t ix = 0; ix < nPixels; ++ix) {
+    const auto &p{pixels[ix]};
+    spectralStorageIndices[static_cast<std::size_t>(p.y() - yMin) * nx +
+                           static_cast<std::size_t>(p.x() - xMin)] =
+        getStorageIndex(ix);
+  }
+  dctX = Dct(nx);
+  dctY = Dct(ny);
+  spectralLambdaX = dctEigenvalues(nx);
+  spectralLambdaY = dctEigenvalues(ny);
+  spectralDiffusionWorkspaces.resize(nStored);
+  for (std::size_t is = 0; is < nStored; ++is) {
+    if (storedDiffConstants[is] > 0) {
+      auto &w{spectralDiffusionWorkspaces[is]};
+      w.grid.resize(nPixels);
+      w.ex.resize(nx);
+    }
+  }
+  useSpectralDiffusion = true;
+  SPDLOG_DEBUG("  - {}x{} rectangle: using spectral diffusion", nx, ny);
+  return true;
+}
+
+bool SimCompartment::hasSpectralDiffusion() const {
+  return useSpectralDiffusion;
+}
+
+void SimCompartment::solveSpectralDiffusion(std::size_t storedIndex,
+                                            double dt) {
+  // transform to the DCT basis, where the diffusion operator is diagonal,
+  // multiply each mode by exp(dt D lambda), then transform back
+  const std::size_t nx{spectralNx};
+  const std::size_t ny{spectralNy};
+  const double d{dt * storedDiffConstants[storedIndex]};
+  double *c{conc.data() + storedIndex * speciesStride};
+  auto &[grid, ex, w]{spectralDiffusionWorkspaces[storedIndex]};
+  for (std::size_t i = 0; i < nx * ny; ++i) {
+    grid[i] = c[spectralStorageIndices[i] * pixelStride];
+  }
+  // in-place transforms along x (rows of the grid), then along y (columns)
+  for (std::size_t y = 0; y < ny; ++y) {
+    double *row{grid.data() + y * nx};
+    dctX.forward(row, 1, row, 1, w);
+  }
+  for (std::size_t x = 0; x < nx; ++x) {
+    double *col{grid.data() + x};
+    dctY.forward(col, nx, col, nx, w);
+  }
+  // propagate each mode, exp(-d (lx + ly)) = exp(-d lx) exp(-d ly)
+  for (std::size_t k = 0; k < nx; ++k) {
+    ex[k] = std::exp(-d * spectralLambdaX[k]);
+  }
+  for (std::size_t ky = 0; ky < ny; ++ky) {
+    const double ey{std::exp(-d * spectralLambdaY[ky])};
+    double *row{grid.data() + ky * nx};
+    for (std::size_t k = 0; k < nx; ++k) {
+      row[k] *= ey * ex[k];
+    }
+  }
+  for (std::size_t x = 0; x < nx; ++x) {
+    double *col{grid.data() + x};
+    dctY.inverse(col, nx, col, nx, w);
+  }
+  for (std::size_t y = 0; y < ny; ++y) {
+    double *row{grid.data() + y * nx};
+    dctX.inverse(row, 1, row, 1, w);
+  }
+  for (std::size_t i = 0; i < nx * ny; ++i) {
+    c[spectralStorageIndices[i] * pixelStride] = grid[i];
+  }
+}
+
+void SimCompartment::doSpectralDiffusionTimestep(double dt) {
+  for (std::size_t is = 0; is < nStored; ++is) {
+    if (storedDiffConstants[is] > 0) {
+      solveSpectralDiffusion(is, dt);
+    }
+  }
+}
+
+void SimCompartment::doSpectralDiffusionTimestep_tbb(double dt) {
+  // each species is independent
+  tbbParallelFor(
+      nStored,
+      [this, dt](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        for (std::size_t is = r.begin(); is < r.end(); ++is) {
+          if (storedDiffConstants[is] > 0) {
+            solveSpectralDiffusion(is, dt);
+          }
+        }
+      },
+      1);
+}
+
+// solve a x = b in place for a small dense m x m row-major matrix a using
+// Gaussian elimination with partial pivoting, b is replaced with x
+// returns false if a is singular
+static bool solveDenseLinearSystem(std::vector<double> &a, double *b,
+                                   std::size_t m) {
+  for (std::size_t k = 0; k < m; ++k) {
+    std::size_t p{k};
+    for (std::size_t i = k + 1; i < m; ++i) {
+      if (std::abs(a[i * m + k]) > std::abs(a[p * m + k])) {
+        p = i;
+      }
+    }
+    const double pivot{a[p * m + k]};
+    if (pivot == 0.0 || !std::isfinite(pivot)) {
+      return false;
+    }
+    if (p != k) {
+      std::swap_ranges(a.begin() + static_cast<std::ptrdiff_t>(k * m),
+                       a.begin() + static_cast<std::ptrdiff_t>((k + 1) * m),
+                       a.begin() + static_cast<std::ptrdiff_t>(p * m));
+      std::swap(b[k], b[p]);
+    }
+    for (std::size_t i = k + 1; i < m; ++i) {
+      const double f{a[i * m + k] / pivot};
+      for (std::size_t j = k + 1; j < m; ++j) {
+        a[i * m + j] -= f * a[k * m + j];
+      }
+      b[i] -= f * b[k];
+    }
+  }
+  for (std::size_t k = m; k-- > 0;) {
+    double x{b[k]};
+    for (std::size_t j = k + 1; j < m; ++j) {
+      x -= a[k * m + j] * b[j];
+    }
+    b[k] = x / a[k * m + k];
+  }
+  return true;
+}
+
+void SimCompartment::doLinearlyImplicitReactionTimestep(double dt,
+                                                        std::size_t begin,
+                                                        std::size_t end) {
+  const std::size_t m{nJacobian};
+  auto &workspace{reactionWorkspaces.local()};
+  auto &c{workspace.c};
+  auto &jac{workspace.jac};
+  auto &a{workspace.a};
+  auto &dc{workspace.dc};
+  jac.resize(reactionBlockSize * m * m);
+  a.resize(m * m);
+  dc.resize(nSpecies);
+  auto explicitIncrement{[this, dt, &dc](std::size_t ix) {
+    for (std::size_t is = 0; is < nSpecies; ++is) {
+      dc[is] = dt * dcdt[speciesOffsets[is] + ix * speciesPixelStrides[is]];
+    }
+  }};
+  for (std::size_t i0 = begin; i0 < end; i0 += reactionBlockSize) {
+    const std::size_t n{std::min(reactionBlockSize, end - i0)};
+    gatherReactionVariables(i0, n, c);
+    reacEval.evaluateJacobian(jac.data(), c.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const std::size_t ix{i0 + i};
+      explicitIncrement(ix);
+      // a = 1 - dt J, with the rows of non-spatial species left as the
+      // identity so that their (spatially uniform) increment stays explicit
+      const double *j{jac.data() + i * m * m};
+      for (std::size_t row = 0; row < m; ++row) {
+        const double f{speciesPixelStrides[row] == 0 ? 0.0 : dt};
+        for (std::size_t col = 0; col < m; ++col) {
+          a[row * m + col] = -f * j[row * m + col];
+        }
+        a[row * m + row] += 1.0;
+      }
+      if (!solveDenseLinearSystem(a, dc.data(), m)) {
+        // singular matrix: fall back to forwards Euler for this pixel
+        explicitIncrement(ix);
+      }
+      for (std::size_t is = 0; is < nSpecies; ++is) {
+        if (const std::size_t stride{speciesPixelStrides[is]}; stride != 0) {
+          conc[speciesOffsets[is] + ix * stride] += dc[is];
+        }
+      }
+    }
+  }
+}
+
+void SimCompartment::doLinearlyImplicitReactionTimestep(double dt) {
+  doLinearlyImplicitReactionTimestep(dt, 0, nPixels);
+  // non-spatial species: single forwards Euler step
+  for (auto is : nonSpatialSpeciesIndices) {
+    conc[speciesOffsets[is]] += dt * dcdt[speciesOffsets[is]];
+  }
+}
+
+void SimCompartment::doLinearlyImplicitReactionTimestep_tbb(double dt) {
+  const std::size_t nBlocks{(nPixels + reactionBlockSize - 1) /
+                            reactionBlockSize};
+  tbbParallelFor(
+      nBlocks,
+      [this, dt](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        doLinearlyImplicitReactionTimestep(
+            dt, r.begin() * reactionBlockSize,
+            std::min(r.end() * reactionBlockSize, nPixels));
+      },
+      1);
+  for (auto is : nonSpatialSpeciesIndices) {
+    conc[speciesOffsets[is]] += dt * dcdt[speciesOffsets[is]];
+  }
 }
 
 void SimCompartment::doForwardsEulerTimestep(double dt, std::size_t begin,
@@ -257,23 +1450,31 @@ void SimCompartment::doRK212Substep1_tbb(double dt) {
                  });
 }
 
-void SimCompartment::doRK212Substep2(double dt, std::size_t begin,
-                                     std::size_t end) {
+PixelIntegratorError SimCompartment::doRK212Substep2(double dt, double epsilon,
+                                                     std::size_t begin,
+                                                     std::size_t end) {
+  PixelIntegratorError err{0.0, 0.0};
   for (std::size_t i = begin; i < end; ++i) {
     s2[i] = conc[i];
     conc[i] = 0.5 * s3[i] + 0.5 * conc[i] + 0.5 * dt * dcdt[i];
+    // error estimate: difference from embedded forwards Euler result
+    updateRKError(err, conc[i], s2[i], s3[i], epsilon);
   }
+  return err;
 }
 
-void SimCompartment::doRK212Substep2(double dt) {
-  doRK212Substep2(dt, 0, conc.size());
+PixelIntegratorError SimCompartment::doRK212Substep2(double dt,
+                                                     double epsilon) {
+  return doRK212Substep2(dt, epsilon, 0, conc.size());
 }
 
-void SimCompartment::doRK212Substep2_tbb(double dt) {
-  tbbParallelFor(conc.size(),
-                 [this, dt](const oneapi::tbb::blocked_range<std::size_t> &r) {
-                   doRK212Substep2(dt, r.begin(), r.end());
-                 });
+PixelIntegratorError SimCompartment::doRK212Substep2_tbb(double dt,
+                                                         double epsilon) {
+  return tbbParallelMaxError(
+      conc.size(),
+      [this, dt, epsilon](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        return doRK212Substep2(dt, epsilon, r.begin(), r.end());
+      });
 }
 
 void SimCompartment::doRKSubstep(double dt, double g1, double g2, double g3,
@@ -299,25 +1500,90 @@ void SimCompartment::doRKSubstep_tbb(double dt, double g1, double g2, double g3,
                  });
 }
 
-void SimCompartment::doRKFinalise(double cFactor, double s2Factor,
-                                  double s3Factor, std::size_t begin,
-                                  std::size_t end) {
+PixelIntegratorError
+SimCompartment::doRKFinalise(double cFactor, double s2Factor, double s3Factor,
+                             double epsilon, std::size_t begin,
+                             std::size_t end) {
+  PixelIntegratorError err{0.0, 0.0};
   for (std::size_t i = begin; i < end; ++i) {
     s2[i] = cFactor * conc[i] + s2Factor * s2[i] + s3Factor * s3[i];
+    // error estimate: difference from embedded lower order result
+    updateRKError(err, conc[i], s2[i], s3[i], epsilon);
   }
+  return err;
 }
 
-void SimCompartment::doRKFinalise(double cFactor, double s2Factor,
-                                  double s3Factor) {
-  doRKFinalise(cFactor, s2Factor, s3Factor, 0, conc.size());
+PixelIntegratorError SimCompartment::doRKFinalise(double cFactor,
+                                                  double s2Factor,
+                                                  double s3Factor,
+                                                  double epsilon) {
+  return doRKFinalise(cFactor, s2Factor, s3Factor, epsilon, 0, conc.size());
 }
 
-void SimCompartment::doRKFinalise_tbb(double cFactor, double s2Factor,
-                                      double s3Factor) {
-  tbbParallelFor(
-      conc.size(), [this, cFactor, s2Factor, s3Factor](
-                       const oneapi::tbb::blocked_range<std::size_t> &r) {
-        doRKFinalise(cFactor, s2Factor, s3Factor, r.begin(), r.end());
+PixelIntegratorError SimCompartment::doRKFinalise_tbb(double cFactor,
+                                                      double s2Factor,
+                                                      double s3Factor,
+                                                      double epsilon) {
+  return tbbParallelMaxError(
+      conc.size(), [this, cFactor, s2Factor, s3Factor,
+                    epsilon](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        return doRKFinalise(cFactor, s2Factor, s3Factor, epsilon, r.begin(),
+                            r.end());
+      });
+}
+
+void SimCompartment::doRKCInit() {
+  doRKInit();
+  dcdt0 = dcdt;
+}
+
+void SimCompartment::doRKCSubstep(double dt, const RKCStage &stage,
+                                  std::size_t begin, std::size_t end) {
+  const double g0{1.0 - stage.mu - stage.nu};
+  const double a{stage.muTilde * dt};
+  const double b{stage.gammaTilde * dt};
+  for (std::size_t i = begin; i < end; ++i) {
+    const double c{conc[i]};
+    conc[i] = g0 * s3[i] + stage.mu * c + stage.nu * s2[i] + a * dcdt[i] +
+              b * dcdt0[i];
+    s2[i] = c;
+  }
+}
+
+void SimCompartment::doRKCSubstep(double dt, const RKCStage &stage) {
+  doRKCSubstep(dt, stage, 0, conc.size());
+}
+
+void SimCompartment::doRKCSubstep_tbb(double dt, const RKCStage &stage) {
+  tbbParallelFor(conc.size(), [this, dt, &stage](
+                                  const oneapi::tbb::blocked_range<std::size_t>
+                                      &r) {
+    doRKCSubstep(dt, stage, r.begin(), r.end());
+  });
+}
+
+PixelIntegratorError SimCompartment::doRKCFinalise(double dt, double epsilon,
+                                                   std::size_t begin,
+                                                   std::size_t end) {
+  PixelIntegratorError err{0.0, 0.0};
+  const double a{0.4 * dt};
+  for (std::size_t i = begin; i < end; ++i) {
+    s2[i] = conc[i] + 0.8 * (s3[i] - conc[i]) + a * (dcdt0[i] + dcdt[i]);
+    updateRKError(err, conc[i], s2[i], s3[i], epsilon);
+  }
+  return err;
+}
+
+PixelIntegratorError SimCompartment::doRKCFinalise(double dt, double epsilon) {
+  return doRKCFinalise(dt, epsilon, 0, conc.size());
+}
+
+PixelIntegratorError SimCompartment::doRKCFinalise_tbb(double dt,
+                                                       double epsilon) {
+  return tbbParallelMaxError(
+      conc.size(),
+      [this, dt, epsilon](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        return doRKCFinalise(dt, epsilon, r.begin(), r.end());
       });
 }
 
@@ -336,17 +1602,132 @@ void SimCompartment::undoRKStep_tbb() {
                  });
 }
 
+void SimCompartment::doStepDoublingRestart() {
+  std::swap(s2, conc);
+  conc = s3;
+}
+
+PixelIntegratorError SimCompartment::calculateRKError(double epsilon,
+                                                      std::size_t begin,
+                                                      std::size_t end) const {
+  PixelIntegratorError err{0.0, 0.0};
+  for (std::size_t i = begin; i < end; ++i) {
+    updateRKError(err, conc[i], s2[i], s3[i], epsilon);
+  }
+  return err;
+}
+
 PixelIntegratorError SimCompartment::calculateRKError(double epsilon) const {
+  return calculateRKError(epsilon, 0, conc.size());
+}
+
+PixelIntegratorError
+SimCompartment::calculateRKError_tbb(double epsilon) const {
+  return tbbParallelMaxError(
+      conc.size(),
+      [this, epsilon](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        return calculateRKError(epsilon, r.begin(), r.end());
+      });
+}
+
+template <bool init, bool finalise>
+static PixelIntegratorError
+fusedRKUpdate(double dt, const FusedRKStage &stage, double epsilon,
+              const double *conc, const double *dcdt, double *s2, double *s3,
+              double *concNext, std::size_t begin, std::size_t end) {
+  // copy coefficients to avoid re-loading them from stage in the loop
+  const double g1{stage.g1};
+  const double g2{stage.g2};
+  const double g3{stage.g3};
+  const double betaDt{stage.beta * dt};
+  const double delta{stage.delta};
+  const double cFactor{stage.cFactor};
+  const double s2Factor{stage.s2Factor};
+  const double s3Factor{stage.s3Factor};
   PixelIntegratorError err{0.0, 0.0};
-  std::size_t n{conc.size()};
-  for (std::size_t i = 0; i < n; ++i) {
-    double localErr = std::abs(conc[i] - s2[i]);
-    err.abs = std::max(err.abs, localErr);
-    // average current and previous concentrations and add a (hopefully) small
-    // constant term to avoid dividing by c=0 issues
-    double localNorm = 0.5 * (conc[i] + s3[i] + epsilon);
-    err.rel = std::max(err.rel, localErr / localNorm);
+  for (std::size_t i = begin; i < end; ++i) {
+    double c{conc[i]};
+    if constexpr (init) {
+      s3[i] = c;
+      s2[i] = delta * c;
+    } else {
+      s2[i] += delta * c;
+    }
+    double cNew{g1 * c + g2 * s2[i] + g3 * s3[i] + betaDt * dcdt[i]};
+    concNext[i] = cNew;
+    if constexpr (finalise) {
+      s2[i] = cFactor * cNew + s2Factor * s2[i] + s3Factor * s3[i];
+      updateRKError(err, cNew, s2[i], s3[i], epsilon);
+    }
+  }
+  return err;
+}
+
+PixelIntegratorError
+SimCompartment::doFusedRKSubstep(double dt, const FusedRKStage &stage,
+                                 double epsilon, std::size_t begin,
+                                 std::size_t end) {
+  evaluateReactions(begin, end);
+  evaluateDiffusionOperator(begin, end);
+  auto update = [&](std::size_t b, std::size_t e) {
+    if (stage.init && stage.finalise) {
+      return fusedRKUpdate<true, true>(dt, stage, epsilon, conc.data(),
+                                       dcdt.data(), s2.data(), s3.data(),
+                                       concNext.data(), b, e);
+    }
+    if (stage.init) {
+      return fusedRKUpdate<true, false>(dt, stage, epsilon, conc.data(),
+                                        dcdt.data(), s2.data(), s3.data(),
+                                        concNext.data(), b, e);
+    }
+    if (stage.finalise) {
+      return fusedRKUpdate<false, true>(dt, stage, epsilon, conc.data(),
+                                        dcdt.data(), s2.data(), s3.data(),
+                                        concNext.data(), b, e);
+    }
+    return fusedRKUpdate<false, false>(dt, stage, epsilon, conc.data(),
+                                       dcdt.data(), s2.data(), s3.data(),
+                                       concNext.data(), b, e);
+  };
+  if (storageLayout == PixelStorageLayout::SpeciesMajor) {
+    PixelIntegratorError err{0.0, 0.0};
+    for (std::size_t is = 0; is < nStored; ++is) {
+      err = maxError(err, update(is * nPixels + begin, is * nPixels + end));
+    }
+    return err;
   }
+  return update(begin * nStored, end * nStored);
+}
+
+PixelIntegratorError SimCompartment::doFusedRKSubstep(double dt,
+                                                      const FusedRKStage &stage,
+                                                      double epsilon) {
+  s2.resize(conc.size());
+  s3.resize(conc.size());
+  concNext.resize(conc.size());
+  // process pixels in cache-sized blocks
+  PixelIntegratorError err{0.0, 0.0};
+  for (std::size_t begin = 0; begin < nPixels; begin += fusedRKBlockSize) {
+    err = maxError(err, doFusedRKSubstep(dt, stage, epsilon, begin,
+                                         std::min(begin + fusedRKBlockSize,
+                                                  nPixels)));
+  }
+  std::swap(conc, concNext);
+  return err;
+}
+
+PixelIntegratorError
+SimCompartment::doFusedRKSubstep_tbb(double dt, const FusedRKStage &stage,
+                                     double epsilon) {
+  s2.resize(conc.size());
+  s3.resize(conc.size());
+  concNext.resize(conc.size());
+  auto err{tbbParallelMaxError(
+      nPixels, [this, dt, &stage,
+                epsilon](const oneapi::tbb::blocked_range<std::size_t> &r) {
+        return doFusedRKSubstep(dt, stage, epsilon, r.begin(), r.end());
+      })};
+  std::swap(conc, concNext);
   return err;
 }
 
@@ -357,18 +1738,23 @@ std::string SimCompartment::plotRKError(QImage &image, double epsilon,
     image.fill(qRgb(0, 0, 0));
   }
   std::size_t iSpecies{nSpecies + 1};
-  for (std::size_t i = 0; i < conc.size(); ++i) {
-    double localErr = std::abs(conc[i] - s2[i]);
-    double localNorm = 0.5 * (conc[i] + s3[i] + epsilon);
-    double pixelIntensity{localErr / localNorm / max};
-    auto red{static_cast<int>(255.0 * pixelIntensity)};
-    auto point{comp->getPixel(i / nSpecies)};
-    auto oldRed{qRed(image.pixel(point))};
-    if (red > oldRed) {
-      image.setPixel(point, qRgb(red, 0, 0));
-      if (red > 254) {
-        // update index of species with largest error
-        iSpecies = i % nSpecies;
+  for (std::size_t is = 0; is < nSpecies; ++is) {
+    for (std::size_t ix = 0; ix < comp->nPixels(); ++ix) {
+      // (a non-spatial species has the same error in every pixel)
+      std::size_t i{speciesOffsets[is] +
+                    getStorageIndex(ix) * speciesPixelStrides[is]};
+      double localErr = std::abs(conc[i] - s2[i]);
+      double localNorm = 0.5 * (conc[i] + s3[i] + epsilon);
+      double pixelIntensity{localErr / localNorm / max};
+      auto red{static_cast<int>(255.0 * pixelIntensity)};
+      auto point{comp->getPixel(ix)};
+      auto oldRed{qRed(image.pixel(point))};
+      if (red > oldRed) {
+        image.setPixel(point, qRgb(red, 0, 0));
+        if (red > 254) {
+          // update index of species with largest error
+          iSpecies = is;
+        }
       }
     }
   }
@@ -386,13 +1772,152 @@ const std::vector<std::string> &SimCompartment::getSpeciesIds() const {
   return speciesIds;
 }
 
+void SimCompartment::toPixelMajor(const std::vector<double> &src,
+                                  std::vector<double> &dst,
+                                  std::size_t member) const {
+  if (!cellSizes.empty()) {
+    // each pixel has the value of the quadtree cell that contains it
+    const std::size_t n{comp->nPixels()};
+    dst.resize(n * nSpecies);
+    for (std::size_t is = 0; is < nSpecies; ++is) {
+      const double *s{src.data() + speciesOffsets[is]};
+      const std::size_t stride{speciesPixelStrides[is]};
+      for (std::size_t ix = 0; ix < n; ++ix) {
+        dst[ix * nSpecies + is] = s[storageIndices[ix] * stride];
+      }
+    }
+    return;
+  }
+  const std::size_t n{nPixels / nEnsemble};
+  dst.resize(n * nSpecies);
+  for (std::size_t is = 0; is < nSpecies; ++is) {
+    const std::size_t stride{speciesPixelStrides[is]};
+    const double *s{src.data() + speciesOffsets[is] +
+                    getEnsembleOffset(member) * stride};
+    if (pixelIndices.empty()) {
+      for (std::size_t ix = 0; ix < n; ++ix) {
+        dst[ix * nSpecies + is] = s[ix * stride];
+      }
+    } else {
+      for (std::size_t i = 0; i < n; ++i) {
+        dst[pixelIndices[i] * nSpecies + is] = s[i * stride];
+      }
+    }
+  }
+}
+
+bool SimCompartment::isPixelMajor() const {
+  return storageLayout == PixelStorageLayout::PixelMajor &&
+         pixelIndices.empty() && nonSpatialSpeciesIndices.empty() &&
+         cellSizes.empty() && nEnsemble == 1;
+}
+
 const std::vector<double> &SimCompartment::getConcentrations() const {
+  if (!isPixelMajor()) {
+    toPixelMajor(conc, pixelMajorConc);
+    return pixelMajorConc;
+  }
   return conc;
 }
 
+std::size_t SimCompartment::getEnsembleSize() const { return nEnsemble; }
+
+std::size_t SimCompartment::getEnsembleOffset(std::size_t member) const {
+  return member * (nPixels / nEnsemble);
+}
+
+const std::vector<double> &
+SimCompartment::getEnsembleConcentrations(std::size_t member) const {
+  if (member == 0) {
+    return getConcentrations();
+  }
+  toPixelMajor(conc, pixelMajorConc, member);
+  return pixelMajorConc;
+}
+
+const std::vector<double> &
+SimCompartment::getEnsembleDcdt(std::size_t member) const {
+  if (member == 0) {
+    return getDcdt();
+  }
+  toPixelMajor(dcdt, pixelMajorDcdt, member);
+  return pixelMajorDcdt;
+}
+
 void SimCompartment::setConcentrations(
     const std::vector<double> &concentrations) {
-  conc = concentrations;
+  if (!isPixelMajor()) {
+    // non-spatial species are set to their spatial average, and quadtree
+    // cells to the average over the pixels in the cell
+    conc.assign(nStored * nPixels + nonSpatialSpeciesIndices.size(), 0.0);
+    const std::size_t n{comp->nPixels()};
+    const double w{1.0 / static_cast<double>(n)};
+    for (std::size_t ix = 0; ix < n; ++ix) {
+      const std::size_t i{getStorageIndex(ix)};
+      double wCell{1.0};
+      if (!cellSizes.empty()) {
+        wCell /= static_cast<double>(cellSizes[i] * cellSizes[i]);
+      }
+      for (std::size_t is = 0; is < nSpecies; ++is) {
+        const std::size_t stride{speciesPixelStrides[is]};
+        const double c{concentrations[ix * nSpecies + is]};
+        if (stride == 0) {
+          conc[speciesOffsets[is]] += w * c;
+        } else {
+          conc[speciesOffsets[is] + i * stride] += wCell * c;
+        }
+      }
+    }
+  } else {
+    conc = concentrations;
+  }
+  if (activeTileTolerance > 0.0) {
+    // new concentrations: re-evaluate all tiles
+    std::fill(activeTiles.begin(), activeTiles.end(), 1);
+    updateEvaluatedTiles();
+  }
+}
+
+std::size_t SimCompartment::getStateSize(std::size_t nExtraVars) const {
+  std::size_t n{0};
+  for (std::size_t is = 0; is + nExtraVars < nSpecies; ++is) {
+    n += speciesPixelStrides[is] == 0 ? 1 : nPixels;
+  }
+  return n;
+}
+
+void SimCompartment::getState(double *x, std::size_t nExtraVars) const {
+  for (std::size_t is = 0; is + nExtraVars < nSpecies; ++is) {
+    const std::size_t stride{speciesPixelStrides[is]};
+    const std::size_t n{stride == 0 ? 1 : nPixels};
+    for (std::size_t i = 0; i < n; ++i) {
+      *x++ = conc[speciesOffsets[is] + i * stride];
+    }
+  }
+}
+
+void SimCompartment::setState(const double *x, std::size_t nExtraVars) {
+  for (std::size_t is = 0; is + nExtraVars < nSpecies; ++is) {
+    const std::size_t stride{speciesPixelStrides[is]};
+    const std::size_t n{stride == 0 ? 1 : nPixels};
+    for (std::size_t i = 0; i < n; ++i) {
+      conc[speciesOffsets[is] + i * stride] = *x++;
+    }
+  }
+  if (activeTileTolerance > 0.0) {
+    std::fill(activeTiles.begin(), activeTiles.end(), 1);
+    updateEvaluatedTiles();
+  }
+}
+
+void SimCompartment::getStateDcdt(double *f, std::size_t nExtraVars) const {
+  for (std::size_t is = 0; is + nExtraVars < nSpecies; ++is) {
+    const std::size_t stride{speciesPixelStrides[is]};
+    const std::size_t n{stride == 0 ? 1 : nPixels};
+    for (std::size_t i = 0; i < n; ++i) {
+      *f++ = dcdt[speciesOffsets[is] + i * stride];
+    }
+  }
 }
 
 double
@@ -401,24 +1926,58 @@ SimCompartment::getLowerOrderConcentration(std::size_t speciesIndex,
   if (s2.empty()) {
     return 0;
   }
-  return s2[pixelIndex * nSpecies + speciesIndex];
+  return s2[speciesOffsets[speciesIndex] +
+            getStorageIndex(pixelIndex) * speciesPixelStrides[speciesIndex]];
 }
 
 const std::vector<QPoint> &SimCompartment::getPixels() const {
   return comp->getPixels();
 }
 
-std::vector<double> &SimCompartment::getDcdt() { return dcdt; }
+const std::vector<double> &SimCompartment::getDcdt() const {
+  if (!isPixelMajor()) {
+    toPixelMajor(dcdt, pixelMajorDcdt);
+    return pixelMajorDcdt;
+  }
+  return dcdt;
+}
+
+const double *SimCompartment::getConcentrationData() const {
+  return conc.data();
+}
+
+double *SimCompartment::getDcdtData() { return dcdt.data(); }
+
+const std::vector<std::size_t> &SimCompartment::getSpeciesOffsets() const {
+  return speciesOffsets;
+}
+
+const std::vector<std::size_t> &
+SimCompartment::getSpeciesPixelStrides() const {
+  return speciesPixelStrides;
+}
+
+std::size_t SimCompartment::getStorageIndex(std::size_t pixelIndex) const {
+  if (storageIndices.empty()) {
+    return pixelIndex;
+  }
+  return storageIndices[pixelIndex];
+}
 
 double SimCompartment::getMaxStableTimestep() const {
   return maxStableTimestep;
 }
 
+bool SimCompartment::hasNonSpatialSpecies() const {
+  return !nonSpatialSpeciesIndices.empty();
+}
+
 SimMembrane::SimMembrane(
     const model::Model &doc, const geometry::Membrane *membrane_ptr,
     SimCompartment *simCompA, SimCompartment *simCompB, bool doCSE,
     unsigned optLevel, bool timeDependent, bool spaceDependent,
-    const std::map<std::string, double, std::less<>> &substitutions)
+    const std::map<std::string, double, std::less<>> &substitutions,
+    const std::vector<std::string> &ensembleParameterIds)
     : membrane(membrane_ptr), compA(simCompA), compB(simCompB) {
   if (timeDependent) {
     ++nExtraVars;
@@ -426,6 +1985,7 @@ SimMembrane::SimMembrane(
   if (spaceDependent) {
     nExtraVars += 2;
   }
+  nEnsembleParameters = ensembleParameterIds.size();
   if (compA != nullptr &&
       membrane->getCompartmentA()->getId() != compA->getCompartmentId()) {
     SPDLOG_ERROR("compA '{}' doesn't match simCompA '{}'",
@@ -473,53 +2033,208 @@ SimMembrane::SimMembrane(
       common::toStdString(doc.getReactions().getIds(membrane->getId().c_str()));
   reacEval =
       ReacEval(doc, speciesIds, reactionID, volOverL3 / pixelWidth, doCSE,
-               optLevel, timeDependent, spaceDependent, substitutions);
+               optLevel, timeDependent, spaceDependent, substitutions, false,
+               ensembleParameterIds);
+  // convert compartment pixel indices to storage indices, with a copy of
+  // each pair for each ensemble member
+  std::size_t nEnsemble{1};
+  for (const auto *c : {compA, compB}) {
+    if (c != nullptr) {
+      nEnsemble = c->getEnsembleSize();
+    }
+  }
+  const auto &memberPairs{membrane->getIndexPairs()};
+  std::vector<std::pair<std::size_t, std::size_t>> pairs;
+  pairs.reserve(nEnsemble * memberPairs.size());
+  for (std::size_t k = 0; k < nEnsemble; ++k) {
+    for (auto [ixA, ixB] : memberPairs) {
+      if (compA != nullptr) {
+        ixA = compA->getEnsembleOffset(k) + compA->getStorageIndex(ixA);
+      }
+      if (compB != nullptr) {
+        ixB = compB->getEnsembleOffset(k) + compB->getStorageIndex(ixB);
+      }
+      pairs.emplace_back(ixA, ixB);
+    }
+  }
+  // greedy colouring of pairs such that no two pairs with the same colour
+  // write to the same pixel of compartment A or B (each pixel is in at most
+  // 4 pairs, so at most 7 colours are needed)
+  std::vector<std::uint64_t> usedColoursA;
+  std::vector<std::uint64_t> usedColoursB;
+  for (const auto &[ixA, ixB] : pairs) {
+    usedColoursA.resize(std::max(usedColoursA.size(), ixA + 1), 0);
+    usedColoursB.resize(std::max(usedColoursB.size(), ixB + 1), 0);
+  }
+  std::vector<std::size_t> colours;
+  colours.reserve(pairs.size());
+  std::size_t nColours{0};
+  for (const auto &[ixA, ixB] : pairs) {
+    std::uint64_t used{0};
+    if (compA != nullptr) {
+      used |= usedColoursA[ixA];
+    }
+    if (compB != nullptr) {
+      used |= usedColoursB[ixB];
+    }
+    std::size_t colour{0};
+    while (colour < 63 && ((used >> colour) & 1) != 0) {
+      ++colour;
+    }
+    usedColoursA[ixA] |= std::uint64_t{1} << colour;
+    usedColoursB[ixB] |= std::uint64_t{1} << colour;
+    colours.push_back(colour);
+    nColours = std::max(nColours, colour + 1);
+  }
+  // sort pairs by colour, preserving the order within each colour
+  colourOffsets.assign(nColours + 1, 0);
+  for (auto colour : colours) {
+    ++colourOffsets[colour + 1];
+  }
+  std::partial_sum(colourOffsets.cbegin(), colourOffsets.cend(),
+                   colourOffsets.begin());
+  indexPairs.resize(pairs.size());
+  auto next{colourOffsets};
+  for (std::size_t i = 0; i < pairs.size(); ++i) {
+    indexPairs[next[colours[i]]++] = pairs[i];
+  }
+  SPDLOG_DEBUG("  - {} pixel pairs in {} colours", indexPairs.size(),
+               nColours);
+  // preallocate storage for species & results of each pair
+  nVars = speciesIds.size() + nExtraVars + nEnsembleParameters;
+  speciesBuffer.assign(indexPairs.size() * nVars, 0.0);
+  resultBuffer.assign(indexPairs.size() * nVars, 0.0);
 }
 
-void SimMembrane::evaluateReactions() {
+void SimMembrane::evaluateReactions(std::size_t begin, std::size_t end) {
   std::size_t nSpeciesA{0};
-  const std::vector<double> *concA{nullptr};
-  std::vector<double> *dcdtA{nullptr};
+  const double *concA{nullptr};
+  double *dcdtA{nullptr};
+  const std::size_t *offsetsA{nullptr};
+  const std::size_t *stridesA{nullptr};
   if (compA != nullptr) {
     nSpeciesA = compA->getSpeciesIds().size() - nExtraVars;
-    concA = &compA->getConcentrations();
-    dcdtA = &compA->getDcdt();
+    concA = compA->getConcentrationData();
+    dcdtA = compA->getDcdtData();
+    offsetsA = compA->getSpeciesOffsets().data();
+    stridesA = compA->getSpeciesPixelStrides().data();
   }
   std::size_t nSpeciesB{0};
-  const std::vector<double> *concB{nullptr};
-  std::vector<double> *dcdtB{nullptr};
+  const double *concB{nullptr};
+  double *dcdtB{nullptr};
+  const std::size_t *offsetsB{nullptr};
+  const std::size_t *stridesB{nullptr};
   if (compB != nullptr) {
     nSpeciesB = compB->getSpeciesIds().size() - nExtraVars;
-    concB = &compB->getConcentrations();
-    dcdtB = &compB->getDcdt();
+    concB = compB->getConcentrationData();
+    dcdtB = compB->getDcdtData();
+    offsetsB = compB->getSpeciesOffsets().data();
+    stridesB = compB->getSpeciesPixelStrides().data();
   }
-  std::vector<double> species(nSpeciesA + nSpeciesB + nExtraVars, 0);
-  std::vector<double> result(nSpeciesA + nSpeciesB + nExtraVars, 0);
-  for (const auto &[ixA, ixB] : membrane->getIndexPairs()) {
-    // populate species concentrations: first A, then B, then t,x,y
-    if (concA != nullptr) {
-      std::copy_n(&((*concA)[ixA * (nSpeciesA + nExtraVars)]), nSpeciesA,
-                  &species[0]);
-    }
-    if (concB != nullptr) {
-      std::copy_n(&((*concB)[ixB * (nSpeciesB + nExtraVars)]),
-                  nSpeciesB + nExtraVars, &species[nSpeciesA]);
-    } else if (concA != nullptr) {
-      std::copy_n(&((*concA)[ixA * (nSpeciesA + nExtraVars) + nSpeciesA]),
-                  nExtraVars, &species[nSpeciesA]);
+  // membrane pixel pairs are evaluated in blocks: the species for each pair
+  // in the block are gathered, the block is evaluated, then the results are
+  // added to dc/dt
+  for (std::size_t i0 = begin; i0 < end; i0 += reactionBlockSize) {
+    const std::size_t n{std::min(reactionBlockSize, end - i0)};
+    double *species{speciesBuffer.data() + i0 * nVars};
+    double *result{resultBuffer.data() + i0 * nVars};
+    // populate species concentrations: first A, then B, then t,x,y, then
+    // the ensemble parameters of the member that the pair belongs to
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto &[ixA, ixB] = indexPairs[i0 + i];
+      double *sp{species + i * nVars};
+      if (concA != nullptr) {
+        for (std::size_t is = 0; is < nSpeciesA; ++is) {
+          sp[is] = concA[offsetsA[is] + ixA * stridesA[is]];
+        }
+      }
+      if (concB != nullptr) {
+        for (std::size_t is = 0; is < nSpeciesB + nExtraVars; ++is) {
+          sp[nSpeciesA + is] = concB[offsetsB[is] + ixB * stridesB[is]];
+        }
+      } else if (concA != nullptr) {
+        for (std::size_t is = nSpeciesA; is < nSpeciesA + nExtraVars; ++is) {
+          sp[is] = concA[offsetsA[is] + ixA * stridesA[is]];
+        }
+      }
+      if (nEnsembleParameters > 0) {
+        const double *params{compB != nullptr
+                                 ? compB->getEnsembleParameters(ixB)
+                                 : compA->getEnsembleParameters(ixA)};
+        std::copy_n(params, nEnsembleParameters,
+                    sp + nSpeciesA + nSpeciesB + nExtraVars);
+      }
     }
 
     // evaluate reaction terms
-    reacEval.evaluate(result.data(), species.data());
+    reacEval.evaluate(result, species, n);
 
     // add results to dc/dt: first A, then B
-    for (std::size_t is = 0; is < nSpeciesA; ++is) {
-      (*dcdtA)[ixA * (nSpeciesA + nExtraVars) + is] += result[is];
+    // (non-spatial species are done separately in addNonSpatialReactions)
+    for (std::size_t i = 0; i < n; ++i) {
+      const auto &[ixA, ixB] = indexPairs[i0 + i];
+      const double *r{result + i * nVars};
+      for (std::size_t is = 0; is < nSpeciesA; ++is) {
+        if (stridesA[is] != 0) {
+          dcdtA[offsetsA[is] + ixA * stridesA[is]] += r[is];
+        }
+      }
+      for (std::size_t is = 0; is < nSpeciesB; ++is) {
+        if (stridesB[is] != 0) {
+          dcdtB[offsetsB[is] + ixB * stridesB[is]] += r[is + nSpeciesA];
+        }
+      }
+    }
+  }
+}
+
+void SimMembrane::addNonSpatialReactions() {
+  std::size_t iResult{0};
+  for (auto *comp : {compA, compB}) {
+    if (comp == nullptr) {
+      continue;
     }
-    for (std::size_t is = 0; is < nSpeciesB; ++is) {
-      (*dcdtB)[ixB * (nSpeciesB + nExtraVars) + is] += result[is + nSpeciesA];
+    const auto &offsets{comp->getSpeciesOffsets()};
+    const auto &strides{comp->getSpeciesPixelStrides()};
+    double *dcdt{comp->getDcdtData()};
+    for (std::size_t is = 0; is < comp->getSpeciesIds().size() - nExtraVars;
+         ++is) {
+      if (strides[is] == 0) {
+        // sum over all pairs in a fixed order
+        double sum{0.0};
+        for (std::size_t i = 0; i < indexPairs.size(); ++i) {
+          sum += resultBuffer[i * nVars + iResult];
+        }
+        dcdt[offsets[is]] += sum;
+      }
+      ++iResult;
     }
   }
 }
 
+void SimMembrane::evaluateReactions() {
+  for (std::size_t c = 0; c + 1 < colourOffsets.size(); ++c) {
+    evaluateReactions(colourOffsets[c], colourOffsets[c + 1]);
+  }
+  addNonSpatialReactions();
+}
+
+void SimMembrane::evaluateReactions_tbb() {
+  // pairs of the same colour don't share any pixels, so can be done in
+  // parallel without write conflicts
+  for (std::size_t c = 0; c + 1 < colourOffsets.size(); ++c) {
+    const std::size_t offset{colourOffsets[c]};
+    tbbParallelFor(colourOffsets[c + 1] - offset,
+                   [this, offset](
+                       const oneapi::tbb::blocked_range<std::size_t> &r) {
+                     evaluateReactions(offset + r.begin(), offset + r.end());
+                   });
+  }
+  addNonSpatialReactions();
+}
+
+SimCompartment *SimMembrane::getCompartmentA() const { return compA; }
+
+SimCompartment *SimMembrane::getCompartmentB() const { return compB; }
+
 } // namespace sme::simulate
@@ -5,15 +5,28 @@
 
 #pragma once
 
+#include "dct.hpp"
 #include "sme/pde.hpp"
 #include "sme/simulate_options.hpp"
 #include "sme/symbolic.hpp"
 #include <QImage>
 #include <QPoint>
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
+// Qt defines emit keyword which interferes with a tbb emit() function
+#ifdef emit
+#undef emit
+#include <oneapi/tbb/enumerable_thread_specific.h>
+#define emit // restore the Qt empty definition of "emit"
+#else
+#include <oneapi/tbb/enumerable_thread_specific.h>
+#endif
 
 namespace sme {
 
@@ -38,6 +51,8 @@ class ReacEval {
 private:
   // symengine reaction expression
   common::Symbolic sym;
+  // Jacobian of the species reaction terms w.r.t. the species
+  common::Symbolic jacobianSym;
 
 public:
   ReacEval() = default;
@@ -47,54 +62,318 @@ public:
       double reactionScaleFactor = 1.0, bool doCSE = true,
       unsigned optLevel = 3, bool timeDependent = false,
       bool spaceDependent = false,
-      const std::map<std::string, double, std::less<>> &substitutions = {});
+      const std::map<std::string, double, std::less<>> &substitutions = {},
+      bool compileJacobian = false,
+      const std::vector<std::string> &ensembleParameterIds = {});
   ReacEval(ReacEval &&) noexcept = default;
   ReacEval(const ReacEval &) = delete;
   ReacEval &operator=(ReacEval &&) noexcept = default;
   ReacEval &operator=(const ReacEval &) = delete;
   ~ReacEval() = default;
   void evaluate(double *output, const double *input) const;
+  // evaluate at n contiguous locations, each with nSpecies input/output values
+  // (one call of the compiled reaction terms for each batch of locations)
+  void evaluate(double *output, const double *input, std::size_t n) const;
+  // evaluate the Jacobian at n contiguous locations, each with nSpecies input
+  // values, output for each location is the row-major nSpecies x nSpecies
+  // matrix d(reaction term of species i)/d(species j), excluding any extra
+  // variables (only available if compileJacobian was set)
+  void evaluateJacobian(double *output, const double *input,
+                        std::size_t n) const;
+};
+
+// elementwise maximum of two errors
+inline PixelIntegratorError maxError(const PixelIntegratorError &a,
+                                     const PixelIntegratorError &b) {
+  return {std::max(a.abs, b.abs), std::max(a.rel, b.rel)};
+}
+
+// coefficients of a single Shu-Osher form RK stage, see
+// SimCompartment::doRKSubstep and SimCompartment::doRKFinalise
+struct FusedRKStage {
+  double g1{0.0};
+  double g2{0.0};
+  double g3{0.0};
+  double beta{0.0};
+  double delta{0.0};
+  // first stage: also initialise s2 = 0, s3 = conc
+  bool init{false};
+  // last stage: also apply doRKFinalise and calculate the RK error
+  bool finalise{false};
+  double cFactor{0.0};
+  double s2Factor{0.0};
+  double s3Factor{0.0};
+};
+
+// coefficients of a single stage j of the RKC method, see
+// SimCompartment::doRKCSubstep
+struct RKCStage {
+  double mu{0.0};
+  double nu{0.0};
+  double muTilde{0.0};
+  double gammaTilde{0.0};
+};
+
+// a run of pixels [begin, end) in storage order for the diffusion operator:
+// if fixedOffsets, each pixel i has nearest neighbours i + offsets[k],
+// otherwise the nearest neighbours table is used
+struct StencilRun {
+  std::size_t begin{0};
+  std::size_t end{0};
+  bool fixedOffsets{false};
+  std::array<std::ptrdiff_t, 4> offsets{};
 };
 
 class SimCompartment {
 private:
   ReacEval reacEval;
   // species concentrations & corresponding dcdt values
-  // ordering: ix, species
+  // spatial species & extra variables are stored for each pixel, ordering
+  // given by storageLayout: element (ix, slot) has index
+  // ix * pixelStride + slot * speciesStride, where ix is the storage index of
+  // the pixel, which is given by pixelOrdering
+  // non-spatial species are stored as a single value, after the above
+  // element (ix, is) of species is has index
+  // speciesOffsets[is] + ix * speciesPixelStrides[is]
   std::vector<double> conc;
   std::vector<double> dcdt;
   std::vector<double> s2;
   std::vector<double> s3;
+  // new concentrations written by the fused RK stage
+  std::vector<double> concNext;
+  // dcdt at the start of the step, used by each RKC stage
+  std::vector<double> dcdt0;
+  // membrane reaction terms, held constant between multirate synchronisation
+  // points
+  std::vector<double> membraneFluxes;
+  // concentrations at the last multirate synchronisation point
+  std::vector<double> concSync;
+  // pixel-major copies of conc/dcdt returned when storageLayout is SpeciesMajor
+  mutable std::vector<double> pixelMajorConc;
+  mutable std::vector<double> pixelMajorDcdt;
   // dimensionless diffusion constants for each species
   std::vector<double> diffConstants;
+  // and for each species stored per pixel
+  std::vector<double> storedDiffConstants;
   const geometry::Compartment *comp;
+  // number of stored locations: pixels, or quadtree cells
+  // (for all ensemble members)
   std::size_t nPixels;
+  // ensemble members: member k is a copy of the pixels of member 0 at storage
+  // indices [k * nPixels / nEnsemble, (k + 1) * nPixels / nEnsemble), with its
+  // own values of the ensemble parameters, which are constant so are stored
+  // once for each member instead of with the concentrations:
+  // member->parameter
+  std::size_t nEnsemble{1};
+  std::size_t nEnsembleParameters{0};
+  std::vector<double> ensembleParameterValues;
+  void addEnsembleMembers(const EnsembleParameters &ensemble);
   std::size_t nSpecies;
   std::string compartmentId;
   std::vector<std::string> speciesIds;
   std::vector<std::string> speciesNames;
   std::vector<std::size_t> nonSpatialSpeciesIndices;
+  // number of species (including extra variables) stored for each pixel
+  std::size_t nStored;
+  // number of species (excluding extra variables) in the reaction Jacobian
+  std::size_t nJacobian{0};
+  std::vector<std::size_t> speciesOffsets;
+  std::vector<std::size_t> speciesPixelStrides;
+  // sum of non-spatial species reaction terms over each block of pixels
+  std::vector<double> nonSpatialDcdtBlockSums;
+  // work vectors of the blocked reaction evaluation, one set for each thread:
+  // the gathered concentrations c, the results dc, and for the linearly
+  // implicit timestep the Jacobians jac and the matrix a of a single pixel
+  struct ReactionWorkspace {
+    std::vector<double> c;
+    std::vector<double> dc;
+    std::vector<double> jac;
+    std::vector<double> a;
+  };
+  oneapi::tbb::enumerable_thread_specific<ReactionWorkspace>
+      reactionWorkspaces;
   double maxStableTimestep = std::numeric_limits<double>::max();
+  PixelStorageLayout storageLayout;
+  std::size_t pixelStride;
+  std::size_t speciesStride;
+  // compartment pixel index of each storage index, empty if they are the same
+  std::vector<std::size_t> pixelIndices;
+  // storage index of each compartment pixel index, empty if they are the same
+  std::vector<std::size_t> storageIndices;
+  // storage indices of nearest neighbours: up_x, dn_x, up_y, dn_y
+  std::vector<std::size_t> nn;
+  // all pixels in storage order, split into runs for the diffusion operator
+  std::vector<StencilRun> stencilRuns;
+  // spectral diffusion: if the compartment is a full rectangle of
+  // spectralNx x spectralNy pixels, the diffusion operator with zero-flux
+  // boundaries is diagonalised by the orthonormal DCT-II transforms dctX,
+  // dctY with eigenvalues -spectralLambdaX[kx] - spectralLambdaY[ky],
+  // spectralStorageIndices[y * spectralNx + x] is the storage index of the
+  // pixel at (x, y) relative to the top-left corner
+  bool useSpectralDiffusion{false};
+  std::size_t spectralNx{0};
+  std::size_t spectralNy{0};
+  Dct dctX;
+  Dct dctY;
+  std::vector<double> spectralLambdaX;
+  std::vector<double> spectralLambdaY;
+  std::vector<std::size_t> spectralStorageIndices;
+  // work vectors of the transforms for a single species stored for each
+  // pixel, allocated once when spectral diffusion is enabled
+  struct SpectralDiffusionWorkspace {
+    std::vector<double> grid;
+    std::vector<double> ex;
+    Dct::Workspace dct;
+  };
+  std::vector<SpectralDiffusionWorkspace> spectralDiffusionWorkspaces;
+  // exact diffusion propagator c = exp(dt D L) c for a single species stored
+  // for each pixel
+  void solveSpectralDiffusion(std::size_t storedIndex, double dt);
+  // quadtree cells: if non-empty, each storage index is a square cell of
+  // cellSizes[i] x cellSizes[i] pixels, and storageIndices maps each pixel to
+  // the cell that contains it
+  std::vector<std::size_t> cellSizes;
+  std::size_t quadtreeMaxLevel{0};
+  double quadtreeTolerance{0.0};
+  // cell i has neighbours
+  // cellNeighbours[cellNeighbourOffsets[i], cellNeighbourOffsets[i+1]), the
+  // diffusion term in cell i is D sum_k cellNeighbourWeights[k] (c_k - c_i)
+  std::vector<std::size_t> cellNeighbourOffsets;
+  std::vector<std::size_t> cellNeighbours;
+  std::vector<double> cellNeighbourWeights;
+  void evaluateDiffusionCells(std::size_t begin, std::size_t end);
+  // set pixelStride, speciesStride & speciesOffsets for the current nPixels
+  void setStorageOffsets();
+  // active tiles: each tile is a block of reactionBlockSize pixels in storage
+  // order. A tile is active if |dcdt| > activeTileTolerance anywhere in the
+  // tile at the last evaluation, and dcdt is only evaluated in active tiles
+  // and their neighbours, elsewhere it is set to zero
+  double activeTileTolerance{0.0};
+  std::size_t nTiles{0};
+  std::vector<std::uint8_t> activeTiles;
+  // neighbours of tile t are
+  // tileNeighbours[tileNeighbourOffsets[t], tileNeighbourOffsets[t+1])
+  std::vector<std::size_t> tileNeighbourOffsets;
+  std::vector<std::size_t> tileNeighbours;
+  // tiles where dcdt is evaluated, and tiles where it is set to zero
+  std::vector<std::size_t> evaluatedTiles;
+  std::vector<std::size_t> skippedTiles;
+  void evaluateTile(std::size_t tile);
+  void clearTileDcdt(std::size_t tile);
+  [[nodiscard]] bool isTileActive(std::size_t tile) const;
+  void updateEvaluatedTiles();
+  void evaluateDiffusionFixedOffsets(
+      std::size_t begin, std::size_t end,
+      const std::array<std::ptrdiff_t, 4> &offsets);
+  void evaluateDiffusionNeighbourTable(std::size_t begin, std::size_t end);
+  // work vectors of the conjugate gradient solve for a single species stored
+  // for each pixel, allocated once and reused for each timestep
+  struct ImplicitDiffusionWorkspace {
+    std::vector<double> x;
+    std::vector<double> invDiag;
+    std::vector<double> r;
+    std::vector<double> z;
+    std::vector<double> p;
+    std::vector<double> ap;
+    // partial dot products of each block of pixels
+    std::vector<double> blockSums;
+  };
+  std::vector<ImplicitDiffusionWorkspace> implicitDiffusionWorkspaces;
+  // resize the workspace of each species stored for each pixel
+  void resizeImplicitDiffusionWorkspaces();
+  // solve (1 - dt D L) c_new = c for a single species stored for each pixel,
+  // where L is the diffusion operator, returns the number of iterations. If
+  // parallel, each pass over the pixels is split between threads
+  std::size_t solveImplicitDiffusion(std::size_t storedIndex, double dt,
+                                     bool parallel);
+  // true if storage is already in pixel-major (ix, species) ordering
+  [[nodiscard]] bool isPixelMajor() const;
+  void toPixelMajor(const std::vector<double> &src, std::vector<double> &dst,
+                    std::size_t member = 0) const;
+  // copy the reaction variables of n locations from i0 into c in pixel-major
+  // order: the stored species and extra variables, then the ensemble
+  // parameters
+  void gatherReactionVariables(std::size_t i0, std::size_t n,
+                               std::vector<double> &c) const;
 
 public:
   explicit SimCompartment(
       const model::Model &doc, const geometry::Compartment *compartment,
       std::vector<std::string> sIds, bool doCSE = true, unsigned optLevel = 3,
       bool timeDependent = false, bool spaceDependent = false,
-      const std::map<std::string, double, std::less<>> &substitutions = {});
+      const std::map<std::string, double, std::less<>> &substitutions = {},
+      PixelStorageLayout layout = PixelStorageLayout::PixelMajor,
+      PixelOrdering ordering = PixelOrdering::Column,
+      bool compileJacobian = false, const EnsembleParameters &ensemble = {});
   SimCompartment(SimCompartment &&) noexcept = default;
   SimCompartment(const SimCompartment &) = delete;
   SimCompartment &operator=(SimCompartment &&) noexcept = default;
   SimCompartment &operator=(const SimCompartment &) = delete;
   ~SimCompartment() = default;
 
-  // dcdt = result of applying diffusion operator to conc
+  // dcdt += result of applying diffusion operator to conc
   void evaluateDiffusionOperator(std::size_t begin, std::size_t end);
-  // dcdt += result of applying reaction expressions to conc
+  // dcdt = result of applying reaction expressions to conc
+  // (begin must be a multiple of the reaction block size if there are
+  // non-spatial species)
   void evaluateReactions(std::size_t begin, std::size_t end);
-  void evaluateReactionsAndDiffusion();
-  void evaluateReactionsAndDiffusion_tbb();
+  // (only in active tiles and their neighbours, unless allTiles is true)
+  void evaluateReactionsAndDiffusion(bool allTiles = false);
+  void evaluateReactionsAndDiffusion_tbb(bool allTiles = false);
+  // dcdt = result of applying reaction expressions to conc
+  // (used when diffusion is done implicitly)
+  void evaluateReactions();
+  void evaluateReactions_tbb();
+  // backwards Euler timestep of the diffusion term for each species
+  void doImplicitDiffusionTimestep(double dt);
+  void doImplicitDiffusionTimestep_tbb(double dt);
+  // if the compartment is a full rectangle, set up the exact spectral
+  // diffusion propagator and return true
+  bool enableSpectralDiffusion();
+  [[nodiscard]] bool hasSpectralDiffusion() const;
+  // exact diffusion timestep (only available if hasSpectralDiffusion())
+  void doSpectralDiffusionTimestep(double dt);
+  void doSpectralDiffusionTimestep_tbb(double dt);
+  // linearly implicit (Rosenbrock) Euler timestep of the reaction terms:
+  // solve (1 - dt J) dc = dt dcdt at each pixel, where J is the Jacobian of
+  // the compartment reaction terms. Membrane fluxes in dcdt, non-spatial
+  // species and extra variables are treated explicitly.
+  void doLinearlyImplicitReactionTimestep(double dt, std::size_t begin,
+                                          std::size_t end);
+  void doLinearlyImplicitReactionTimestep(double dt);
+  void doLinearlyImplicitReactionTimestep_tbb(double dt);
+  // dcdt of non-spatial species = spatial average of reaction terms and
+  // membrane fluxes
   void spatiallyAverageDcdt();
+  // only evaluate dcdt in active tiles and their neighbours, a tolerance of
+  // zero evaluates dcdt everywhere (not used by the fused RK stage, or if
+  // there are non-spatial species)
+  void setActiveTileTolerance(double tolerance);
+  // update active tiles from the current dcdt, including membrane terms
+  void updateActiveTiles();
+  void updateActiveTiles_tbb();
+  // replace the pixels with square cells of up to 2^maxLevel x 2^maxLevel
+  // pixels where the concentrations are smooth, i.e. the relative variation
+  // of each species over the cell and the pixels around it is less than
+  // tolerance (boundary pixels are never merged)
+  void setQuadtree(std::size_t maxLevel, double tolerance);
+  // rebuild the quadtree cells from the current concentrations
+  void regrid();
+  // multirate: dcdt = 0, before evaluating the membrane reaction terms
+  void clearDcdt();
+  // multirate: membraneFluxes = dcdt
+  void storeMembraneFluxes();
+  // multirate: dcdt += membraneFluxes
+  void addMembraneFluxes();
+  // multirate: concSync = conc
+  void storeSyncConcentrations();
+  // multirate: conc = concSync
+  void restoreSyncConcentrations();
+  // multirate: error from holding the membrane fluxes constant over a
+  // synchronisation step dt, i.e. dt/2 times the difference between
+  // membraneFluxes and the fluxes at the end of the step in dcdt
+  [[nodiscard]] PixelIntegratorError
+  calculateMembraneFluxError(double dt, double epsilon) const;
   void doForwardsEulerTimestep(double dt, std::size_t begin, std::size_t end);
   void doForwardsEulerTimestep(double dt);
   void doForwardsEulerTimestep_tbb(double dt);
@@ -102,33 +381,104 @@ public:
   void doRK212Substep1(double dt, std::size_t begin, std::size_t end);
   void doRK212Substep1(double dt);
   void doRK212Substep1_tbb(double dt);
-  void doRK212Substep2(double dt, std::size_t begin, std::size_t end);
-  void doRK212Substep2(double dt);
-  void doRK212Substep2_tbb(double dt);
+  // final RK212 stage, returns the RK error
+  PixelIntegratorError doRK212Substep2(double dt, double epsilon,
+                                       std::size_t begin, std::size_t end);
+  PixelIntegratorError doRK212Substep2(double dt, double epsilon);
+  PixelIntegratorError doRK212Substep2_tbb(double dt, double epsilon);
   void doRKSubstep(double dt, double g1, double g2, double g3, double beta,
                    double delta, std::size_t begin, std::size_t end);
   void doRKSubstep(double dt, double g1, double g2, double g3, double beta,
                    double delta);
   void doRKSubstep_tbb(double dt, double g1, double g2, double g3, double beta,
                        double delta);
-  void doRKFinalise(double cFactor, double s2Factor, double s3Factor,
-                    std::size_t begin, std::size_t end);
-  void doRKFinalise(double cFactor, double s2Factor, double s3Factor);
-  void doRKFinalise_tbb(double cFactor, double s2Factor, double s3Factor);
+  // s2 = lower order solution, returns the RK error
+  PixelIntegratorError doRKFinalise(double cFactor, double s2Factor,
+                                    double s3Factor, double epsilon,
+                                    std::size_t begin, std::size_t end);
+  PixelIntegratorError doRKFinalise(double cFactor, double s2Factor,
+                                    double s3Factor, double epsilon);
+  PixelIntegratorError doRKFinalise_tbb(double cFactor, double s2Factor,
+                                        double s3Factor, double epsilon);
+  // s3 = conc, dcdt0 = dcdt
+  void doRKCInit();
+  // RKC stage: conc = (1 - mu - nu) s3 + mu conc + nu s2
+  //                   + muTilde dt dcdt + gammaTilde dt dcdt0,
+  // s2 = previous conc
+  void doRKCSubstep(double dt, const RKCStage &stage, std::size_t begin,
+                    std::size_t end);
+  void doRKCSubstep(double dt, const RKCStage &stage);
+  void doRKCSubstep_tbb(double dt, const RKCStage &stage);
+  // RKC error estimate, using dcdt at the end of the step:
+  // s2 = conc + 0.8 (s3 - conc) + 0.4 dt (dcdt0 + dcdt), returns the RK error
+  PixelIntegratorError doRKCFinalise(double dt, double epsilon,
+                                     std::size_t begin, std::size_t end);
+  PixelIntegratorError doRKCFinalise(double dt, double epsilon);
+  PixelIntegratorError doRKCFinalise_tbb(double dt, double epsilon);
   void undoRKStep(std::size_t begin, std::size_t end);
   void undoRKStep();
   void undoRKStep_tbb();
+  // step doubling, after a single step: s2 = conc, conc = s3
+  void doStepDoublingRestart();
+  // RK error from the difference between conc and the lower order result s2
+  [[nodiscard]] PixelIntegratorError
+  calculateRKError(double epsilon, std::size_t begin, std::size_t end) const;
   [[nodiscard]] PixelIntegratorError calculateRKError(double epsilon) const;
+  [[nodiscard]] PixelIntegratorError
+  calculateRKError_tbb(double epsilon) const;
+  // fused RK stage: in a single pass over each block of pixels, evaluate
+  // dcdt, then apply the RK stage update. New concentrations are written to a
+  // separate buffer which is swapped with conc at the end, so that the
+  // diffusion stencil of neighbouring blocks still sees the old values.
+  // Returns the RK error if stage.finalise is set.
+  PixelIntegratorError doFusedRKSubstep(double dt, const FusedRKStage &stage,
+                                        double epsilon, std::size_t begin,
+                                        std::size_t end);
+  PixelIntegratorError doFusedRKSubstep(double dt, const FusedRKStage &stage,
+                                        double epsilon);
+  PixelIntegratorError doFusedRKSubstep_tbb(double dt,
+                                            const FusedRKStage &stage,
+                                            double epsilon);
   std::string plotRKError(QImage &image, double epsilon, double max) const;
   [[nodiscard]] const std::string &getCompartmentId() const;
   [[nodiscard]] const std::vector<std::string> &getSpeciesIds() const;
+  // concentrations with pixel-major (ix, species) ordering
+  // (of the first ensemble member)
   [[nodiscard]] const std::vector<double> &getConcentrations() const;
+  [[nodiscard]] std::size_t getEnsembleSize() const;
+  // storage index of the first pixel of an ensemble member
+  [[nodiscard]] std::size_t getEnsembleOffset(std::size_t member) const;
+  // ensemble parameter values of the member of a storage index
+  [[nodiscard]] const double *getEnsembleParameters(
+      std::size_t storageIndex) const;
+  // concentrations & dcdt of an ensemble member with pixel-major ordering
+  [[nodiscard]] const std::vector<double> &
+  getEnsembleConcentrations(std::size_t member) const;
+  [[nodiscard]] const std::vector<double> &
+  getEnsembleDcdt(std::size_t member) const;
   void setConcentrations(const std::vector<double> &);
+  // steady state solve: the unknowns are the concentrations of the species,
+  // excluding the last nExtraVars extra variables, at each stored location
+  [[nodiscard]] std::size_t getStateSize(std::size_t nExtraVars) const;
+  void getState(double *x, std::size_t nExtraVars) const;
+  void setState(const double *x, std::size_t nExtraVars);
+  void getStateDcdt(double *f, std::size_t nExtraVars) const;
   [[nodiscard]] double getLowerOrderConcentration(std::size_t speciesIndex,
                                                   std::size_t pixelIndex) const;
   [[nodiscard]] const std::vector<QPoint> &getPixels() const;
-  std::vector<double> &getDcdt();
+  // dcdt with pixel-major (ix, species) ordering
+  [[nodiscard]] const std::vector<double> &getDcdt() const;
+  // raw storage, element (ix, is) is at
+  // getSpeciesOffsets()[is] + ix * getSpeciesPixelStrides()[is]
+  // where ix = getStorageIndex(pixel index)
+  // (stride is zero for non-spatial species)
+  [[nodiscard]] const double *getConcentrationData() const;
+  double *getDcdtData();
+  [[nodiscard]] const std::vector<std::size_t> &getSpeciesOffsets() const;
+  [[nodiscard]] const std::vector<std::size_t> &getSpeciesPixelStrides() const;
+  [[nodiscard]] std::size_t getStorageIndex(std::size_t pixelIndex) const;
   [[nodiscard]] double getMaxStableTimestep() const;
+  [[nodiscard]] bool hasNonSpatialSpecies() const;
 };
 
 class SimMembrane {
@@ -137,7 +487,18 @@ private:
   const geometry::Membrane *membrane;
   SimCompartment *compA;
   SimCompartment *compB;
+  // pairs of storage indices in compA, compB of each membrane pixel pair,
+  // sorted by colour: pairs with the same colour don't share any pixels
+  std::vector<std::pair<std::size_t, std::size_t>> indexPairs;
+  // pairs with colour c are in [colourOffsets[c], colourOffsets[c+1])
+  std::vector<std::size_t> colourOffsets;
+  // extra variables stored with the concentrations: t,x,y
   std::size_t nExtraVars{0};
+  std::size_t nEnsembleParameters{0};
+  // species & reaction terms of each pair, ordering: [pair * nVars + is]
+  std::size_t nVars{0};
+  std::vector<double> speciesBuffer;
+  std::vector<double> resultBuffer;
 
 public:
   SimMembrane(
@@ -145,13 +506,22 @@ public:
       SimCompartment *simCompA, SimCompartment *simCompB, bool doCSE = true,
       unsigned optLevel = 3, bool timeDependent = false,
       bool spaceDependent = false,
-      const std::map<std::string, double, std::less<>> &substitutions = {});
+      const std::map<std::string, double, std::less<>> &substitutions = {},
+      const std::vector<std::string> &ensembleParameterIds = {});
   SimMembrane(SimMembrane &&) noexcept = default;
   SimMembrane(const SimMembrane &) = delete;
   SimMembrane &operator=(SimMembrane &&) noexcept = default;
   SimMembrane &operator=(const SimMembrane &) = delete;
   ~SimMembrane() = default;
+  // dcdt += membrane reaction terms for pairs in [begin, end)
+  // (excluding non-spatial species)
+  void evaluateReactions(std::size_t begin, std::size_t end);
+  // dcdt of non-spatial species += sum of membrane reaction terms for all pairs
+  void addNonSpatialReactions();
   void evaluateReactions();
+  void evaluateReactions_tbb();
+  [[nodiscard]] SimCompartment *getCompartmentA() const;
+  [[nodiscard]] SimCompartment *getCompartmentB() const;
 };
 
 } // namespace simulate
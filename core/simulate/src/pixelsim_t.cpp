@@ -2,6 +2,8 @@
 #include "model_test_utils.hpp"
 #include "pixelsim.hpp"
 #include "sme/model.hpp"
+#include <QColor>
+#include <QImage>
 
 using namespace sme;
 using namespace sme::test;
@@ -17,4 +19,67 @@ TEST_CASE("PixelSim", "[core/simulate/pixelsim][core/"
     pixelSim.run(1, -1, []() { return true; });
     REQUIRE(pixelSim.errorMessage() == "Simulation stopped early");
   }
+  SECTION("Diffusion operator matches nearest neighbour stencil") {
+    auto m{getTestModel("small-single-compartment-diffusion")};
+    // compartment with a hole and some missing pixels, so that it has long
+    // runs of pixels with fixed neighbour offsets as well as boundary pixels
+    QImage img(40, 30, QImage::Format_RGB32);
+    QRgb col{QColor(12, 243, 154).rgba()};
+    img.fill(col);
+    for (int x = 0; x < img.width(); ++x) {
+      for (int y = 0; y < img.height(); ++y) {
+        if ((x - 20) * (x - 20) + (y - 15) * (y - 15) < 25 ||
+            (7 * x + 3 * y) % 29 == 0) {
+          img.setPixel(x, y, qRgb(0, 0, 0));
+        }
+      }
+    }
+    m.getGeometry().importGeometryFromImage(img, false);
+    m.getGeometry().setPixelWidth(0.5);
+    m.getCompartments().setColour("circle", col);
+    std::vector<std::string> comps{"circle"};
+    std::vector<std::vector<std::string>> specs{{"slow", "fast"}};
+    m.getSpecies().setAnalyticConcentration("slow", "cos(x/3) + 2");
+    m.getSpecies().setAnalyticConcentration("fast", "cos(x/5) + cos(y/2) + 3");
+    const auto *comp{m.getCompartments().getCompartment("circle")};
+    std::vector<double> d;
+    for (const auto &id : specs[0]) {
+      d.push_back(m.getSpecies().getField(id.c_str())->getDiffusionConstant() /
+                  0.25);
+    }
+    auto &options{m.getSimulationSettings().options.pixel};
+    for (auto layout : {simulate::PixelStorageLayout::PixelMajor,
+                        simulate::PixelStorageLayout::SpeciesMajor}) {
+      for (auto ordering :
+           {simulate::PixelOrdering::Column, simulate::PixelOrdering::Morton}) {
+        for (bool multithreaded : {false, true}) {
+          CAPTURE(layout);
+          CAPTURE(ordering);
+          CAPTURE(multithreaded);
+          options.storageLayout = layout;
+          options.pixelOrdering = ordering;
+          options.enableMultiThreading = multithreaded;
+          simulate::PixelSim pixelSim(m, comps, specs);
+          REQUIRE(pixelSim.errorMessage().empty());
+          pixelSim.evaluateDcdt();
+          const auto &c{pixelSim.getConcentrations(0)};
+          const auto &dcdt{pixelSim.getDcdt(0)};
+          REQUIRE(c.size() == 2 * comp->nPixels());
+          REQUIRE(dcdt.size() == c.size());
+          for (std::size_t ix = 0; ix < comp->nPixels(); ++ix) {
+            for (std::size_t is = 0; is < 2; ++is) {
+              // zero flux boundaries: a missing neighbour is the pixel itself
+              const double expected{
+                  d[is] * (c[comp->up_x(ix) * 2 + is] +
+                           c[comp->dn_x(ix) * 2 + is] +
+                           c[comp->up_y(ix) * 2 + is] +
+                           c[comp->dn_y(ix) * 2 + is] - 4.0 * c[ix * 2 + is])};
+              REQUIRE(dcdt[ix * 2 + is] ==
+                      Catch::Approx(expected).epsilon(1e-12).margin(1e-12));
+            }
+          }
+        }
+      }
+    }
+  }
 }
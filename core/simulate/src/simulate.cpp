@@ -9,8 +9,10 @@
 #include "sme/utils.hpp"
 #include <QElapsedTimer>
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <numeric>
+#include <tuple>
 #include <utility>
 
 namespace sme::simulate {
@@ -118,13 +120,23 @@ void Simulation::applyNextEvent() {
       std::size_t speciesIndex{
           common::element_index(compartmentSpeciesIds[compIndex], sId)};
       SPDLOG_INFO("    species[{}] = {}", speciesIndex, sId);
-      auto &c{data->concentration.back()[compIndex]};
-      const std::size_t stride{simulator->getConcentrationPadding() +
-                               compartmentSpeciesIds[compIndex].size()};
+      // stored concentrations are immutable: replace the last timepoint
+      auto conc{data->concentration.back().get()};
+      auto &c{conc[compIndex]};
+      const std::size_t stride{compartmentSpeciesIds[compIndex].size()};
       SPDLOG_INFO("    stride = {}", stride);
       for (std::size_t iPixel = 0; iPixel < tempConc.size(); ++iPixel) {
         c[stride * iPixel + speciesIndex] = tempConc[iPixel];
       }
+      std::scoped_lock lock(timeTraceIndexMutex);
+      if (compIndex < timeTraceIndices.size() &&
+          timeTraceIndices[compIndex] != nullptr &&
+          timeTraceIndices[compIndex]->size() ==
+              data->concentration.size()) {
+        timeTraceIndices[compIndex]->replaceBack(c);
+      }
+      ++timeTraceIndexRemovals;
+      data->concentration.replaceBack(std::move(conc));
     }
   }
   // re-init simulator
@@ -142,62 +154,171 @@ void Simulation::applyNextEvent() {
   simEvents.pop();
 }
 
+// the simulator concentrations without any extra values after the species
+static std::vector<double>
+removeConcentrationPadding(const std::vector<double> &concs,
+                           std::size_t nSpecies, std::size_t concPadding) {
+  if (concPadding == 0) {
+    return concs;
+  }
+  const std::size_t stride{nSpecies + concPadding};
+  const std::size_t nPixels{concs.size() / stride};
+  std::vector<double> c(nPixels * nSpecies);
+  for (std::size_t ix = 0; ix < nPixels; ++ix) {
+    for (std::size_t is = 0; is < nSpecies; ++is) {
+      c[ix * nSpecies + is] = concs[ix * stride + is];
+    }
+  }
+  return c;
+}
+
 static std::vector<AvgMinMax>
-calculateAvgMinMax(const std::vector<double> &concs, std::size_t nSpecies,
-                   std::size_t concPadding) {
+calculateAvgMinMax(const std::vector<double> &concs, std::size_t nSpecies) {
   std::vector<AvgMinMax> avgMinMax(nSpecies);
-  std::size_t stride{nSpecies + concPadding};
-  for (std::size_t ix = 0; ix < concs.size() / stride; ++ix) {
+  for (std::size_t ix = 0; ix < concs.size() / nSpecies; ++ix) {
     for (std::size_t is = 0; is < nSpecies; ++is) {
       auto &a = avgMinMax[is];
-      double c = concs[ix * stride + is];
+      double c = concs[ix * nSpecies + is];
       a.avg += c;
       a.max = std::max(a.max, c);
       a.min = std::min(a.min, c);
     }
   }
   for (auto &a : avgMinMax) {
-    a.avg /= static_cast<double>(concs.size()) / static_cast<double>(stride);
+    a.avg /= static_cast<double>(concs.size()) / static_cast<double>(nSpecies);
   }
   return avgMinMax;
 }
 
 void Simulation::updateConcentrations(double t) {
   SPDLOG_DEBUG("updating Concentrations at time {}", t);
-  data->timePoints.push_back(t);
-  data->concPadding.push_back(simulator->getConcentrationPadding());
-  auto &c = data->concentration.emplace_back();
+  updateConcentrations(t, *data, 0);
+  for (std::size_t member = 1; member < getEnsembleSize(); ++member) {
+    updateConcentrations(t, ensembleData[member - 1], member);
+  }
+}
+
+void Simulation::updateConcentrations(double t, SimulationData &d,
+                                      std::size_t member) {
+  std::vector<std::vector<double>> c;
   c.reserve(compartments.size());
-  auto &a = data->avgMinMax.emplace_back();
+  std::vector<std::vector<AvgMinMax>> a;
   a.reserve(compartments.size());
-  if (data->concentrationMax.empty()) {
-    auto &m = data->concentrationMax.emplace_back();
+  std::vector<std::vector<double>> m;
+  if (d.concentrationMax.empty()) {
     for (std::size_t i = 0; i < compartments.size(); ++i) {
       std::size_t nSpecies = compartmentSpeciesIds[i].size();
       m.push_back(std::vector<double>(nSpecies, 0.0));
     }
   } else {
-    data->concentrationMax.push_back(data->concentrationMax.back());
+    m = d.concentrationMax.back();
   }
   for (std::size_t compIndex = 0; compIndex < compartments.size();
        ++compIndex) {
     std::size_t nSpecies{compartmentSpeciesIds[compIndex].size()};
-    const auto &compConcs{simulator->getConcentrations(compIndex)};
-    c.push_back(compConcs);
-    a.push_back(
-        calculateAvgMinMax(compConcs, nSpecies, data->concPadding.back()));
-    auto &maxS{data->concentrationMax.back()[compIndex]};
+    const auto &compConcs{
+        member == 0
+            ? simulator->getConcentrations(compIndex)
+            : static_cast<const PixelSim *>(simulator.get())
+                  ->getEnsembleConcentrations(compIndex, member)};
+    c.push_back(removeConcentrationPadding(
+        compConcs, nSpecies, simulator->getConcentrationPadding()));
+    a.push_back(calculateAvgMinMax(c.back(), nSpecies));
+    auto &maxS{m[compIndex]};
     for (std::size_t is = 0; is < nSpecies; ++is) {
       maxS[is] = std::max(maxS[is], a.back()[is].max);
     }
   }
+  if (member == 0) {
+    std::scoped_lock lock(timeTraceIndexMutex);
+    for (std::size_t compIndex = 0; compIndex < timeTraceIndices.size();
+         ++compIndex) {
+      // an index that is still being built is caught up by getPixelTimeSeries
+      if (const auto &index{timeTraceIndices[compIndex]};
+          index != nullptr && index->size() == d.concentration.size()) {
+        index->push_back(c[compIndex]);
+      }
+    }
+    d.concentration.push_back(std::move(c));
+  } else {
+    d.concentration.push_back(std::move(c));
+  }
+  d.avgMinMax.push_back(std::move(a));
+  d.concentrationMax.push_back(std::move(m));
+  // readers can access the new timepoint once its time has been added
+  d.timePoints.push_back(t);
+}
+
+void Simulation::popBackConcentrations() {
+  std::scoped_lock lock(timeTraceIndexMutex);
+  for (const auto &index : timeTraceIndices) {
+    if (index != nullptr && index->size() == data->concentration.size()) {
+      index->pop_back();
+    }
+  }
+  ++timeTraceIndexRemovals;
+  data->pop_back();
 }
 
-Simulation::Simulation(model::Model &model)
+double Simulation::getMaxAbsDcdt() {
+  double maxAbsDcdt{0.0};
+  if (auto *s = dynamic_cast<PixelSim *>(simulator.get()); s != nullptr) {
+    // dcdt including the diffusion term at the current concentrations
+    s->evaluateDcdt();
+    for (std::size_t member = 0; member < s->getEnsembleSize(); ++member) {
+      for (std::size_t ic = 0; ic < compartments.size(); ++ic) {
+        const auto &compDcdt{s->getEnsembleDcdt(ic, member)};
+        const std::size_t nSpecies{compartmentSpeciesIds[ic].size()};
+        const std::size_t stride{nSpecies +
+                                 simulator->getConcentrationPadding()};
+        for (std::size_t i = 0; i < compDcdt.size(); i += stride) {
+          for (std::size_t is = 0; is < nSpecies; ++is) {
+            const double dcdt{compDcdt[i + is]};
+            if (std::isnan(dcdt)) {
+              return std::numeric_limits<double>::max();
+            }
+            maxAbsDcdt = std::max(maxAbsDcdt, std::abs(dcdt));
+          }
+        }
+      }
+    }
+    return maxAbsDcdt;
+  }
+  // otherwise estimate dcdt from the last two timepoints
+  const std::size_t n{data->timePoints.size()};
+  if (n < 2) {
+    return std::numeric_limits<double>::max();
+  }
+  const double dt{data->timePoints[n - 1] - data->timePoints[n - 2]};
+  for (std::size_t ic = 0; ic < compartments.size(); ++ic) {
+    for (std::size_t is = 0; is < compartmentSpeciesIds[ic].size(); ++is) {
+      auto c1{getConc(n - 1, ic, is)};
+      auto c0{getConc(n - 2, ic, is)};
+      for (std::size_t i = 0; i < c1.size(); ++i) {
+        const double dcdt{(c1[i] - c0[i]) / dt};
+        if (std::isnan(dcdt)) {
+          return std::numeric_limits<double>::max();
+        }
+        maxAbsDcdt = std::max(maxAbsDcdt, std::abs(dcdt));
+      }
+    }
+  }
+  return maxAbsDcdt;
+}
+
+Simulation::Simulation(model::Model &model,
+                       EnsembleParameters ensembleParameters)
     : model(model), settings(&model.getSimulationSettings()),
       data{&model.getSimulationData()},
+      ensemble{std::move(ensembleParameters)},
       imageSize(model.getGeometry().getImage().size()) {
-  if (data->timePoints.size() <= 1) {
+  if (ensemble.size() > 0) {
+    // the existing results can't be continued with other parameters
+    SPDLOG_INFO("starting new ensemble simulation with {} members",
+                ensemble.size());
+    data->clear();
+    ensembleData.resize(ensemble.size() - 1);
+  } else if (data->timePoints.size() <= 1) {
     SPDLOG_INFO("starting new simulation");
     data->clear();
   } else {
@@ -206,15 +327,16 @@ Simulation::Simulation(model::Model &model)
   }
   initModel();
   initEvents();
-  // init simulator
+  // init simulator (ensembles are only supported by the pixel simulator)
   if (settings->simulatorType == SimulatorType::DUNE &&
       model.getGeometry().getMesh() != nullptr &&
-      model.getGeometry().getMesh()->isValid()) {
+      model.getGeometry().getMesh()->isValid() && ensemble.size() == 0) {
     simulator =
         std::make_unique<DuneSim>(model, compartmentIds, eventSubstitutions);
   } else {
-    simulator = std::make_unique<PixelSim>(
-        model, compartmentIds, compartmentSpeciesIds, eventSubstitutions);
+    simulator =
+        std::make_unique<PixelSim>(model, compartmentIds, compartmentSpeciesIds,
+                                   eventSubstitutions, ensemble);
   }
   if (simulator->errorMessage().empty()) {
     nCompletedTimesteps.store(data->timePoints.size());
@@ -256,9 +378,8 @@ std::size_t Simulation::doMultipleTimesteps(
   QElapsedTimer timer;
   timer.start();
 
-  // ensure there is enough space that push_back won't cause a reallocation
-  // todo: there should be a mutex/lock here in case reserve() reallocates
-  // to avoid a user getting garbage data while the vector contents are moving
+  // allocate space for the new timepoints in advance: existing timepoints are
+  // never moved, so they can be read while the simulation is running
   data->reserve(data->size() + nStepsTotal);
   std::size_t steps{0};
   double remaining_timeout_ms{-1.0};
@@ -299,7 +420,7 @@ std::size_t Simulation::doMultipleTimesteps(
         applyNextEvent();
         nextEventTime = simEvents.front().time;
         // remove intermediate concentrations
-        data->pop_back();
+        popBackConcentrations();
         currentTime += subTimeStep;
         currentTimeStep -= subTimeStep;
         SPDLOG_INFO("Remaining time step: {}", currentTimeStep);
@@ -322,12 +443,83 @@ std::size_t Simulation::doMultipleTimesteps(
   return steps;
 }
 
+SteadyStateResult
+Simulation::doSteadyState(const SteadyStateOptions &options, double timeout_ms,
+                          const std::function<bool()> &stopRunningCallback) {
+  SteadyStateResult result{};
+  if (options.checkInterval <= 0.0) {
+    SPDLOG_WARN("Invalid steady state check interval {}",
+                options.checkInterval);
+    return result;
+  }
+  QElapsedTimer timer;
+  timer.start();
+  double t0{0.0};
+  if (!data->timePoints.empty()) {
+    t0 = data->timePoints.back();
+  }
+  double remaining_timeout_ms{-1.0};
+  bool stopped{false};
+  while (!result.converged) {
+    if (timeout_ms >= 0.0) {
+      remaining_timeout_ms =
+          std::max(0.0, timeout_ms - static_cast<double>(timer.elapsed()));
+    }
+    const std::size_t nTimePoints{data->timePoints.size()};
+    doMultipleTimesteps({{1, options.checkInterval}}, remaining_timeout_ms,
+                        stopRunningCallback);
+    if (!errorMessage().empty() || data->timePoints.size() == nTimePoints) {
+      // simulation failed, timed out, or was stopped
+      stopped = true;
+      break;
+    }
+    result.maxAbsDcdt = getMaxAbsDcdt();
+    if (result.maxAbsDcdt == std::numeric_limits<double>::max()) {
+      SPDLOG_WARN("dcdt is not finite: stopping steady state simulation");
+      stopped = true;
+      break;
+    }
+    result.converged = result.maxAbsDcdt < options.tolerance;
+    SPDLOG_INFO("t={}, max |dcdt| = {}", data->timePoints.back(),
+                result.maxAbsDcdt);
+    if (data->timePoints.back() - t0 >= options.maxTime) {
+      break;
+    }
+  }
+  if (!options.newtonPolish || stopped) {
+    return result;
+  }
+  auto *s{dynamic_cast<PixelSim *>(simulator.get())};
+  if (s == nullptr) {
+    SPDLOG_WARN("Newton-Krylov polishing is only available for the pixel "
+                "simulator");
+    return result;
+  }
+  std::tie(result.maxAbsDcdt, result.newtonIterations) = s->solveSteadyState(
+      options.newtonTolerance, options.maxNewtonIterations);
+  result.converged = result.maxAbsDcdt < options.tolerance;
+  SPDLOG_INFO("Newton-Krylov: {} iterations, max |dcdt| = {}",
+              result.newtonIterations, result.maxAbsDcdt);
+  // replace the last timepoint with the polished concentrations
+  const double t{data->timePoints.back()};
+  popBackConcentrations();
+  for (auto &d : ensembleData) {
+    d.pop_back();
+  }
+  updateConcentrations(t);
+  return result;
+}
+
 const std::string &Simulation::errorMessage() const {
   return simulator->errorMessage();
 }
 
 const QImage &Simulation::errorImage() const { return simulator->errorImage(); }
 
+const TimestepStatistics &Simulation::getTimestepStatistics() const {
+  return simulator->getTimestepStatistics();
+}
+
 const std::vector<std::string> &Simulation::getCompartmentIds() const {
   return compartmentIds;
 }
@@ -342,7 +534,7 @@ Simulation::getSpeciesColors(std::size_t compartmentIndex) const {
   return compartmentSpeciesColors[compartmentIndex];
 }
 
-const std::vector<double> &Simulation::getTimePoints() const {
+const AppendOnlyVector<double> &Simulation::getTimePoints() const {
   return data->timePoints;
 }
 
@@ -355,14 +547,26 @@ const AvgMinMax &Simulation::getAvgMinMax(std::size_t timeIndex,
 std::vector<double> Simulation::getConc(std::size_t timeIndex,
                                         std::size_t compartmentIndex,
                                         std::size_t speciesIndex) const {
+  return getEnsembleConc(0, timeIndex, compartmentIndex, speciesIndex);
+}
+
+std::size_t Simulation::getEnsembleSize() const {
+  return ensembleData.size() + 1;
+}
+
+std::vector<double>
+Simulation::getEnsembleConc(std::size_t member, std::size_t timeIndex,
+                            std::size_t compartmentIndex,
+                            std::size_t speciesIndex) const {
   std::vector<double> c;
-  const auto &compConc = data->concentration[timeIndex][compartmentIndex];
+  const auto &d{member == 0 ? *data : ensembleData[member - 1]};
+  const auto frame{d.concentration[timeIndex]};
+  const auto &compConc{frame[compartmentIndex]};
   std::size_t nPixels = compartments[compartmentIndex]->nPixels();
   std::size_t nSpecies = compartmentSpeciesIds[compartmentIndex].size();
-  std::size_t stride{nSpecies + data->concPadding[timeIndex]};
   c.reserve(nPixels);
   for (std::size_t ix = 0; ix < nPixels; ++ix) {
-    c.push_back(compConc[ix * stride + speciesIndex]);
+    c.push_back(compConc[ix * nSpecies + speciesIndex]);
   }
   return c;
 }
@@ -372,20 +576,123 @@ std::vector<double> Simulation::getConcArray(std::size_t timeIndex,
                                              std::size_t speciesIndex) const {
   std::vector<double> c(
       static_cast<std::size_t>(imageSize.width() * imageSize.height()), 0.0);
-  const auto &compConc = data->concentration[timeIndex][compartmentIndex];
+  const auto frame{data->concentration[timeIndex]};
+  const auto &compConc{frame[compartmentIndex]};
   const auto &comp = compartments[compartmentIndex];
   std::size_t nPixels = comp->nPixels();
   std::size_t nSpecies = compartmentSpeciesIds[compartmentIndex].size();
-  std::size_t stride{nSpecies + data->concPadding[timeIndex]};
   for (std::size_t ix = 0; ix < nPixels; ++ix) {
     const auto &point = comp->getPixel(ix);
     auto arrayIndex{static_cast<std::size_t>(
         point.x() + imageSize.width() * (imageSize.height() - 1 - point.y()))};
-    c[arrayIndex] = compConc[ix * stride + speciesIndex];
+    c[arrayIndex] = compConc[ix * nSpecies + speciesIndex];
   }
   return c;
 }
 
+void Simulation::enableTimeTraceIndex() {
+  std::scoped_lock lock(timeTraceIndexMutex);
+  timeTraceIndices.resize(compartments.size());
+}
+
+bool Simulation::getTimeTraceIndexEnabled() const {
+  std::scoped_lock lock(timeTraceIndexMutex);
+  return !timeTraceIndices.empty();
+}
+
+std::vector<std::vector<double>>
+Simulation::getPixelTimeSeries(std::size_t compartmentIndex,
+                               std::size_t speciesIndex,
+                               const std::vector<QPoint> &points) const {
+  const auto &comp{compartments[compartmentIndex]};
+  const auto &arrayPoints{comp->getArrayPoints()};
+  const auto w{imageSize.width()};
+  const auto h{imageSize.height()};
+  const std::size_t nSpecies{compartmentSpeciesIds[compartmentIndex].size()};
+  TimeTraceIndex *index{nullptr};
+  // catch up with the stored timepoints a few at a time, decoding them
+  // without the lock so that the simulation can keep adding timepoints
+  constexpr std::size_t maxTimepointsPerStep{64};
+  std::vector<std::vector<double>> newTimepoints;
+  std::size_t first{0};
+  std::size_t removals{0};
+  std::unique_lock lock(timeTraceIndexMutex);
+  while (!timeTraceIndices.empty()) {
+    auto &compIndex{timeTraceIndices[compartmentIndex]};
+    if (compIndex == nullptr) {
+      compIndex = std::make_unique<TimeTraceIndex>(
+          nSpecies, comp->nPixels(),
+          data->concentration.getCompression().type !=
+              FrameCompressionType::None);
+    }
+    index = compIndex.get();
+    // only add the decoded timepoints if no timepoints were added to or
+    // removed from the index meanwhile
+    if (!newTimepoints.empty() && index->size() == first &&
+        removals == timeTraceIndexRemovals) {
+      for (const auto &c : newTimepoints) {
+        index->push_back(c);
+      }
+    }
+    newTimepoints.clear();
+    first = index->size();
+    removals = timeTraceIndexRemovals;
+    const std::size_t last{std::min(data->concentration.size(),
+                                    first + maxTimepointsPerStep)};
+    if (first >= last) {
+      break;
+    }
+    lock.unlock();
+    for (std::size_t it = first; it < last; ++it) {
+      newTimepoints.push_back(data->concentration[it][compartmentIndex]);
+    }
+    lock.lock();
+  }
+  lock.unlock();
+  const std::size_t nTimepoints{index != nullptr ? index->size()
+                                                 : data->timePoints.size()};
+  constexpr std::size_t invalidIndex{std::numeric_limits<std::size_t>::max()};
+  std::vector<std::size_t> pixelIndices;
+  pixelIndices.reserve(points.size());
+  for (const auto &p : points) {
+    std::size_t ix{invalidIndex};
+    if (p.x() >= 0 && p.x() < w && p.y() >= 0 && p.y() < h) {
+      const auto arrayIndex{
+          static_cast<std::size_t>(p.x() + w * (h - 1 - p.y()))};
+      // array points outside the compartment map to a nearby pixel
+      if (arrayIndex < arrayPoints.size() &&
+          arrayPoints[arrayIndex] < comp->nPixels() &&
+          comp->getPixel(arrayPoints[arrayIndex]) == p) {
+        ix = arrayPoints[arrayIndex];
+      }
+    }
+    pixelIndices.push_back(ix);
+  }
+  std::vector<std::vector<double>> timeSeries(
+      points.size(), std::vector<double>(nTimepoints, 0.0));
+  if (index != nullptr) {
+    for (std::size_t i = 0; i < pixelIndices.size(); ++i) {
+      if (pixelIndices[i] != invalidIndex) {
+        auto values{index->getTimeSeries(speciesIndex, pixelIndices[i])};
+        values.resize(nTimepoints);
+        timeSeries[i] = std::move(values);
+      }
+    }
+    return timeSeries;
+  }
+  // without an index every timepoint has to be read
+  for (std::size_t it = 0; it < nTimepoints; ++it) {
+    const auto frame{data->concentration[it]};
+    const auto &c{frame[compartmentIndex]};
+    for (std::size_t i = 0; i < pixelIndices.size(); ++i) {
+      if (pixelIndices[i] != invalidIndex) {
+        timeSeries[i][it] = c[pixelIndices[i] * nSpecies + speciesIndex];
+      }
+    }
+  }
+  return timeSeries;
+}
+
 void Simulation::applyConcsToModel(model::Model &m,
                                    std::size_t timeIndex) const {
   for (std::size_t iCompartment = 0; iCompartment < compartmentIds.size();
@@ -407,7 +714,7 @@ std::vector<double> Simulation::getDcdt(std::size_t compartmentIndex,
     const auto &compDcdt = s->getDcdt(compartmentIndex);
     std::size_t nPixels = compartments[compartmentIndex]->nPixels();
     std::size_t nSpecies = compartmentSpeciesIds[compartmentIndex].size();
-    std::size_t stride{nSpecies + data->concPadding.back()};
+    std::size_t stride{nSpecies + s->getConcentrationPadding()};
     c.reserve(nPixels);
     for (std::size_t ix = 0; ix < nPixels; ++ix) {
       c.push_back(compDcdt[ix * stride + speciesIndex]);
@@ -426,7 +733,7 @@ std::vector<double> Simulation::getDcdtArray(std::size_t compartmentIndex,
     const auto &comp = compartments[compartmentIndex];
     std::size_t nPixels = compartments[compartmentIndex]->nPixels();
     std::size_t nSpecies = compartmentSpeciesIds[compartmentIndex].size();
-    std::size_t stride{nSpecies + data->concPadding.back()};
+    std::size_t stride{nSpecies + s->getConcentrationPadding()};
     for (std::size_t ix = 0; ix < nPixels; ++ix) {
       const auto &point = comp->getPixel(ix);
       auto arrayIndex{static_cast<std::size_t>(
@@ -496,19 +803,19 @@ QImage Simulation::getConcImage(
   }
   QImage img(imageSize, QImage::Format_ARGB32_Premultiplied);
   img.fill(qRgba(0, 0, 0, 0));
+  const auto frame{data->concentration[timeIndex]};
   // iterate over compartments
   for (std::size_t ic = 0; ic < compartments.size(); ++ic) {
     const auto &pixels{compartments[ic]->getPixels()};
-    const auto &conc{data->concentration[timeIndex][ic]};
+    const auto &conc{frame[ic]};
     std::size_t nSpecies = compartmentSpeciesIds[ic].size();
-    std::size_t stride{nSpecies + data->concPadding[timeIndex]};
     for (std::size_t ix = 0; ix < pixels.size(); ++ix) {
       const QPoint &p{pixels[ix]};
       int r = 0;
       int g = 0;
       int b = 0;
       for (std::size_t is : (*speciesIndices)[ic]) {
-        double c = conc[ix * stride + is] / maxConcs[ic][is];
+        double c = conc[ix * nSpecies + is] / maxConcs[ic][is];
         const auto &col = compartmentSpeciesColors[ic][is];
         r += static_cast<int>(qRed(col) * c);
         g += static_cast<int>(qGreen(col) * c);
@@ -545,13 +852,13 @@ Simulation::getPyConcs(std::size_t timeIndex,
           0.0));
   const auto w{static_cast<std::size_t>(imageSize.width())};
   const auto &pixels{compartments[compartmentIndex]->getPixels()};
-  const auto &conc{data->concentration[timeIndex][compartmentIndex]};
+  const auto frame{data->concentration[timeIndex]};
+  const auto &conc{frame[compartmentIndex]};
   const std::size_t nSpecies{compartmentSpeciesIds[compartmentIndex].size()};
-  const std::size_t stride{nSpecies + data->concPadding[timeIndex]};
   for (std::size_t ix = 0; ix < pixels.size(); ++ix) {
     const auto pyIndex{pointToPyIndex(pixels[ix], w)};
     for (std::size_t is : compartmentSpeciesIndices[compartmentIndex]) {
-      pyConcs[is][pyIndex] = conc[ix * stride + is];
+      pyConcs[is][pyIndex] = conc[ix * nSpecies + is];
     }
   }
   return pyConcs;
@@ -561,7 +868,7 @@ Simulation::getPyConcs(std::size_t timeIndex,
 Simulation::getPyDcdts(std::size_t compartmentIndex) const {
   // dcdt is only available from pixel sim, and only for the last timestep
   const PixelSim *pixelSim{dynamic_cast<const PixelSim *>(simulator.get())};
-  if (pixelSim == nullptr || data->concPadding.empty()) {
+  if (pixelSim == nullptr || data->timePoints.empty()) {
     return {};
   }
   std::vector<std::vector<double>> pyDcdts(
@@ -573,7 +880,7 @@ Simulation::getPyDcdts(std::size_t compartmentIndex) const {
   const auto &pixels{compartments[compartmentIndex]->getPixels()};
   const auto &dcdt{pixelSim->getDcdt(compartmentIndex)};
   const std::size_t nSpecies{compartmentSpeciesIds[compartmentIndex].size()};
-  const std::size_t stride{nSpecies + data->concPadding.back()};
+  const std::size_t stride{nSpecies + pixelSim->getConcentrationPadding()};
   for (std::size_t ix = 0; ix < pixels.size(); ++ix) {
     const auto pyIndex{pointToPyIndex(pixels[ix], w)};
     for (std::size_t is : compartmentSpeciesIndices[compartmentIndex]) {
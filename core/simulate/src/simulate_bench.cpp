@@ -1,6 +1,7 @@
 #include "bench.hpp"
 #include "sme/simulate.hpp"
 #include "sme/simulate_options.hpp"
+#include <limits>
 
 using namespace sme;
 
@@ -37,6 +38,64 @@ static void simulate_Simulation_getConcImage(benchmark::State &state) {
   }
 }
 
+// state.range(0): fuseRKStages
+template <typename T>
+static void simulate_Simulation_PIXEL_doTimesteps(benchmark::State &state) {
+  T data;
+  data.model.getSimulationSettings().simulatorType =
+      simulate::SimulatorType::Pixel;
+  auto &options{data.model.getSimulationSettings().options.pixel};
+  options.integrator = simulate::PixelIntegratorType::RK323;
+  options.maxErr = {std::numeric_limits<double>::max(),
+                    std::numeric_limits<double>::max()};
+  options.maxTimestep = 1e-3;
+  options.fuseRKStages = state.range(0) != 0;
+  simulate::Simulation simulation(data.model);
+  for (auto _ : state) {
+    simulation.doTimesteps(1e-2);
+  }
+}
+
+// state.range(0): maxThreads
+template <typename T>
+static void
+simulate_Simulation_PIXEL_doTimesteps_threads(benchmark::State &state) {
+  T data;
+  data.model.getSimulationSettings().simulatorType =
+      simulate::SimulatorType::Pixel;
+  auto &options{data.model.getSimulationSettings().options.pixel};
+  options.integrator = simulate::PixelIntegratorType::RK323;
+  options.maxErr = {std::numeric_limits<double>::max(),
+                    std::numeric_limits<double>::max()};
+  options.maxTimestep = 1e-3;
+  options.enableMultiThreading = true;
+  options.maxThreads = static_cast<std::size_t>(state.range(0));
+  simulate::Simulation simulation(data.model);
+  for (auto _ : state) {
+    simulation.doTimesteps(1e-2);
+  }
+}
+
+template <typename T>
+static void
+simulate_Simulation_PIXEL_doTimesteps_Rosenbrock(benchmark::State &state) {
+  T data;
+  data.model.getSimulationSettings().simulatorType =
+      simulate::SimulatorType::Pixel;
+  auto &options{data.model.getSimulationSettings().options.pixel};
+  options.integrator = simulate::PixelIntegratorType::Rosenbrock;
+  options.maxTimestep = 1e-3;
+  simulate::Simulation simulation(data.model);
+  for (auto _ : state) {
+    simulation.doTimesteps(1e-2);
+  }
+}
+
 SME_BENCHMARK(simulate_SimulationDUNE);
 SME_BENCHMARK(simulate_SimulationPIXEL);
 SME_BENCHMARK(simulate_Simulation_getConcImage);
+SME_BENCHMARK_DENSE_RANGE(simulate_Simulation_PIXEL_doTimesteps,
+                          "fuseRKStages", 0, 1);
+SME_BENCHMARK_DENSE_RANGE(simulate_Simulation_PIXEL_doTimesteps_threads,
+                          "maxThreads", 1, 8);
+SME_BENCHMARK(simulate_Simulation_PIXEL_doTimesteps_Rosenbrock);
@@ -1,13 +1,1024 @@
 #include "sme/simulate_data.hpp"
+#include "sme/logger.hpp"
+#include <QByteArray>
+#include <QDir>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+// Qt defines emit keyword which interferes with a tbb emit() function
+#ifdef emit
+#undef emit
+#include <oneapi/tbb/parallel_for.h>
+#define emit // restore the Qt empty definition of "emit"
+#else
+#include <oneapi/tbb/parallel_for.h>
+#endif
 
 namespace sme::simulate {
 
+ConcentrationFrame::ConcentrationFrame(
+    std::shared_ptr<const std::vector<std::vector<double>>> concentrations)
+    : frame{std::move(concentrations)} {}
+
+std::size_t ConcentrationFrame::size() const {
+  return frame == nullptr ? 0 : frame->size();
+}
+
+bool ConcentrationFrame::empty() const { return size() == 0; }
+
+const std::vector<double> &
+ConcentrationFrame::operator[](std::size_t compartmentIndex) const & {
+  return (*frame)[compartmentIndex];
+}
+
+const std::vector<std::vector<double>> &ConcentrationFrame::get() const & {
+  static const std::vector<std::vector<double>> noConcentrations{};
+  return frame == nullptr ? noConcentrations : *frame;
+}
+
+std::vector<double>
+ConcentrationFrame::operator[](std::size_t compartmentIndex) && {
+  return (*frame)[compartmentIndex];
+}
+
+std::vector<std::vector<double>> ConcentrationFrame::get() && {
+  return static_cast<const ConcentrationFrame &>(*this).get();
+}
+
+namespace {
+
+using Frame = std::vector<std::vector<double>>;
+using SharedFrame = std::shared_ptr<const Frame>;
+using Words = std::vector<std::uint64_t>;
+
+// how the bytes of a stored timepoint are encoded
+enum class Encoding : std::uint8_t {
+  // the doubles
+  Raw = 0,
+  // compressed doubles, XOR'd with the previous timepoint
+  Xor = 1,
+  // compressed difference from the previous timepoint of the quantized values
+  Quantized = 2
+};
+
+// maximum number of timepoints that are stored as a difference from the
+// previous timepoint before a self-contained one
+constexpr std::size_t keyframeInterval{16};
+
+// zlib compression level: favour speed over compression ratio
+constexpr int compressionLevel{1};
+
+// values with a larger magnitude in units of the quantization step can't be
+// represented exactly as a double after quantization
+constexpr double maxQuantizedValue{4503599627370496.0};
+
+constexpr std::size_t defaultCachedFrames{16};
+
+std::uint64_t zigzag(std::int64_t x) {
+  return (static_cast<std::uint64_t>(x) << 1) ^
+         static_cast<std::uint64_t>(x >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t x) {
+  return static_cast<std::int64_t>(x >> 1) ^ -static_cast<std::int64_t>(x & 1);
+}
+
+// group the n-th byte of each word together before compressing: the high
+// bytes of differences between similar values are then mostly zeros
+QByteArray compressWords(const Words &words) {
+  const std::size_t n{words.size()};
+  QByteArray shuffled;
+  shuffled.resize(static_cast<qsizetype>(n * sizeof(std::uint64_t)));
+  auto *dest{reinterpret_cast<unsigned char *>(shuffled.data())};
+  for (std::size_t b = 0; b < sizeof(std::uint64_t); ++b) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dest[b * n + i] = static_cast<unsigned char>(words[i] >> (8 * b));
+    }
+  }
+  return qCompress(shuffled, compressionLevel);
+}
+
+Words decompressWords(const char *bytes, std::size_t nBytes,
+                      std::size_t nWords) {
+  Words words(nWords, 0);
+  const auto shuffled{qUncompress(reinterpret_cast<const uchar *>(bytes),
+                                  static_cast<qsizetype>(nBytes))};
+  if (static_cast<std::size_t>(shuffled.size()) !=
+      nWords * sizeof(std::uint64_t)) {
+    SPDLOG_ERROR("Invalid compressed concentrations");
+    return words;
+  }
+  const auto *src{reinterpret_cast<const unsigned char *>(shuffled.data())};
+  for (std::size_t b = 0; b < sizeof(std::uint64_t); ++b) {
+    for (std::size_t i = 0; i < nWords; ++i) {
+      words[i] |= static_cast<std::uint64_t>(src[b * nWords + i]) << (8 * b);
+    }
+  }
+  return words;
+}
+
+} // namespace
+
+struct ConcentrationFrames::Store {
+  // a memory-mapped temporary file that frames are appended to
+  class Chunk {
+  private:
+    QTemporaryFile file;
+    uchar *data{nullptr};
+    std::size_t capacity{0};
+
+  public:
+    std::size_t used{0};
+    // true if frames in this chunk are referred to by a copy of the store
+    std::atomic<bool> shared{false};
+    Chunk(const QString &directory, std::size_t nBytes)
+        : file{QDir(directory).filePath("sme-concentrations-XXXXXX.bin")},
+          capacity{nBytes} {
+      if (!file.open() || !file.resize(static_cast<qint64>(nBytes))) {
+        throw std::runtime_error(
+            fmt::format("Failed to create {} byte file in '{}': {}", nBytes,
+                        directory.toStdString(),
+                        file.errorString().toStdString()));
+      }
+      data = file.map(0, static_cast<qint64>(nBytes));
+      if (data == nullptr) {
+        throw std::runtime_error(
+            fmt::format("Failed to memory-map file '{}': {}",
+                        file.fileName().toStdString(),
+                        file.errorString().toStdString()));
+      }
+      SPDLOG_DEBUG("created {} byte chunk {}", nBytes,
+                   file.fileName().toStdString());
+    }
+    Chunk(const Chunk &) = delete;
+    Chunk &operator=(const Chunk &) = delete;
+    Chunk(Chunk &&) = delete;
+    Chunk &operator=(Chunk &&) = delete;
+    ~Chunk() { file.unmap(data); }
+    [[nodiscard]] std::size_t available() const { return capacity - used; }
+    [[nodiscard]] char *at(std::size_t offset) const {
+      return reinterpret_cast<char *>(data + offset);
+    }
+  };
+  // a stored frame: in memory, or at offset in a chunk
+  struct Entry {
+    Encoding encoding;
+    // index of the last self-contained frame
+    std::size_t keyframe;
+    std::vector<std::size_t> sizes;
+    QByteArray bytes{};
+    std::shared_ptr<Chunk> chunk{};
+    std::size_t offset{0};
+    std::size_t nBytes{0};
+  };
+  // the bits or quantized values of a frame
+  struct State {
+    std::size_t index;
+    Encoding encoding;
+    std::vector<std::size_t> sizes;
+    Words words;
+  };
+  static constexpr std::size_t minChunkBytes{std::size_t{16} << 20};
+  static constexpr std::size_t maxChunkBytes{std::size_t{1} << 30};
+  FrameCompression compression;
+  // quantization step for BoundedError compression
+  double step;
+  // no directory: frames are stored in memory
+  QString directory;
+  std::size_t cachedFrames;
+  // the single writer is the only thread that modifies entries, so it can
+  // read them without a lock, other threads hold a shared lock of mutex
+  std::vector<Entry> entries{};
+  std::size_t rawBytes{0};
+  std::size_t storedBytes{0};
+  mutable std::shared_mutex mutex{};
+  // only used by the writer:
+  std::size_t nextChunkBytes{minChunkBytes};
+  // chunk that new frames are appended to
+  std::shared_ptr<Chunk> writeChunk{};
+  // the last frame added, which the next one is encoded relative to, only
+  // modified by the writer while holding a unique lock of mutex
+  std::optional<State> reference{};
+  // guarded by cacheMutex, which is never held while decoding a frame:
+  // the last frame decoded, which following frames can be decoded from
+  mutable std::optional<State> decoded{};
+  // most recently used frames, most recent at the back
+  mutable std::vector<std::pair<std::size_t, SharedFrame>> cache{};
+  // number of times frames have been removed: a frame that was being decoded
+  // while one was removed may be out of date, so it is decoded again
+  std::size_t removals{0};
+  mutable std::mutex cacheMutex{};
+
+  Store(const std::string &dir, std::size_t nCachedFrames,
+        const FrameCompression &frameCompression)
+      : compression{frameCompression}, step{frameCompression.maxError},
+        directory{dir.c_str()}, cachedFrames{std::max(nCachedFrames,
+                                                      std::size_t{1})} {}
+  // a copy shares the existing chunks but appends to a new one
+  Store(const Store &other)
+      : compression{other.compression}, step{other.step},
+        directory{other.directory}, cachedFrames{other.cachedFrames},
+        nextChunkBytes{other.nextChunkBytes} {
+    {
+      std::shared_lock lock(other.mutex);
+      entries = other.entries;
+      reference = other.reference;
+      rawBytes = other.rawBytes;
+      storedBytes = other.storedBytes;
+      // the writer can only reuse the space of the last frame
+      if (!entries.empty() && entries.back().chunk != nullptr) {
+        entries.back().chunk->shared = true;
+      }
+    }
+    {
+      std::scoped_lock lock(other.cacheMutex);
+      decoded = other.decoded;
+      cache = other.cache;
+    }
+  }
+  Store(Store &&) = delete;
+  Store &operator=(const Store &) = delete;
+  Store &operator=(Store &&) = delete;
+  ~Store() = default;
+
+  // requires cacheMutex to be locked
+  void addToCache(std::size_t index, SharedFrame frame) const {
+    if (cache.size() >= cachedFrames) {
+      cache.erase(cache.begin());
+    }
+    cache.emplace_back(index, std::move(frame));
+  }
+
+  [[nodiscard]] static const char *bytesOf(const Entry &entry) {
+    if (entry.chunk != nullptr) {
+      return entry.chunk->at(entry.offset);
+    }
+    return entry.bytes.constData();
+  }
+
+  [[nodiscard]] SharedFrame toFrame(const State &state) const {
+    auto frame{std::make_shared<Frame>()};
+    frame->reserve(state.sizes.size());
+    auto word{state.words.cbegin()};
+    for (auto n : state.sizes) {
+      auto &c{frame->emplace_back(n)};
+      if (state.encoding == Encoding::Quantized) {
+        for (auto &v : c) {
+          v = static_cast<double>(static_cast<std::int64_t>(*word++)) * step;
+        }
+      } else if (n > 0) {
+        std::memcpy(c.data(), &*word, n * sizeof(double));
+        word += static_cast<std::ptrdiff_t>(n);
+      }
+    }
+    return frame;
+  }
+
+  [[nodiscard]] State toState(const Frame &frame) const {
+    State state{0, Encoding::Raw, {}, {}};
+    std::size_t nValues{0};
+    for (const auto &c : frame) {
+      state.sizes.push_back(c.size());
+      nValues += c.size();
+    }
+    state.words.reserve(nValues);
+    bool quantize{compression.type == FrameCompressionType::BoundedError};
+    for (const auto &c : frame) {
+      for (auto v : c) {
+        quantize = quantize && std::abs(v / step) < maxQuantizedValue;
+        std::uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(double));
+        state.words.push_back(bits);
+      }
+    }
+    if (quantize) {
+      state.encoding = Encoding::Quantized;
+      std::size_t i{0};
+      for (const auto &c : frame) {
+        for (auto v : c) {
+          state.words[i++] =
+              static_cast<std::uint64_t>(std::llround(v / step));
+        }
+      }
+    } else if (compression.type != FrameCompressionType::None) {
+      // values that can't be quantized are stored losslessly
+      state.encoding = Encoding::Xor;
+    }
+    return state;
+  }
+
+  // writer only: copy the bytes to the write chunk, then make the entry
+  // visible to readers along with the new reference frame
+  void append(Entry &&entry, std::optional<State> &&newReference) {
+    if (!directory.isEmpty()) {
+      if (writeChunk == nullptr || writeChunk->available() < entry.nBytes) {
+        writeChunk = std::make_shared<Chunk>(
+            directory, std::max(nextChunkBytes, entry.nBytes));
+        nextChunkBytes = std::min(2 * nextChunkBytes, maxChunkBytes);
+      }
+      entry.chunk = writeChunk;
+      entry.offset = writeChunk->used;
+      if (entry.nBytes > 0) {
+        std::memcpy(writeChunk->at(writeChunk->used), entry.bytes.constData(),
+                    entry.nBytes);
+      }
+      writeChunk->used += entry.nBytes;
+      entry.bytes.clear();
+    }
+    std::size_t nRawBytes{0};
+    for (auto n : entry.sizes) {
+      nRawBytes += n * sizeof(double);
+    }
+    std::unique_lock lock(mutex);
+    rawBytes += nRawBytes;
+    storedBytes += entry.nBytes;
+    entries.push_back(std::move(entry));
+    reference = std::move(newReference);
+  }
+
+  // writer only: compress the frame relative to the reference frame
+  [[nodiscard]] Entry encode(const State &state) const {
+    const bool isDelta{
+        state.encoding != Encoding::Raw && reference.has_value() &&
+        reference->encoding == state.encoding &&
+        reference->sizes == state.sizes &&
+        state.index - entries.back().keyframe < keyframeInterval};
+    Entry entry{state.encoding, isDelta ? entries.back().keyframe : state.index,
+                state.sizes};
+    if (state.encoding == Encoding::Raw) {
+      entry.bytes =
+          QByteArray(reinterpret_cast<const char *>(state.words.data()),
+                     static_cast<qsizetype>(state.words.size() *
+                                            sizeof(std::uint64_t)));
+    } else {
+      auto payload{state.words};
+      for (std::size_t i = 0; i < payload.size(); ++i) {
+        if (state.encoding == Encoding::Xor) {
+          payload[i] ^= isDelta ? reference->words[i] : 0;
+        } else {
+          auto q{static_cast<std::int64_t>(payload[i])};
+          if (isDelta) {
+            q -= static_cast<std::int64_t>(reference->words[i]);
+          }
+          payload[i] = zigzag(q);
+        }
+      }
+      entry.bytes = compressWords(payload);
+    }
+    entry.nBytes = static_cast<std::size_t>(entry.bytes.size());
+    return entry;
+  }
+
+  void push_back(SharedFrame frame) {
+    auto state{toState(*frame)};
+    const std::size_t index{entries.size()};
+    state.index = index;
+    auto entry{encode(state)};
+    if (state.encoding == Encoding::Quantized) {
+      // cache the values that will be returned when decoding
+      frame = toFrame(state);
+    }
+    append(std::move(entry), std::move(state));
+    std::scoped_lock lock(cacheMutex);
+    addToCache(index, std::move(frame));
+  }
+
+  bool pushEncoded(const Encoded &encoded) {
+    const auto encoding{static_cast<Encoding>(encoded.type)};
+    if (encoding != Encoding::Raw && encoding != Encoding::Xor &&
+        encoding != Encoding::Quantized) {
+      return false;
+    }
+    std::vector<std::size_t> sizes(encoded.sizes.cbegin(),
+                                   encoded.sizes.cend());
+    std::size_t nValues{0};
+    for (auto n : sizes) {
+      nValues += n;
+    }
+    const std::size_t index{entries.size()};
+    if (encoded.keyframeOffset > index ||
+        (encoding == Encoding::Raw &&
+         (encoded.keyframeOffset != 0 ||
+          encoded.bytes.size() != nValues * sizeof(double)))) {
+      return false;
+    }
+    const auto keyframe{
+        index - static_cast<std::size_t>(encoded.keyframeOffset)};
+    if (keyframe != index) {
+      const auto &previous{entries.back()};
+      if (previous.encoding != encoding || previous.sizes != sizes ||
+          previous.keyframe != keyframe) {
+        return false;
+      }
+    }
+    Entry entry{encoding, keyframe, std::move(sizes)};
+    entry.bytes = QByteArray(encoded.bytes.data(),
+                             static_cast<qsizetype>(encoded.bytes.size()));
+    entry.nBytes = encoded.bytes.size();
+    // the next frame added will be self-contained
+    append(std::move(entry), std::nullopt);
+    return true;
+  }
+
+  [[nodiscard]] Encoded getEncoded(std::size_t index) const {
+    std::shared_lock lock(mutex);
+    const auto &entry{entries[index]};
+    return {static_cast<std::uint8_t>(entry.encoding), index - entry.keyframe,
+            std::vector<std::uint64_t>(entry.sizes.cbegin(),
+                                       entry.sizes.cend()),
+            std::string(bytesOf(entry), entry.nBytes)};
+  }
+
+  // chain holds the entries from the keyframe to the frame to decode, start
+  // is an earlier decoded frame of the same chain, if any
+  [[nodiscard]] State decode(const std::vector<Entry> &chain,
+                             std::optional<State> start) const {
+    const auto &entry{chain.back()};
+    const std::size_t index{entry.keyframe + chain.size() - 1};
+    std::size_t nWords{0};
+    for (auto n : entry.sizes) {
+      nWords += n;
+    }
+    State state{index, entry.encoding, entry.sizes, {}};
+    if (entry.encoding == Encoding::Raw) {
+      state.words.resize(nWords);
+      if (nWords > 0) {
+        std::memcpy(state.words.data(), bytesOf(entry),
+                    nWords * sizeof(std::uint64_t));
+      }
+      return state;
+    }
+    // continue from the earlier decoded frame
+    std::size_t first{entry.keyframe};
+    if (start.has_value()) {
+      first = start->index + 1;
+      state.words = std::move(start->words);
+    }
+    std::vector<Words> payloads(index + 1 - first);
+    oneapi::tbb::parallel_for(std::size_t{0}, payloads.size(),
+                              [&](std::size_t i) {
+                                const auto &e{chain[first + i -
+                                                    entry.keyframe]};
+                                payloads[i] = decompressWords(
+                                    bytesOf(e), e.nBytes, nWords);
+                              });
+    for (std::size_t i = 0; i < payloads.size(); ++i) {
+      auto &payload{payloads[i]};
+      if (first + i == entry.keyframe) {
+        state.words = std::move(payload);
+        if (entry.encoding == Encoding::Quantized) {
+          for (auto &w : state.words) {
+            w = static_cast<std::uint64_t>(unzigzag(w));
+          }
+        }
+      } else if (entry.encoding == Encoding::Xor) {
+        for (std::size_t j = 0; j < nWords; ++j) {
+          state.words[j] ^= payload[j];
+        }
+      } else {
+        for (std::size_t j = 0; j < nWords; ++j) {
+          state.words[j] += static_cast<std::uint64_t>(unzigzag(payload[j]));
+        }
+      }
+    }
+    return state;
+  }
+
+  [[nodiscard]] SharedFrame get(std::size_t index) const {
+    while (true) {
+      std::size_t nRemovals{0};
+      {
+        std::scoped_lock lock(cacheMutex);
+        if (auto iter{std::find_if(cache.begin(), cache.end(),
+                                   [index](const auto &p) {
+                                     return p.first == index;
+                                   })};
+            iter != cache.end()) {
+          auto frame{iter->second};
+          cache.erase(iter);
+          cache.emplace_back(index, frame);
+          return frame;
+        }
+        nRemovals = removals;
+      }
+      // copies of the entries keep their bytes valid without the lock
+      std::vector<Entry> chain;
+      {
+        std::shared_lock lock(mutex);
+        const auto keyframe{static_cast<std::ptrdiff_t>(
+            entries[index].keyframe)};
+        chain.assign(entries.cbegin() + keyframe,
+                     entries.cbegin() + static_cast<std::ptrdiff_t>(index) + 1);
+      }
+      // continue from the last decoded frame if it is earlier in the chain
+      std::optional<State> start;
+      {
+        std::scoped_lock lock(cacheMutex);
+        const auto &entry{chain.back()};
+        if (decoded.has_value() && entry.encoding != Encoding::Raw &&
+            decoded->encoding == entry.encoding &&
+            decoded->index >= entry.keyframe && decoded->index < index) {
+          start = std::move(decoded);
+          decoded.reset();
+        }
+      }
+      auto state{decode(chain, std::move(start))};
+      auto frame{toFrame(state)};
+      std::scoped_lock lock(cacheMutex);
+      if (removals != nRemovals) {
+        // a frame was removed while decoding, and its bytes may have been
+        // re-used
+        continue;
+      }
+      addToCache(index, frame);
+      if (state.encoding != Encoding::Raw) {
+        decoded = std::move(state);
+      }
+      return frame;
+    }
+  }
+
+  // writer only
+  void removeLastFrame() {
+    std::size_t index{0};
+    {
+      std::unique_lock lock(mutex);
+      const auto &entry{entries.back()};
+      // reuse the space if no copy can still be referring to it
+      if (entry.chunk != nullptr && entry.chunk == writeChunk &&
+          !writeChunk->shared) {
+        writeChunk->used = entry.offset;
+      }
+      for (auto n : entry.sizes) {
+        rawBytes -= n * sizeof(double);
+      }
+      storedBytes -= entry.nBytes;
+      index = entries.size() - 1;
+      entries.pop_back();
+      // the next frame added will be self-contained
+      reference.reset();
+    }
+    {
+      std::scoped_lock lock(cacheMutex);
+      cache.erase(std::remove_if(cache.begin(), cache.end(),
+                                 [index](const auto &p) {
+                                   return p.first == index;
+                                 }),
+                  cache.end());
+      if (decoded.has_value() && decoded->index >= index) {
+        decoded.reset();
+      }
+      ++removals;
+    }
+  }
+
+  void pop_back() { removeLastFrame(); }
+
+  void replaceBack(SharedFrame frame) {
+    removeLastFrame();
+    push_back(std::move(frame));
+  }
+
+  void clear() {
+    {
+      std::unique_lock lock(mutex);
+      entries.clear();
+      reference.reset();
+      rawBytes = 0;
+      storedBytes = 0;
+    }
+    {
+      std::scoped_lock lock(cacheMutex);
+      cache.clear();
+      decoded.reset();
+      ++removals;
+    }
+    writeChunk.reset();
+    nextChunkBytes = minChunkBytes;
+  }
+};
+
+ConcentrationFrames::ConcentrationFrames() = default;
+
+ConcentrationFrames::ConcentrationFrames(const ConcentrationFrames &other) {
+  {
+    std::shared_lock lock(other.framesMutex);
+    frames = other.frames;
+  }
+  if (other.store != nullptr) {
+    store = std::make_unique<Store>(*other.store);
+  }
+}
+
+// the mutex is not moved: moving is not safe while other threads may be
+// reading the frames
+ConcentrationFrames::ConcentrationFrames(ConcentrationFrames &&other) noexcept
+    : frames{std::move(other.frames)}, store{std::move(other.store)} {}
+
+ConcentrationFrames &
+ConcentrationFrames::operator=(const ConcentrationFrames &other) {
+  if (this != &other) {
+    ConcentrationFrames tmp(other);
+    *this = std::move(tmp);
+  }
+  return *this;
+}
+
+ConcentrationFrames &
+ConcentrationFrames::operator=(ConcentrationFrames &&other) noexcept {
+  frames = std::move(other.frames);
+  store = std::move(other.store);
+  return *this;
+}
+
+ConcentrationFrames::~ConcentrationFrames() = default;
+
+std::size_t ConcentrationFrames::size() const {
+  if (store != nullptr) {
+    std::shared_lock lock(store->mutex);
+    return store->entries.size();
+  }
+  return frames.size();
+}
+
+bool ConcentrationFrames::empty() const { return size() == 0; }
+
+ConcentrationFrame
+ConcentrationFrames::operator[](std::size_t timeIndex) const {
+  if (store != nullptr) {
+    return ConcentrationFrame(store->get(timeIndex));
+  }
+  std::shared_lock lock(framesMutex);
+  return ConcentrationFrame(frames[timeIndex]);
+}
+
+ConcentrationFrame ConcentrationFrames::back() const {
+  return (*this)[size() - 1];
+}
+
+void ConcentrationFrames::push_back(
+    std::vector<std::vector<double>> concentrations) {
+  auto frame{std::make_shared<const Frame>(std::move(concentrations))};
+  if (store != nullptr) {
+    store->push_back(std::move(frame));
+    return;
+  }
+  std::unique_lock lock(framesMutex);
+  frames.push_back(std::move(frame));
+}
+
+void ConcentrationFrames::replaceBack(
+    std::vector<std::vector<double>> concentrations) {
+  auto frame{std::make_shared<const Frame>(std::move(concentrations))};
+  if (store != nullptr) {
+    store->replaceBack(std::move(frame));
+    return;
+  }
+  std::unique_lock lock(framesMutex);
+  // the old frame is released after unlocking, by whichever thread holds the
+  // last reference to it
+  std::swap(frames.back(), frame);
+  lock.unlock();
+}
+
+void ConcentrationFrames::pop_back() {
+  if (store != nullptr) {
+    store->pop_back();
+    return;
+  }
+  std::unique_lock lock(framesMutex);
+  frames.pop_back();
+}
+
+void ConcentrationFrames::clear() {
+  {
+    std::unique_lock lock(framesMutex);
+    frames.clear();
+  }
+  if (store != nullptr) {
+    store->clear();
+  }
+}
+
+void ConcentrationFrames::reserve(std::size_t n) {
+  if (store != nullptr) {
+    std::unique_lock lock(store->mutex);
+    store->entries.reserve(n);
+    return;
+  }
+  frames.reserve(n);
+}
+
+void ConcentrationFrames::reconfigure(
+    const std::string &directory, std::size_t cachedFrames,
+    const FrameCompression &frameCompression) {
+  std::unique_ptr<Store> newStore;
+  if (!directory.empty() ||
+      frameCompression.type != FrameCompressionType::None) {
+    newStore =
+        std::make_unique<Store>(directory, cachedFrames, frameCompression);
+  }
+  // re-encode existing frames one at a time
+  const std::size_t n{size()};
+  auto oldFrames{std::move(frames)};
+  frames.clear();
+  for (std::size_t i = 0; i < n; ++i) {
+    auto frame{store != nullptr ? store->get(i) : std::move(oldFrames[i])};
+    if (newStore != nullptr) {
+      newStore->push_back(std::move(frame));
+    } else {
+      frames.push_back(std::move(frame));
+    }
+  }
+  store = std::move(newStore);
+}
+
+void ConcentrationFrames::setDiskBacked(const std::string &directory,
+                                        std::size_t cachedFrames) {
+  reconfigure(directory, cachedFrames, getCompression());
+  if (!directory.empty()) {
+    SPDLOG_INFO("storing concentrations in '{}', {} frames cached in memory",
+                directory, store->cachedFrames);
+  }
+}
+
+bool ConcentrationFrames::isDiskBacked() const {
+  return store != nullptr && !store->directory.isEmpty();
+}
+
+void ConcentrationFrames::setCompression(
+    const FrameCompression &frameCompression) {
+  if (store == nullptr) {
+    reconfigure({}, defaultCachedFrames, frameCompression);
+  } else {
+    reconfigure(store->directory.toStdString(), store->cachedFrames,
+                frameCompression);
+  }
+}
+
+const FrameCompression &ConcentrationFrames::getCompression() const {
+  static const FrameCompression noCompression{};
+  return store == nullptr ? noCompression : store->compression;
+}
+
+double ConcentrationFrames::getCompressionRatio() const {
+  if (store == nullptr) {
+    return 1.0;
+  }
+  std::shared_lock lock(store->mutex);
+  if (store->storedBytes == 0) {
+    return 1.0;
+  }
+  return static_cast<double>(store->rawBytes) /
+         static_cast<double>(store->storedBytes);
+}
+
+ConcentrationFrames::Encoded
+ConcentrationFrames::getEncoded(std::size_t timeIndex) const {
+  if (store != nullptr) {
+    return store->getEncoded(timeIndex);
+  }
+  Encoded encoded{static_cast<std::uint8_t>(Encoding::Raw), 0, {}, {}};
+  SharedFrame frame;
+  {
+    std::shared_lock lock(framesMutex);
+    frame = frames[timeIndex];
+  }
+  for (const auto &c : *frame) {
+    encoded.sizes.push_back(c.size());
+    encoded.bytes.append(reinterpret_cast<const char *>(c.data()),
+                         c.size() * sizeof(double));
+  }
+  return encoded;
+}
+
+bool ConcentrationFrames::pushEncoded(const Encoded &encoded) {
+  if (store == nullptr) {
+    if (encoded.type == static_cast<std::uint8_t>(Encoding::Raw)) {
+      auto frame{std::make_shared<Frame>()};
+      const char *src{encoded.bytes.data()};
+      std::size_t nBytes{0};
+      for (auto n : encoded.sizes) {
+        nBytes += n * sizeof(double);
+      }
+      if (encoded.keyframeOffset != 0 || nBytes != encoded.bytes.size()) {
+        return false;
+      }
+      for (auto n : encoded.sizes) {
+        auto &c{frame->emplace_back(n)};
+        if (n > 0) {
+          std::memcpy(c.data(), src, n * sizeof(double));
+          src += n * sizeof(double);
+        }
+      }
+      std::unique_lock lock(framesMutex);
+      frames.push_back(std::move(frame));
+      return true;
+    }
+    // compressed frames can only be held by a store
+    store = std::make_unique<Store>(std::string{}, defaultCachedFrames,
+                                    FrameCompression{});
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+      store->push_back(std::move(frames[i]));
+    }
+    frames.clear();
+  }
+  return store->pushEncoded(encoded);
+}
+
+TimeTraceIndex::TimeTraceIndex(std::size_t compartmentSpecies,
+                               std::size_t compartmentPixels, bool compress)
+    : nSpecies{compartmentSpecies}, nPixels{compartmentPixels},
+      nPixelTiles{(compartmentPixels + tilePixels - 1) / tilePixels},
+      compressTiles{compress && compartmentSpecies > 0} {}
+
+std::size_t TimeTraceIndex::nCompressedTimeTiles() const {
+  return nPixelTiles == 0 ? 0 : compressedTiles.size() / nPixelTiles;
+}
+
+// requires a unique lock of the mutex
+void TimeTraceIndex::write(std::size_t timeIndex,
+                           const std::vector<double> &concentrations) {
+  if (concentrations.size() != nPixels * nSpecies) {
+    SPDLOG_WARN("Ignoring {} concentrations, expected {}",
+                concentrations.size(), nPixels * nSpecies);
+    return;
+  }
+  const std::size_t timeTile{timeIndex / tileTimepoints -
+                             nCompressedTimeTiles()};
+  const std::size_t it{timeIndex % tileTimepoints};
+  for (std::size_t ix = 0; ix < nPixels; ++ix) {
+    auto &tile{tiles[timeTile * nPixelTiles + ix / tilePixels]};
+    std::copy_n(concentrations.cbegin() +
+                    static_cast<std::ptrdiff_t>(ix * nSpecies),
+                nSpecies,
+                tile.begin() + static_cast<std::ptrdiff_t>(
+                                   ((ix % tilePixels) * tileTimepoints + it) *
+                                   nSpecies));
+  }
+}
+
+std::size_t TimeTraceIndex::size() const {
+  std::shared_lock lock(mutex);
+  return count;
+}
+
+void TimeTraceIndex::push_back(const std::vector<double> &concentrations) {
+  // only the writer modifies the tiles, so it can read them without a lock
+  const std::size_t n{count};
+  std::vector<std::string> compressed;
+  if (compressTiles && n > 0 && n % tileTimepoints == 0) {
+    // the previous tiles now have all of their timepoints: compress each
+    // value XOR'd with the previous timepoint of the same pixel
+    compressed.resize(nPixelTiles);
+    oneapi::tbb::parallel_for(
+        std::size_t{0}, nPixelTiles, [&](std::size_t pixelTile) {
+          const auto &tile{tiles[pixelTile]};
+          Words words(tile.size());
+          std::memcpy(words.data(), tile.data(),
+                      tile.size() * sizeof(double));
+          for (std::size_t i = words.size() - 1; i >= nSpecies; --i) {
+            if (i % (tileTimepoints * nSpecies) >= nSpecies) {
+              words[i] ^= words[i - nSpecies];
+            }
+          }
+          const auto bytes{compressWords(words)};
+          compressed[pixelTile].assign(bytes.constData(),
+                                       static_cast<std::size_t>(bytes.size()));
+        });
+  }
+  std::unique_lock lock(mutex);
+  if (!compressed.empty()) {
+    std::move(compressed.begin(), compressed.end(),
+              std::back_inserter(compressedTiles));
+    tiles.erase(tiles.begin(),
+                tiles.begin() + static_cast<std::ptrdiff_t>(nPixelTiles));
+  }
+  // tiles are kept after pop_back, and re-used
+  const std::size_t nTimeTiles{n / tileTimepoints + 1 -
+                               nCompressedTimeTiles()};
+  while (tiles.size() < nTimeTiles * nPixelTiles) {
+    tiles.emplace_back(tilePixels * tileTimepoints * nSpecies, 0.0);
+  }
+  write(n, concentrations);
+  ++count;
+}
+
+void TimeTraceIndex::replaceBack(const std::vector<double> &concentrations) {
+  std::unique_lock lock(mutex);
+  write(count - 1, concentrations);
+}
+
+void TimeTraceIndex::pop_back() {
+  std::unique_lock lock(mutex);
+  --count;
+  const std::size_t nCompressed{nCompressedTimeTiles()};
+  if (nCompressed == 0 || count / tileTimepoints >= nCompressed) {
+    return;
+  }
+  // the next timepoint is written to the last compressed tiles
+  std::vector<Tile> decompressed;
+  const std::size_t first{(nCompressed - 1) * nPixelTiles};
+  for (std::size_t i = first; i < compressedTiles.size(); ++i) {
+    const auto &bytes{compressedTiles[i]};
+    auto words{decompressWords(bytes.data(), bytes.size(),
+                               tilePixels * tileTimepoints * nSpecies)};
+    for (std::size_t j = 0; j < words.size(); ++j) {
+      if (j % (tileTimepoints * nSpecies) >= nSpecies) {
+        words[j] ^= words[j - nSpecies];
+      }
+    }
+    auto &tile{decompressed.emplace_back(words.size())};
+    std::memcpy(tile.data(), words.data(), words.size() * sizeof(double));
+  }
+  compressedTiles.resize(first);
+  tiles.insert(tiles.begin(), std::make_move_iterator(decompressed.begin()),
+               std::make_move_iterator(decompressed.end()));
+}
+
+std::vector<double>
+TimeTraceIndex::getTimeSeries(std::size_t speciesIndex,
+                              std::size_t pixelIndex) const {
+  const std::size_t pixelTile{pixelIndex / tilePixels};
+  const std::size_t offset{
+      (pixelIndex % tilePixels) * tileTimepoints * nSpecies + speciesIndex};
+  std::vector<double> values;
+  // copy the compressed tiles of the pixel, and decompress them without the
+  // lock
+  std::vector<std::string> compressed;
+  {
+    std::shared_lock lock(mutex);
+    values.resize(count);
+    const std::size_t nCompressed{nCompressedTimeTiles()};
+    for (std::size_t timeTile = 0; timeTile < nCompressed; ++timeTile) {
+      compressed.push_back(
+          compressedTiles[timeTile * nPixelTiles + pixelTile]);
+    }
+    for (std::size_t t = nCompressed * tileTimepoints; t < count; ++t) {
+      const auto &tile{
+          tiles[(t / tileTimepoints - nCompressed) * nPixelTiles +
+                pixelTile]};
+      values[t] = tile[offset + (t % tileTimepoints) * nSpecies];
+    }
+  }
+  for (std::size_t timeTile = 0; timeTile < compressed.size(); ++timeTile) {
+    const auto &bytes{compressed[timeTile]};
+    const auto words{decompressWords(bytes.data(), bytes.size(),
+                                     tilePixels * tileTimepoints * nSpecies)};
+    std::uint64_t bits{0};
+    for (std::size_t it = 0; it < tileTimepoints; ++it) {
+      bits ^= words[offset + it * nSpecies];
+      std::memcpy(&values[timeTile * tileTimepoints + it], &bits,
+                  sizeof(double));
+    }
+  }
+  return values;
+}
+
+void SimulationData::removePadding(
+    const std::vector<std::size_t> &concPadding) {
+  if (std::all_of(concPadding.cbegin(), concPadding.cend(),
+                  [](std::size_t padding) { return padding == 0; })) {
+    return;
+  }
+  SPDLOG_INFO("removing padding from stored concentrations");
+  ConcentrationFrames unpadded;
+  unpadded.setCompression(concentration.getCompression());
+  for (std::size_t it = 0; it < concentration.size(); ++it) {
+    auto c{concentration[it].get()};
+    const std::size_t padding{it < concPadding.size() ? concPadding[it] : 0};
+    for (std::size_t ic = 0; ic < c.size() && padding > 0; ++ic) {
+      if (it >= avgMinMax.size() || ic >= avgMinMax[it].size()) {
+        continue;
+      }
+      // the number of species is the number of avg/min/max values
+      const std::size_t nSpecies{avgMinMax[it][ic].size()};
+      const std::size_t stride{nSpecies + padding};
+      auto &compConc{c[ic]};
+      const std::size_t nPixels{compConc.size() / stride};
+      for (std::size_t ix = 0; ix < nPixels; ++ix) {
+        for (std::size_t is = 0; is < nSpecies; ++is) {
+          compConc[ix * nSpecies + is] = compConc[ix * stride + is];
+        }
+      }
+      compConc.resize(nPixels * nSpecies);
+    }
+    unpadded.push_back(std::move(c));
+  }
+  concentration = std::move(unpadded);
+}
+
 void SimulationData::clear() {
   timePoints.clear();
   concentration.clear();
   avgMinMax.clear();
   concentrationMax.clear();
-  concPadding.clear();
   xmlModel.clear();
 }
 
@@ -18,15 +1029,14 @@ void SimulationData::reserve(std::size_t n) {
   concentration.reserve(n);
   avgMinMax.reserve(n);
   concentrationMax.reserve(n);
-  concPadding.reserve(n);
 }
 
 void SimulationData::pop_back() {
+  // the timepoint is removed first, as it determines the size
   timePoints.pop_back();
   concentration.pop_back();
   avgMinMax.pop_back();
   concentrationMax.pop_back();
-  concPadding.pop_back();
 }
 
 } // namespace sme::simulate
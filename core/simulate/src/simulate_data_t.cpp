@@ -1,34 +1,111 @@
 #include "catch_wrapper.hpp"
 #include "sme/simulate_data.hpp"
+#include <QTemporaryDir>
+#include <cereal/archives/binary.hpp>
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 
 using namespace sme;
 
+// the layout of SimulationData in version 0, where each pixel stored
+// concPadding extra values after the species
+struct PaddedSimulationData {
+  std::vector<double> timePoints;
+  std::vector<std::vector<std::vector<double>>> concentration;
+  std::vector<std::vector<std::vector<simulate::AvgMinMax>>> avgMinMax;
+  std::vector<std::vector<std::vector<double>>> concentrationMax;
+  std::vector<std::size_t> concPadding;
+  std::string xmlModel;
+  template <class Archive>
+  void serialize(Archive &ar, [[maybe_unused]] std::uint32_t const version) {
+    ar(timePoints, concentration, avgMinMax, concentrationMax, concPadding,
+       xmlModel);
+  }
+};
+CEREAL_CLASS_VERSION(PaddedSimulationData, 0);
+
+// 2 timepoints, compartment 0 has 2 species and 3 pixels, compartment 1 has
+// 1 species and 2 pixels, each pixel is followed by padding values of -1
+static PaddedSimulationData makePaddedSimulationData(std::size_t padding) {
+  PaddedSimulationData data;
+  data.xmlModel = "padded model";
+  const std::vector<std::size_t> nSpecies{2, 1};
+  const std::vector<std::size_t> nPixels{3, 2};
+  for (std::size_t it = 0; it < 2; ++it) {
+    data.timePoints.push_back(static_cast<double>(it));
+    auto &c{data.concentration.emplace_back()};
+    auto &avg{data.avgMinMax.emplace_back()};
+    auto &cMax{data.concentrationMax.emplace_back()};
+    for (std::size_t ic = 0; ic < 2; ++ic) {
+      auto &compConc{c.emplace_back()};
+      for (std::size_t ix = 0; ix < nPixels[ic]; ++ix) {
+        for (std::size_t is = 0; is < nSpecies[ic]; ++is) {
+          compConc.push_back(static_cast<double>(100 * it + 10 * ix + is));
+        }
+        for (std::size_t ip = 0; ip < padding; ++ip) {
+          compConc.push_back(-1.0);
+        }
+      }
+      avg.emplace_back(nSpecies[ic], simulate::AvgMinMax{1.0, 0.0, 2.0});
+      cMax.emplace_back(nSpecies[ic], 2.0);
+    }
+    data.concPadding.push_back(padding);
+  }
+  return data;
+}
+
+static simulate::SimulationData loadPaddedSimulationData(std::size_t padding) {
+  const auto padded{makePaddedSimulationData(padding)};
+  std::stringstream ss;
+  {
+    cereal::BinaryOutputArchive ar(ss);
+    ar(padded);
+  }
+  simulate::SimulationData data;
+  {
+    cereal::BinaryInputArchive ar(ss);
+    ar(data);
+  }
+  return data;
+}
+
 TEST_CASE("SimulateData",
           "[core/simulate/simulate][core/simulate_data][core][simulate_data]") {
   simulate::SimulationData data;
   data.timePoints = {0.0, 1.0};
-  data.concentration = {{{1.2, -0.881}, {1.0, -0.1}},
-                        {{2.2, -2.881}, {3.0, -3.1}}};
+  data.concentration.push_back({{1.2, -0.881}, {1.0, -0.1}});
+  data.concentration.push_back({{2.2, -2.881}, {3.0, -3.1}});
   data.avgMinMax.push_back(
       {{{1.0, 2.0, 3.0}, {0.0, 0.1, 0.2}}, {{1.0, 2.0, 3.0}, {0.0, 0.1, 0.2}}});
   data.avgMinMax.push_back({{{3.0, 4.0, 5.0}, {5.0, 5.1, 6.2}},
                             {{6.0, 12.0, 13.0}, {90.0, 90.1, 90.2}}});
   data.concentrationMax = {{{1.0, -0.1}, {1.2, -2.1}},
                            {{3.0, -3.1}, {4.2, -4.1}}};
-  data.concPadding = {0, 4};
   data.xmlModel = "sim model";
   REQUIRE(data.timePoints.size() == 2);
   REQUIRE(data.concentration.size() == 2);
   REQUIRE(data.avgMinMax.size() == 2);
   REQUIRE(data.concentrationMax.size() == 2);
-  REQUIRE(data.concPadding.size() == 2);
+  // a temporary frame returns copies, a named frame returns references
+  static_assert(
+      !std::is_reference_v<decltype(data.concentration[0][0])> &&
+      !std::is_reference_v<decltype(data.concentration[0].get())>);
+  const auto frame{data.concentration[1]};
+  static_assert(std::is_reference_v<decltype(frame[0])> &&
+                std::is_reference_v<decltype(frame.get())>);
+  const auto &c1{data.concentration[1][1]};
+  data.concentration.pop_back();
+  REQUIRE(c1 == std::vector<double>{3.0, -3.1});
+  REQUIRE(frame[1] == c1);
+  data.concentration.push_back(frame.get());
   SECTION("clear()") {
     data.clear();
     REQUIRE(data.timePoints.empty());
     REQUIRE(data.concentration.empty());
     REQUIRE(data.avgMinMax.empty());
     REQUIRE(data.concentrationMax.empty());
-    REQUIRE(data.concPadding.empty());
     REQUIRE(data.xmlModel.empty());
   }
   SECTION("pop_back()") {
@@ -45,8 +122,306 @@ TEST_CASE("SimulateData",
     REQUIRE(data.concentrationMax.size() == 1);
     REQUIRE(data.concentrationMax.back()[0][0] == dbl_approx(1.0));
     REQUIRE(data.concentrationMax.back()[0][1] == dbl_approx(-0.1));
-    REQUIRE(data.concPadding.size() == 1);
-    REQUIRE(data.concPadding.back() == 0);
     REQUIRE(data.xmlModel == "sim model");
   }
+  SECTION("disk backed concentrations") {
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    REQUIRE(data.concentration.isDiskBacked() == false);
+    // existing concentrations are moved to disk
+    data.concentration.setDiskBacked(dir.path().toStdString(), 2);
+    REQUIRE(data.concentration.isDiskBacked() == true);
+    REQUIRE(data.concentration.size() == 2);
+    REQUIRE(data.concentration[1][1][1] == dbl_approx(-3.1));
+    // more frames than the cache size
+    for (std::size_t i = 0; i < 5; ++i) {
+      auto x{static_cast<double>(i)};
+      data.concentration.push_back({{x, 2 * x, 3 * x}, {}, {-x}});
+    }
+    REQUIRE(data.concentration.size() == 7);
+    const auto first{data.concentration[0]};
+    REQUIRE(first.size() == 2);
+    REQUIRE(first[0][0] == dbl_approx(1.2));
+    REQUIRE(first[0][1] == dbl_approx(-0.881));
+    REQUIRE(first[1][0] == dbl_approx(1.0));
+    REQUIRE(first[1][1] == dbl_approx(-0.1));
+    for (std::size_t i = 0; i < 5; ++i) {
+      auto x{static_cast<double>(i)};
+      const auto frame{data.concentration[i + 2]};
+      REQUIRE(frame.size() == 3);
+      REQUIRE(frame[0].size() == 3);
+      REQUIRE(frame[0][2] == dbl_approx(3 * x));
+      REQUIRE(frame[1].empty());
+      REQUIRE(frame[2][0] == dbl_approx(-x));
+    }
+    // a frame remains valid after it is evicted from the cache
+    REQUIRE(data.concentration[3][0][1] == dbl_approx(2.0));
+    REQUIRE(first[0][0] == dbl_approx(1.2));
+    // a copy is independent of the original
+    auto copy{data.concentration};
+    data.concentration.pop_back();
+    data.concentration.push_back({{7.0}});
+    REQUIRE(copy.isDiskBacked() == true);
+    REQUIRE(copy.size() == 7);
+    REQUIRE(copy.back()[2][0] == dbl_approx(-4.0));
+    REQUIRE(data.concentration.size() == 7);
+    REQUIRE(data.concentration.back()[0][0] == dbl_approx(7.0));
+    copy.push_back({{8.0}});
+    REQUIRE(copy.back()[0][0] == dbl_approx(8.0));
+    REQUIRE(data.concentration.back()[0][0] == dbl_approx(7.0));
+    // pop_back then push_back
+    data.concentration.pop_back();
+    data.concentration.pop_back();
+    data.concentration.push_back({{9.0, 10.0}});
+    REQUIRE(data.concentration.size() == 6);
+    REQUIRE(data.concentration[4][0][0] == dbl_approx(2.0));
+    REQUIRE(data.concentration[5][0][1] == dbl_approx(10.0));
+    // clear keeps the disk backing
+    data.clear();
+    REQUIRE(data.concentration.empty());
+    REQUIRE(data.concentration.isDiskBacked() == true);
+    data.concentration.push_back({{1.0}});
+    REQUIRE(data.concentration[0][0][0] == dbl_approx(1.0));
+    // move concentrations back to memory
+    data.concentration.setDiskBacked("");
+    REQUIRE(data.concentration.isDiskBacked() == false);
+    REQUIRE(data.concentration.size() == 1);
+    REQUIRE(data.concentration[0][0][0] == dbl_approx(1.0));
+  }
+  SECTION("compressed concentrations") {
+    // smoothly varying concentrations
+    auto makeFrame{[](double t) {
+      std::vector<std::vector<double>> frame(2);
+      for (std::size_t i = 0; i < 1000; ++i) {
+        auto x{static_cast<double>(i)};
+        frame[0].push_back(std::exp(-0.01 * t * x));
+        frame[1].push_back(t * x);
+      }
+      return frame;
+    }};
+    data.clear();
+    for (std::size_t i = 0; i < 40; ++i) {
+      data.concentration.push_back(makeFrame(static_cast<double>(i)));
+    }
+    REQUIRE(data.concentration.getCompressionRatio() == dbl_approx(1.0));
+    SECTION("lossless") {
+      data.concentration.setCompression(
+          {simulate::FrameCompressionType::Lossless});
+      REQUIRE(data.concentration.getCompression().type ==
+              simulate::FrameCompressionType::Lossless);
+      REQUIRE(data.concentration.size() == 40);
+      REQUIRE(data.concentration.getCompressionRatio() > 1.0);
+      // random and sequential access give the exact values
+      for (std::size_t i : {37, 3, 20, 21, 22, 0, 39, 38, 15, 16, 17}) {
+        auto expected{makeFrame(static_cast<double>(i))};
+        REQUIRE(data.concentration[i].get() == expected);
+      }
+      data.concentration.pop_back();
+      data.concentration.push_back(makeFrame(-1.0));
+      REQUIRE(data.concentration.back().get() == makeFrame(-1.0));
+      auto copy{data.concentration};
+      data.concentration.clear();
+      REQUIRE(copy.size() == 40);
+      REQUIRE(copy[13].get() == makeFrame(13.0));
+      // stored form can be used to make an identical copy
+      simulate::ConcentrationFrames frames;
+      for (std::size_t i = 0; i < copy.size(); ++i) {
+        REQUIRE(frames.pushEncoded(copy.getEncoded(i)) == true);
+      }
+      REQUIRE(frames.size() == 40);
+      REQUIRE(frames.getCompressionRatio() ==
+              dbl_approx(copy.getCompressionRatio()));
+      REQUIRE(frames[25].get() == makeFrame(25.0));
+      REQUIRE(frames[39].get() == makeFrame(-1.0));
+      // invalid encoded frames are rejected
+      auto invalid{copy.getEncoded(5)};
+      invalid.keyframeOffset = 50;
+      REQUIRE(frames.pushEncoded(invalid) == false);
+      invalid.keyframeOffset = 0;
+      invalid.type = 99;
+      REQUIRE(frames.pushEncoded(invalid) == false);
+    }
+    SECTION("bounded error") {
+      data.concentration.setCompression(
+          {simulate::FrameCompressionType::BoundedError, 1e-6});
+      REQUIRE(data.concentration.getCompressionRatio() > 4.0);
+      for (std::size_t i : {37, 3, 20, 21, 22, 0, 39}) {
+        auto expected{makeFrame(static_cast<double>(i))};
+        const auto frame{data.concentration[i]};
+        for (std::size_t ic = 0; ic < expected.size(); ++ic) {
+          REQUIRE(frame[ic].size() == expected[ic].size());
+          for (std::size_t ix = 0; ix < expected[ic].size(); ++ix) {
+            REQUIRE(std::abs(frame[ic][ix] - expected[ic][ix]) <= 1e-6);
+          }
+        }
+      }
+      // values that can't be quantized are stored losslessly
+      data.concentration.push_back({{1e300, -2.0}});
+      REQUIRE(data.concentration.back()[0][0] == dbl_approx(1e300));
+      // combined with disk backing
+      QTemporaryDir dir;
+      data.concentration.setDiskBacked(dir.path().toStdString(), 2);
+      REQUIRE(data.concentration.isDiskBacked() == true);
+      REQUIRE(data.concentration.getCompression().type ==
+              simulate::FrameCompressionType::BoundedError);
+      REQUIRE(std::abs(data.concentration[30][1][999] - 30 * 999) <= 1e-6);
+      REQUIRE(data.concentration[40][0][1] == dbl_approx(-2.0));
+      // back to uncompressed
+      data.concentration.setCompression({});
+      REQUIRE(data.concentration.getCompressionRatio() == dbl_approx(1.0));
+      REQUIRE(std::abs(data.concentration[30][1][999] - 30 * 999) <= 1e-6);
+    }
+  }
+}
+
+TEST_CASE("SimulateData: remove padding from version 0 data",
+          "[core/simulate/simulate][core/simulate_data][core][simulate_data]") {
+  for (std::size_t padding : {0, 3}) {
+    CAPTURE(padding);
+    auto data{loadPaddedSimulationData(padding)};
+    REQUIRE(data.xmlModel == "padded model");
+    REQUIRE(data.size() == 2);
+    REQUIRE(data.concentration.size() == 2);
+    for (std::size_t it = 0; it < 2; ++it) {
+      const double t{100.0 * static_cast<double>(it)};
+      const auto c{data.concentration[it].get()};
+      // only the species concentrations remain
+      REQUIRE(c.size() == 2);
+      REQUIRE(c[0] == std::vector<double>{t, t + 1, t + 10, t + 11, t + 20,
+                                          t + 21});
+      REQUIRE(c[1] == std::vector<double>{t, t + 10});
+    }
+    // saved and loaded with the current version
+    std::stringstream ss;
+    {
+      cereal::BinaryOutputArchive ar(ss);
+      ar(data);
+    }
+    simulate::SimulationData roundtrip;
+    {
+      cereal::BinaryInputArchive ar(ss);
+      ar(roundtrip);
+    }
+    REQUIRE(roundtrip.size() == 2);
+    REQUIRE(roundtrip.timePoints[1] == dbl_approx(1.0));
+    REQUIRE(roundtrip.concentration[1].get() == data.concentration[1].get());
+    REQUIRE(roundtrip.avgMinMax[1][0].size() == 2);
+    REQUIRE(roundtrip.xmlModel == "padded model");
+  }
+}
+
+TEST_CASE("AppendOnlyVector",
+          "[core/simulate/simulate][core/simulate_data][core][simulate_data]") {
+  simulate::AppendOnlyVector<std::vector<double>> v;
+  REQUIRE(v.empty());
+  // elements span several segments
+  for (std::size_t i = 0; i < 1000; ++i) {
+    v.push_back({static_cast<double>(i), 1.0});
+  }
+  REQUIRE(v.size() == 1000);
+  REQUIRE(v[0][0] == dbl_approx(0.0));
+  REQUIRE(v[31][0] == dbl_approx(31.0));
+  REQUIRE(v[32][0] == dbl_approx(32.0));
+  REQUIRE(v.back()[0] == dbl_approx(999.0));
+  // elements are never moved
+  const auto *first{&v[0]};
+  const auto *last{&v[999]};
+  v.reserve(100000);
+  v.push_back({1000.0});
+  REQUIRE(&v[0] == first);
+  REQUIRE(&v[999] == last);
+  v.pop_back();
+  REQUIRE(v.size() == 1000);
+  auto copy{v};
+  REQUIRE(copy.size() == 1000);
+  REQUIRE(copy[500][0] == dbl_approx(500.0));
+  auto moved{std::move(copy)};
+  REQUIRE(moved.size() == 1000);
+  REQUIRE(moved[999][0] == dbl_approx(999.0));
+  v.clear();
+  REQUIRE(v.empty());
+  v = {{1.0}, {2.0}};
+  REQUIRE(v.size() == 2);
+  REQUIRE(v[1][0] == dbl_approx(2.0));
+  SECTION("concurrent reader") {
+    simulate::SimulationData data;
+    constexpr std::size_t n{2000};
+    std::thread writer([&data]() {
+      for (std::size_t i = 0; i < n; ++i) {
+        auto t{static_cast<double>(i)};
+        data.concentration.push_back({{t, t}});
+        data.avgMinMax.push_back({{{t, t, t}}});
+        data.concentrationMax.push_back({{t}});
+        data.timePoints.push_back(t);
+      }
+    });
+    bool valid{true};
+    std::size_t nRead{0};
+    while (nRead < n) {
+      nRead = data.timePoints.size();
+      if (nRead > 0) {
+        const auto i{nRead - 1};
+        const auto frame{data.concentration[i]};
+        valid = valid && data.timePoints[i] == static_cast<double>(i) &&
+                frame[0][1] == static_cast<double>(i) &&
+                data.avgMinMax[i][0][0].max == static_cast<double>(i);
+      }
+    }
+    writer.join();
+    REQUIRE(valid);
+  }
+}
+
+TEST_CASE("TimeTraceIndex",
+          "[core/simulate/simulate][core/simulate_data][core][simulate_data]") {
+  auto frame = [](std::size_t t) {
+    std::vector<double> c(200);
+    for (std::size_t i = 0; i < 200; ++i) {
+      c[i] = static_cast<double>(1000 * t + i);
+    }
+    return c;
+  };
+  for (bool compress : {false, true}) {
+    // 2 species in 100 pixels
+    simulate::TimeTraceIndex index(2, 100, compress);
+    REQUIRE(index.size() == 0);
+    for (std::size_t t = 0; t < 150; ++t) {
+      index.push_back(frame(t));
+    }
+    REQUIRE(index.size() == 150);
+    auto s{index.getTimeSeries(1, 70)};
+    REQUIRE(s.size() == 150);
+    REQUIRE(s[0] == dbl_approx(141.0));
+    REQUIRE(s[64] == dbl_approx(64141.0));
+    REQUIRE(s[149] == dbl_approx(149141.0));
+    // frames with the wrong number of concentrations are ignored
+    index.replaceBack(std::vector<double>(3, -1.0));
+    s = index.getTimeSeries(1, 70);
+    REQUIRE(s[149] == dbl_approx(149141.0));
+    index.pop_back();
+    REQUIRE(index.size() == 149);
+    index.replaceBack(frame(0));
+    s = index.getTimeSeries(0, 0);
+    REQUIRE(s.size() == 149);
+    REQUIRE(s[147] == dbl_approx(147000.0));
+    REQUIRE(s[148] == dbl_approx(0.0));
+    index.push_back(frame(7));
+    s = index.getTimeSeries(0, 99);
+    REQUIRE(s.size() == 150);
+    REQUIRE(s[149] == dbl_approx(7198.0));
+    // remove timepoints from tiles that were completed
+    while (index.size() > 100) {
+      index.pop_back();
+    }
+    index.replaceBack(frame(3));
+    index.push_back(frame(5));
+    s = index.getTimeSeries(1, 99);
+    REQUIRE(s.size() == 101);
+    REQUIRE(s[0] == dbl_approx(199.0));
+    REQUIRE(s[63] == dbl_approx(63199.0));
+    REQUIRE(s[64] == dbl_approx(64199.0));
+    REQUIRE(s[98] == dbl_approx(98199.0));
+    REQUIRE(s[99] == dbl_approx(3199.0));
+    REQUIRE(s[100] == dbl_approx(5199.0));
+  }
 }
@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <cmath>
 #include <future>
+#include <numeric>
 
 using namespace sme;
 using namespace sme::test;
@@ -958,6 +959,735 @@ TEST_CASE("Pixel simulator: brusselator model, RK2, RK3, RK4",
   }
 }
 
+TEST_CASE("Pixel simulator: PI step controller and timestep statistics",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  double eps{1e-20};
+  double time{30.0};
+  double maxAllowedRelErr{0.01};
+  auto s{getExampleModel(Mod::Brusselator)};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  // do accurate simulation
+  options.pixel.maxErr = {std::numeric_limits<double>::max(), 1e-6};
+  options.pixel.integrator = simulate::PixelIntegratorType::RK435;
+  simulate::Simulation sim(s);
+  sim.doTimesteps(time);
+  auto c4_accurate = sim.getConc(sim.getTimePoints().size() - 1, 0, 0);
+  options.pixel.maxErr = {std::numeric_limits<double>::max(),
+                          maxAllowedRelErr};
+  for (auto [integrator, nStages] :
+       {std::pair{simulate::PixelIntegratorType::RK212, std::size_t{2}},
+        std::pair{simulate::PixelIntegratorType::RK323, std::size_t{3}},
+        std::pair{simulate::PixelIntegratorType::RK435, std::size_t{5}}}) {
+    for (auto stepController : {simulate::PixelStepController::I,
+                                simulate::PixelStepController::PI}) {
+      options.pixel.integrator = integrator;
+      options.pixel.stepController = stepController;
+      s.getSimulationData().clear();
+      simulate::Simulation sim2(s);
+      auto steps{sim2.doTimesteps(time)};
+      REQUIRE(sim2.errorMessage().empty());
+      CAPTURE(integrator);
+      CAPTURE(stepController);
+      auto conc = sim2.getConc(sim2.getTimePoints().size() - 1, 0, 0);
+      double maxRelDiff{0};
+      for (std::size_t i = 0; i < conc.size(); ++i) {
+        maxRelDiff = std::max(maxRelDiff, (conc[i] - c4_accurate[i]) /
+                                              (c4_accurate[i] + eps));
+      }
+      REQUIRE(maxRelDiff < maxAllowedRelErr);
+      const auto &stats{sim2.getTimestepStatistics()};
+      REQUIRE(stats.acceptedSteps == steps);
+      REQUIRE(stats.wastedEvaluations == nStages * stats.rejectedSteps);
+      REQUIRE(stats.minTimestep > 0.0);
+      REQUIRE(stats.minTimestep <= stats.maxTimestep);
+      REQUIRE(stats.maxTimestep <= time);
+      REQUIRE(stats.errorEstimateSeconds > 0.0);
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: species-major storage layout",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  // results should be independent of the internal concentration layout
+  for (const auto &filename :
+       {QString("txy"), QString("non-spatial-multi-compartment"),
+        QString("membrane-reaction-circle")}) {
+    auto s{getTestModel(filename)};
+    auto &options{s.getSimulationSettings().options};
+    s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+    options.pixel.storageLayout = simulate::PixelStorageLayout::PixelMajor;
+    simulate::Simulation simPixelMajor(s);
+    simPixelMajor.doTimesteps(0.01, 3);
+    REQUIRE(simPixelMajor.errorMessage().empty());
+    s.getSimulationData().clear();
+    options.pixel.storageLayout = simulate::PixelStorageLayout::SpeciesMajor;
+    simulate::Simulation simSpeciesMajor(s);
+    simSpeciesMajor.doTimesteps(0.01, 3);
+    REQUIRE(simSpeciesMajor.errorMessage().empty());
+    REQUIRE(simSpeciesMajor.getTimePoints().size() ==
+            simPixelMajor.getTimePoints().size());
+    CAPTURE(filename.toStdString());
+    for (std::size_t ic = 0; ic < simPixelMajor.getCompartmentIds().size();
+         ++ic) {
+      for (std::size_t is = 0; is < simPixelMajor.getSpeciesIds(ic).size();
+           ++is) {
+        for (std::size_t it = 0; it < simPixelMajor.getTimePoints().size();
+             ++it) {
+          REQUIRE(simSpeciesMajor.getConc(it, ic, is) ==
+                  simPixelMajor.getConc(it, ic, is));
+        }
+        REQUIRE(simSpeciesMajor.getDcdt(ic, is) ==
+                simPixelMajor.getDcdt(ic, is));
+      }
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: fused RK stages",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  // fused RK stages should give identical results to the default RK stages
+  // (membrane model falls back to the default RK stages)
+  for (const auto &filename :
+       {QString("txy"), QString("small-single-compartment-diffusion"),
+        QString("membrane-reaction-circle")}) {
+    for (auto integrator :
+         {simulate::PixelIntegratorType::RK212,
+          simulate::PixelIntegratorType::RK323,
+          simulate::PixelIntegratorType::RK435}) {
+      for (bool multithreaded : {false, true}) {
+        auto s{getTestModel(filename)};
+        auto &options{s.getSimulationSettings().options};
+        s.getSimulationSettings().simulatorType =
+            simulate::SimulatorType::Pixel;
+        options.pixel.integrator = integrator;
+        options.pixel.enableMultiThreading = multithreaded;
+        options.pixel.fuseRKStages = false;
+        simulate::Simulation sim(s);
+        sim.doTimesteps(0.01, 3);
+        REQUIRE(sim.errorMessage().empty());
+        s.getSimulationData().clear();
+        options.pixel.fuseRKStages = true;
+        simulate::Simulation simFused(s);
+        simFused.doTimesteps(0.01, 3);
+        REQUIRE(simFused.errorMessage().empty());
+        REQUIRE(simFused.getTimePoints().size() == sim.getTimePoints().size());
+        CAPTURE(filename.toStdString());
+        CAPTURE(integrator);
+        CAPTURE(multithreaded);
+        for (std::size_t ic = 0; ic < sim.getCompartmentIds().size(); ++ic) {
+          for (std::size_t is = 0; is < sim.getSpeciesIds(ic).size(); ++is) {
+            for (std::size_t it = 0; it < sim.getTimePoints().size(); ++it) {
+              REQUIRE(simFused.getConc(it, ic, is) == sim.getConc(it, ic, is));
+            }
+            REQUIRE(simFused.getDcdt(ic, is) == sim.getDcdt(ic, is));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: Morton pixel ordering",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  // results should be independent of the internal pixel ordering, up to
+  // rounding differences from summing over pixels in a different order
+  for (const auto &filename :
+       {QString("txy"), QString("non-spatial-multi-compartment"),
+        QString("membrane-reaction-circle")}) {
+    auto s{getTestModel(filename)};
+    auto &options{s.getSimulationSettings().options};
+    s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+    options.pixel.pixelOrdering = simulate::PixelOrdering::Column;
+    simulate::Simulation simColumn(s);
+    simColumn.doTimesteps(0.01, 3);
+    REQUIRE(simColumn.errorMessage().empty());
+    s.getSimulationData().clear();
+    options.pixel.pixelOrdering = simulate::PixelOrdering::Morton;
+    simulate::Simulation simMorton(s);
+    simMorton.doTimesteps(0.01, 3);
+    REQUIRE(simMorton.errorMessage().empty());
+    REQUIRE(simMorton.getTimePoints().size() ==
+            simColumn.getTimePoints().size());
+    CAPTURE(filename.toStdString());
+    for (std::size_t ic = 0; ic < simColumn.getCompartmentIds().size(); ++ic) {
+      for (std::size_t is = 0; is < simColumn.getSpeciesIds(ic).size(); ++is) {
+        for (std::size_t it = 0; it < simColumn.getTimePoints().size(); ++it) {
+          auto cColumn{simColumn.getConc(it, ic, is)};
+          auto cMorton{simMorton.getConc(it, ic, is)};
+          REQUIRE(cMorton.size() == cColumn.size());
+          for (std::size_t ix = 0; ix < cColumn.size(); ++ix) {
+            REQUIRE(cMorton[ix] == dbl_approx(cColumn[ix]));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: multithreaded membrane reactions",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  // membrane reactions are evaluated in the same order in both cases, so
+  // multithreaded results should be identical to single threaded results
+  for (const auto &filename : {QString("membrane-reaction-circle"),
+                               QString("membrane-reaction-pixels"),
+                               QString("very-simple-model-non-spatial")}) {
+    auto s{getTestModel(filename)};
+    auto &options{s.getSimulationSettings().options};
+    s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+    options.pixel.enableMultiThreading = false;
+    simulate::Simulation sim(s);
+    sim.doTimesteps(0.01, 3);
+    REQUIRE(sim.errorMessage().empty());
+    s.getSimulationData().clear();
+    options.pixel.enableMultiThreading = true;
+    options.pixel.maxThreads = 4;
+    simulate::Simulation simMulti(s);
+    simMulti.doTimesteps(0.01, 3);
+    REQUIRE(simMulti.errorMessage().empty());
+    REQUIRE(simMulti.getTimePoints().size() == sim.getTimePoints().size());
+    CAPTURE(filename.toStdString());
+    for (std::size_t ic = 0; ic < sim.getCompartmentIds().size(); ++ic) {
+      for (std::size_t is = 0; is < sim.getSpeciesIds(ic).size(); ++is) {
+        for (std::size_t it = 0; it < sim.getTimePoints().size(); ++it) {
+          REQUIRE(simMulti.getConc(it, ic, is) == sim.getConc(it, ic, is));
+        }
+        REQUIRE(simMulti.getDcdt(ic, is) == sim.getDcdt(ic, is));
+      }
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: non-spatial species",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  // non-spatial species are stored as a single value for each compartment,
+  // so should have the same concentration in every pixel
+  auto s{getTestModel("non-spatial-multi-compartment")};
+  s.getSpecies().setIsSpatial("B", true);
+  s.getSpecies().setDiffusionConstant("B", 0.5);
+  s.getSpecies().setIsSpatial("C", false);
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  for (auto layout : {simulate::PixelStorageLayout::PixelMajor,
+                      simulate::PixelStorageLayout::SpeciesMajor}) {
+    s.getSimulationData().clear();
+    s.getSimulationSettings().options.pixel.storageLayout = layout;
+    simulate::Simulation sim(s);
+    sim.doTimesteps(0.01, 3);
+    REQUIRE(sim.errorMessage().empty());
+    std::size_t nNonSpatial{0};
+    for (std::size_t ic = 0; ic < sim.getCompartmentIds().size(); ++ic) {
+      const auto &speciesIds{sim.getSpeciesIds(ic)};
+      for (std::size_t is = 0; is < speciesIds.size(); ++is) {
+        if (s.getSpecies().getIsSpatial(speciesIds[is].c_str())) {
+          continue;
+        }
+        ++nNonSpatial;
+        CAPTURE(speciesIds[is]);
+        for (std::size_t it = 0; it < sim.getTimePoints().size(); ++it) {
+          auto c{sim.getConc(it, ic, is)};
+          REQUIRE(std::all_of(c.cbegin(), c.cend(),
+                              [c0 = c.front()](double v) { return v == c0; }));
+        }
+        auto dcdt{sim.getDcdt(ic, is)};
+        REQUIRE(std::all_of(
+            dcdt.cbegin(), dcdt.cend(),
+            [d0 = dcdt.front()](double v) { return v == d0; }));
+      }
+    }
+    REQUIRE(nNonSpatial > 0);
+  }
+}
+
+TEST_CASE("Pixel simulator: IMEX and RKC integrators",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  // see docs/tests/diffusion.rst for analytic expressions used here
+  constexpr double pi = 3.14159265358979323846;
+  double sigma2 = 36.0;
+  double analytic_total = sigma2 * pi;
+  auto s{getExampleModel(Mod::SingleCompartmentDiffusion)};
+  std::vector<double> D{s.getSpecies().getDiffusionConstant("slow"),
+                        s.getSpecies().getDiffusionConstant("fast")};
+  const auto *comp{s.getSpecies().getField("slow")->getCompartment()};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  // timestep larger than the forwards Euler stability limit of 1/(4D)
+  options.pixel.maxTimestep = 0.25;
+  REQUIRE(options.pixel.maxTimestep > 1.0 / (4.0 * D[1]));
+  for (auto [integrator, multithreaded] :
+       {std::pair{simulate::PixelIntegratorType::IMEX, false},
+        std::pair{simulate::PixelIntegratorType::IMEX, true},
+        std::pair{simulate::PixelIntegratorType::RKC, false},
+        std::pair{simulate::PixelIntegratorType::RKC, true}}) {
+    options.pixel.integrator = integrator;
+    options.pixel.enableMultiThreading = multithreaded;
+    s.getSimulationData().clear();
+    simulate::Simulation sim(s);
+    sim.doTimesteps(20.0);
+    REQUIRE(sim.errorMessage().empty());
+    double t{sim.getTimePoints().back()};
+    for (auto speciesIndex : {std::size_t{0}, std::size_t{1}}) {
+      auto conc{sim.getConc(1, 0, speciesIndex)};
+      // total concentration is conserved
+      double relErr{std::abs(common::sum(conc) - analytic_total) /
+                    analytic_total};
+      CAPTURE(integrator);
+      CAPTURE(multithreaded);
+      CAPTURE(speciesIndex);
+      REQUIRE(relErr < 1e-9);
+      // distribution matches analytic one away from the boundary
+      double t0{sigma2 / 4.0 / D[speciesIndex]};
+      double maxRelErr{0};
+      double avgRelErr{0};
+      std::size_t count{0};
+      for (std::size_t i = 0; i < comp->nPixels(); ++i) {
+        const auto &p{comp->getPixel(i)};
+        if (r2(p) < 16 * 16) {
+          double c_analytic{analytic(p, t, D[speciesIndex], t0)};
+          double pixelRelErr{std::abs(conc[i] - c_analytic) / c_analytic};
+          avgRelErr += pixelRelErr;
+          ++count;
+          maxRelErr = std::max(maxRelErr, pixelRelErr);
+        }
+      }
+      avgRelErr /= static_cast<double>(count);
+      REQUIRE(maxRelErr < 0.05);
+      REQUIRE(avgRelErr < 0.01);
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: IMEX, Rosenbrock and RKC adaptive timestep",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  double eps{1e-20};
+  double time{1.0};
+  auto s{getExampleModel(Mod::Brusselator)};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  // do accurate simulation
+  options.pixel.integrator = simulate::PixelIntegratorType::RK435;
+  options.pixel.maxErr = {std::numeric_limits<double>::max(), 1e-6};
+  simulate::Simulation sim(s);
+  sim.doTimesteps(time);
+  auto c4_accurate = sim.getConc(sim.getTimePoints().size() - 1, 0, 0);
+  // no maximum timestep: the timestep is set by the error estimate
+  REQUIRE(options.pixel.maxTimestep == std::numeric_limits<double>::max());
+  for (auto integrator : {simulate::PixelIntegratorType::IMEX,
+                          simulate::PixelIntegratorType::Rosenbrock,
+                          simulate::PixelIntegratorType::RKC}) {
+    CAPTURE(integrator);
+    options.pixel.integrator = integrator;
+    std::vector<double> maxRelDiffs;
+    for (double maxRelErr : {1e-2, 1e-4}) {
+      CAPTURE(maxRelErr);
+      options.pixel.maxErr = {std::numeric_limits<double>::max(), maxRelErr};
+      s.getSimulationData().clear();
+      simulate::Simulation simAdaptive(s);
+      simAdaptive.doTimesteps(time);
+      REQUIRE(simAdaptive.errorMessage().empty());
+      REQUIRE(simAdaptive.getTimestepStatistics().acceptedSteps > 1);
+      REQUIRE(simAdaptive.getTimestepStatistics().maxTimestep < time);
+      auto c{simAdaptive.getConc(simAdaptive.getTimePoints().size() - 1, 0,
+                                 0)};
+      double maxRelDiff{0};
+      for (std::size_t i = 0; i < c.size(); ++i) {
+        maxRelDiff = std::max(maxRelDiff, std::abs(c[i] - c4_accurate[i]) /
+                                              (c4_accurate[i] + eps));
+      }
+      maxRelDiffs.push_back(maxRelDiff);
+    }
+    // smaller allowed error gives a more accurate solution
+    REQUIRE(maxRelDiffs[1] < maxRelDiffs[0]);
+    REQUIRE(maxRelDiffs[1] < 0.02);
+  }
+}
+
+TEST_CASE("Pixel simulator: Rosenbrock integrator",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  double eps{1e-20};
+  double time{1.0};
+  double maxAllowedRelErr{0.01};
+  auto s{getExampleModel(Mod::Brusselator)};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  // do accurate simulation
+  options.pixel.integrator = simulate::PixelIntegratorType::RK435;
+  options.pixel.maxErr = {std::numeric_limits<double>::max(), 1e-6};
+  simulate::Simulation sim(s);
+  sim.doTimesteps(time);
+  auto c4_accurate = sim.getConc(sim.getTimePoints().size() - 1, 0, 0);
+  // linearly implicit reactions, implicit diffusion
+  options.pixel.integrator = simulate::PixelIntegratorType::Rosenbrock;
+  options.pixel.maxTimestep = 1e-3;
+  std::vector<std::vector<double>> concs;
+  for (bool multithreaded : {false, true}) {
+    options.pixel.enableMultiThreading = multithreaded;
+    s.getSimulationData().clear();
+    simulate::Simulation simRos(s);
+    simRos.doTimesteps(time);
+    REQUIRE(simRos.errorMessage().empty());
+    concs.push_back(simRos.getConc(simRos.getTimePoints().size() - 1, 0, 0));
+  }
+  double maxRelDiff{0};
+  for (std::size_t i = 0; i < concs[0].size(); ++i) {
+    maxRelDiff = std::max(maxRelDiff, std::abs(concs[0][i] - c4_accurate[i]) /
+                                          (c4_accurate[i] + eps));
+  }
+  REQUIRE(maxRelDiff < maxAllowedRelErr);
+  // each pixel is independent: multithreading gives identical results
+  REQUIRE(concs[1] == concs[0]);
+}
+
+TEST_CASE("Pixel simulator: multirate compartments",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  double eps{1e-20};
+  double time{0.5};
+  double maxAllowedRelErr{0.05};
+  auto s{getExampleModel(Mod::VerySimpleModel)};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  for (auto integrator : {simulate::PixelIntegratorType::RK101,
+                          simulate::PixelIntegratorType::RK212}) {
+    CAPTURE(integrator);
+    options.pixel.integrator = integrator;
+    options.pixel.maxErr = {std::numeric_limits<double>::max(), 1e-3};
+    options.pixel.maxTimestep = 0.05;
+    options.pixel.multirate = false;
+    options.pixel.enableMultiThreading = false;
+    s.getSimulationData().clear();
+    simulate::Simulation sim(s);
+    sim.doTimesteps(time);
+    REQUIRE(sim.errorMessage().empty());
+    std::vector<std::vector<std::vector<double>>> concs;
+    for (bool multithreaded : {false, true}) {
+      options.pixel.multirate = true;
+      options.pixel.enableMultiThreading = multithreaded;
+      s.getSimulationData().clear();
+      simulate::Simulation simMR(s);
+      simMR.doTimesteps(time);
+      REQUIRE(simMR.errorMessage().empty());
+      REQUIRE(simMR.getTimestepStatistics().acceptedSteps > 0);
+      auto &c{concs.emplace_back()};
+      for (std::size_t ic = 0; ic < sim.getCompartmentIds().size(); ++ic) {
+        for (std::size_t is = 0; is < sim.getSpeciesIds(ic).size(); ++is) {
+          c.push_back(simMR.getConc(1, ic, is));
+          const auto &cRef{sim.getConc(1, ic, is)};
+          double maxRelDiff{0};
+          for (std::size_t i = 0; i < cRef.size(); ++i) {
+            maxRelDiff =
+                std::max(maxRelDiff, std::abs(c.back()[i] - cRef[i]) /
+                                         (std::abs(cRef[i]) + 1e-3 + eps));
+          }
+          CAPTURE(ic);
+          CAPTURE(is);
+          REQUIRE(maxRelDiff < maxAllowedRelErr);
+        }
+      }
+    }
+    REQUIRE(concs[1] == concs[0]);
+  }
+}
+
+TEST_CASE("Pixel simulator: multirate membrane flux coupling",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  double eps{1e-20};
+  double time{0.5};
+  // membrane reactions depend on the concentrations on both sides
+  auto s{getExampleModel(Mod::VerySimpleModel)};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  // accurate single rate solution
+  options.pixel.integrator = simulate::PixelIntegratorType::RK435;
+  options.pixel.maxErr = {std::numeric_limits<double>::max(), 1e-8};
+  simulate::Simulation sim(s);
+  sim.doTimesteps(time);
+  REQUIRE(sim.errorMessage().empty());
+  for (auto integrator : {simulate::PixelIntegratorType::RK212,
+                          simulate::PixelIntegratorType::RK323}) {
+    CAPTURE(integrator);
+    options.pixel.integrator = integrator;
+    options.pixel.multirate = true;
+    // no maximum timestep: the synchronisation step is only limited by the
+    // compartment timesteps and the membrane flux coupling error
+    options.pixel.maxTimestep = std::numeric_limits<double>::max();
+    std::vector<double> maxRelDiffs;
+    for (double maxRelErr : {1e-2, 1e-4}) {
+      CAPTURE(maxRelErr);
+      options.pixel.maxErr = {std::numeric_limits<double>::max(), maxRelErr};
+      s.getSimulationData().clear();
+      simulate::Simulation simMR(s);
+      simMR.doTimesteps(time);
+      REQUIRE(simMR.errorMessage().empty());
+      double maxRelDiff{0};
+      for (std::size_t ic = 0; ic < sim.getCompartmentIds().size(); ++ic) {
+        for (std::size_t is = 0; is < sim.getSpeciesIds(ic).size(); ++is) {
+          const auto &c{simMR.getConc(1, ic, is)};
+          const auto &cRef{sim.getConc(1, ic, is)};
+          REQUIRE(c.size() == cRef.size());
+          for (std::size_t i = 0; i < cRef.size(); ++i) {
+            maxRelDiff = std::max(maxRelDiff, std::abs(c[i] - cRef[i]) /
+                                                  (std::abs(cRef[i]) + 1e-3 +
+                                                   eps));
+          }
+        }
+      }
+      maxRelDiffs.push_back(maxRelDiff);
+    }
+    // multirate converges to the single rate solution as maxErr is reduced
+    REQUIRE(maxRelDiffs[1] < maxRelDiffs[0]);
+    REQUIRE(maxRelDiffs[1] < 0.01);
+  }
+}
+
+TEST_CASE("Pixel simulator: active tiles",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  auto s{getExampleModel(Mod::Brusselator)};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  options.pixel.integrator = simulate::PixelIntegratorType::RK101;
+  options.pixel.maxTimestep = 1e-3;
+  simulate::Simulation sim(s);
+  sim.doTimesteps(0.01, 2);
+  REQUIRE(sim.errorMessage().empty());
+  for (auto layout : {simulate::PixelStorageLayout::PixelMajor,
+                      simulate::PixelStorageLayout::SpeciesMajor}) {
+    CAPTURE(layout);
+    options.pixel.storageLayout = layout;
+    // tiny tolerance: all tiles remain active
+    options.pixel.activeTileTolerance = 1e-14;
+    std::vector<std::vector<double>> concs;
+    for (bool multithreaded : {false, true}) {
+      options.pixel.enableMultiThreading = multithreaded;
+      s.getSimulationData().clear();
+      simulate::Simulation simActive(s);
+      simActive.doTimesteps(0.01, 2);
+      REQUIRE(simActive.errorMessage().empty());
+      concs.push_back(simActive.getConc(2, 0, 0));
+      const auto &c{sim.getConc(2, 0, 0)};
+      for (std::size_t i = 0; i < c.size(); ++i) {
+        REQUIRE(concs.back()[i] == dbl_approx(c[i]));
+      }
+    }
+    REQUIRE(concs[1] == concs[0]);
+    // huge tolerance: all tiles are inactive after the first evaluation, so
+    // concentrations don't change after the first timestep
+    options.pixel.activeTileTolerance = 1e100;
+    options.pixel.enableMultiThreading = false;
+    s.getSimulationData().clear();
+    simulate::Simulation simFrozen(s);
+    simFrozen.doTimesteps(0.01, 2);
+    REQUIRE(simFrozen.errorMessage().empty());
+    REQUIRE(simFrozen.getConc(1, 0, 0) != simFrozen.getConc(0, 0, 0));
+    REQUIRE(simFrozen.getConc(2, 0, 0) == simFrozen.getConc(1, 0, 0));
+    // the steady state check evaluates dcdt in all tiles, including the
+    // inactive ones
+    REQUIRE(simFrozen.getMaxAbsDcdt() > 0.0);
+    options.pixel.activeTileTolerance = 0.0;
+  }
+}
+
+TEST_CASE("Pixel simulator: quadtree cells",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  auto s{getTestModel("small-single-compartment-diffusion")};
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  options.pixel.integrator = simulate::PixelIntegratorType::RK101;
+  simulate::Simulation sim(s);
+  sim.doTimesteps(5.0, 4);
+  REQUIRE(sim.errorMessage().empty());
+  options.pixel.quadtreeMaxLevel = 3;
+  options.pixel.quadtreeTolerance = 1e-3;
+  std::vector<std::vector<double>> concs;
+  for (bool multithreaded : {false, true}) {
+    options.pixel.enableMultiThreading = multithreaded;
+    s.getSimulationData().clear();
+    simulate::Simulation simQuadtree(s);
+    simQuadtree.doTimesteps(5.0, 4);
+    REQUIRE(simQuadtree.errorMessage().empty());
+    for (std::size_t is = 0; is < 2; ++is) {
+      CAPTURE(is);
+      // diffusion fluxes between cells conserve the total amount of species
+      auto sum{[](const std::vector<double> &c) {
+        return std::accumulate(c.cbegin(), c.cend(), 0.0);
+      }};
+      const double initialAmount{sum(simQuadtree.getConc(0, 0, is))};
+      for (std::size_t it = 1; it < 5; ++it) {
+        CAPTURE(it);
+        const auto &c{simQuadtree.getConc(it, 0, is)};
+        REQUIRE(sum(c) == Catch::Approx(initialAmount).epsilon(1e-10));
+        const auto &cRef{sim.getConc(it, 0, is)};
+        double maxDiff{0};
+        for (std::size_t i = 0; i < c.size(); ++i) {
+          maxDiff = std::max(maxDiff, std::abs(c[i] - cRef[i]));
+        }
+        REQUIRE(maxDiff <
+                0.05 * *std::max_element(cRef.cbegin(), cRef.cend()));
+      }
+    }
+    concs.push_back(simQuadtree.getConc(4, 0, 0));
+  }
+  REQUIRE(concs[1] == concs[0]);
+}
+
+TEST_CASE("Pixel simulator: spectral diffusion",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  auto s{getTestModel("small-single-compartment-diffusion")};
+  // replace circular geometry with a compartment that fills the image
+  QImage img(24, 16, QImage::Format_RGB32);
+  QRgb col{QColor(12, 243, 154).rgba()};
+  img.fill(col);
+  s.getGeometry().importGeometryFromImage(img, false);
+  s.getGeometry().setPixelWidth(1.0);
+  s.getCompartments().setColour("circle", col);
+  s.getSpecies().setAnalyticConcentration("slow", "cos(x/3) + 2");
+  s.getSpecies().setAnalyticConcentration("fast", "cos(x/5) + cos(y/2) + 3");
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  // accurate explicit solution
+  options.pixel.integrator = simulate::PixelIntegratorType::RK435;
+  options.pixel.maxErr = {std::numeric_limits<double>::max(), 1e-9};
+  std::vector<std::vector<double>> cRef;
+  {
+    simulate::Simulation sim(s);
+    sim.doTimesteps(2.0);
+    REQUIRE(sim.errorMessage().empty());
+    cRef = {sim.getConc(1, 0, 0), sim.getConc(1, 0, 1)};
+  }
+  // pure diffusion in a rectangle is solved exactly by the spectral
+  // propagator, even with a timestep much larger than the explicit stability
+  // limit
+  options.pixel.integrator = simulate::PixelIntegratorType::IMEX;
+  options.pixel.maxTimestep = 1.0;
+  std::vector<std::vector<double>> concs;
+  for (bool multithreaded : {false, true}) {
+    options.pixel.enableMultiThreading = multithreaded;
+    s.getSimulationData().clear();
+    simulate::Simulation simSpectral(s);
+    simSpectral.doTimesteps(2.0);
+    REQUIRE(simSpectral.errorMessage().empty());
+    for (std::size_t is = 0; is < 2; ++is) {
+      CAPTURE(is);
+      auto c{simSpectral.getConc(1, 0, is)};
+      REQUIRE(c.size() == cRef[is].size());
+      for (std::size_t i = 0; i < c.size(); ++i) {
+        REQUIRE(c[i] == Catch::Approx(cRef[is][i]).epsilon(1e-5));
+      }
+    }
+    concs.push_back(simSpectral.getConc(1, 0, 1));
+  }
+  REQUIRE(concs[1] == concs[0]);
+}
+
+TEST_CASE("Pixel simulator: steady state",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  auto s{getTestModel("small-single-compartment-diffusion")};
+  s.getSpecies().setAnalyticConcentration("slow", "cos(x/3) + 2");
+  s.getSpecies().setAnalyticConcentration("fast", "cos(x/5) + cos(y/2) + 3");
+  auto &options{s.getSimulationSettings().options};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  options.pixel.integrator = simulate::PixelIntegratorType::RK212;
+  // initial total amount of each species
+  std::vector<double> initialSums;
+  {
+    simulate::Simulation sim(s);
+    initialSums = {common::sum(sim.getConc(0, 0, 0)),
+                   common::sum(sim.getConc(0, 0, 1))};
+  }
+  simulate::SteadyStateOptions steadyStateOptions;
+  steadyStateOptions.tolerance = 1e-4;
+  steadyStateOptions.checkInterval = 1.0;
+  steadyStateOptions.maxTime = 1000.0;
+  for (bool newtonPolish : {false, true}) {
+    CAPTURE(newtonPolish);
+    steadyStateOptions.newtonPolish = newtonPolish;
+    s.getSimulationData().clear();
+    simulate::Simulation sim(s);
+    auto result{sim.doSteadyState(steadyStateOptions)};
+    REQUIRE(sim.errorMessage().empty());
+    REQUIRE(result.converged);
+    REQUIRE(result.maxAbsDcdt < steadyStateOptions.tolerance);
+    // a timepoint is stored at each check, stops as soon as converged
+    REQUIRE(sim.getTimePoints().size() > 2);
+    REQUIRE(sim.getTimePoints().back() < steadyStateOptions.maxTime);
+    if (newtonPolish) {
+      REQUIRE(result.newtonIterations > 0);
+      REQUIRE(result.maxAbsDcdt < 1e-8);
+    }
+    // steady state of pure diffusion: uniform concentration, same total amount
+    std::size_t ti{sim.getTimePoints().size() - 1};
+    for (std::size_t is = 0; is < 2; ++is) {
+      CAPTURE(is);
+      auto c{sim.getConc(ti, 0, is)};
+      double avg{initialSums[is] / static_cast<double>(c.size())};
+      REQUIRE(common::sum(c) == Catch::Approx(initialSums[is]).epsilon(1e-6));
+      for (double v : c) {
+        REQUIRE(v == Catch::Approx(avg).epsilon(1e-3));
+      }
+    }
+  }
+}
+
+TEST_CASE("Pixel simulator: ensemble",
+          "[core/simulate/simulate][core/simulate][core][simulate][pixel]") {
+  auto s{getExampleModel(Mod::ABtoC)};
+  s.getSimulationSettings().simulatorType = simulate::SimulatorType::Pixel;
+  s.getParameters().add("kscale");
+  s.getParameters().setExpression("kscale", "1");
+  s.getReactions().setRateExpression("r1", "A * B * k1 * kscale");
+  simulate::EnsembleParameters ensemble{{"kscale"}, {{0.5}, {1.0}, {4.0}}};
+  auto &options{s.getSimulationSettings().options};
+  for (auto integrator : {simulate::PixelIntegratorType::RK101,
+                          simulate::PixelIntegratorType::RK212}) {
+    CAPTURE(integrator);
+    options.pixel.integrator = integrator;
+    // the same simulation for each parameter set
+    std::vector<std::vector<double>> concs;
+    for (const auto &values : ensemble.values) {
+      s.getParameters().setExpression("kscale", QString::number(values[0]));
+      s.getSimulationData().clear();
+      simulate::Simulation sim(s);
+      sim.doMultipleTimesteps({{2, 0.05}});
+      REQUIRE(sim.errorMessage().empty());
+      for (std::size_t is = 0; is < 3; ++is) {
+        concs.push_back(sim.getConc(2, 0, is));
+      }
+    }
+    s.getParameters().setExpression("kscale", "1");
+    // all parameter sets in a single ensemble simulation
+    for (bool multithreaded : {false, true}) {
+      CAPTURE(multithreaded);
+      options.pixel.enableMultiThreading = multithreaded;
+      simulate::Simulation sim(s, ensemble);
+      REQUIRE(sim.getEnsembleSize() == 3);
+      sim.doMultipleTimesteps({{2, 0.05}});
+      REQUIRE(sim.errorMessage().empty());
+      REQUIRE(sim.getTimePoints().size() == 3);
+      REQUIRE(sim.getEnsembleConc(0, 2, 0, 0) == sim.getConc(2, 0, 0));
+      for (std::size_t member = 0; member < 3; ++member) {
+        for (std::size_t is = 0; is < 3; ++is) {
+          CAPTURE(member);
+          CAPTURE(is);
+          auto c{sim.getEnsembleConc(member, 2, 0, is)};
+          const auto &cSingle{concs[member * 3 + is]};
+          REQUIRE(c.size() == cSingle.size());
+          for (std::size_t ix = 0; ix < c.size(); ++ix) {
+            if (integrator == simulate::PixelIntegratorType::RK101) {
+              // fixed timestep: identical results
+              REQUIRE(c[ix] == dbl_approx(cSingle[ix]));
+            } else {
+              // shared adaptive timestep: same up to the integration error
+              REQUIRE(c[ix] == Catch::Approx(cSingle[ix]).epsilon(1e-3));
+            }
+          }
+        }
+      }
+    }
+    options.pixel.enableMultiThreading = false;
+  }
+  // parameters must be constant global model parameters
+  simulate::Simulation invalid(s, {{"k1"}, {{1.0}}});
+  REQUIRE(!invalid.errorMessage().empty());
+}
+
 TEST_CASE("DUNE: simulation",
           "[core/simulate/simulate][core/simulate][core][simulate][dune]") {
   SECTION("ABtoC model") {
@@ -1099,14 +1829,64 @@ TEST_CASE("PyConc",
   }
 }
 
+TEST_CASE("Pixel time series",
+          "[core/simulate/simulate][core/simulate][core][simulate]") {
+  auto s{getExampleModel(Mod::ABtoC)};
+  simulate::Simulation sim(s);
+  sim.doTimesteps(0.01, 3);
+  const auto *comp{s.getCompartments().getCompartment(
+      sim.getCompartmentIds()[0].c_str())};
+  // a point in the image but outside the compartment
+  const auto &compImg{comp->getCompartmentImage()};
+  QPoint outside{-1, -1};
+  for (int x = 0; x < compImg.width() && outside.x() < 0; ++x) {
+    for (int y = 0; y < compImg.height() && outside.x() < 0; ++y) {
+      if (compImg.pixelIndex(x, y) == 0) {
+        outside = QPoint(x, y);
+      }
+    }
+  }
+  REQUIRE(outside.x() >= 0);
+  std::vector<QPoint> points{comp->getPixel(0), comp->getPixel(123),
+                             QPoint(-1, 0), outside};
+  auto checkTimeSeries = [&]() {
+    REQUIRE(sim.getTimePoints().size() > 1);
+    for (std::size_t is = 0; is < sim.getSpeciesIds(0).size(); ++is) {
+      auto timeSeries{sim.getPixelTimeSeries(0, is, points)};
+      REQUIRE(timeSeries.size() == points.size());
+      for (std::size_t it = 0; it < sim.getTimePoints().size(); ++it) {
+        auto c{sim.getConc(it, 0, is)};
+        REQUIRE(timeSeries[0][it] == dbl_approx(c[0]));
+        REQUIRE(timeSeries[1][it] == dbl_approx(c[123]));
+        // points outside the compartment
+        REQUIRE(timeSeries[2][it] == dbl_approx(0.0));
+        REQUIRE(timeSeries[3][it] == dbl_approx(0.0));
+      }
+    }
+  };
+  // without index
+  REQUIRE(sim.getTimeTraceIndexEnabled() == false);
+  checkTimeSeries();
+  // index of existing timepoints
+  sim.enableTimeTraceIndex();
+  REQUIRE(sim.getTimeTraceIndexEnabled() == true);
+  checkTimeSeries();
+  // index updated with new timepoints
+  sim.doTimesteps(0.01, 80);
+  REQUIRE(sim.getTimePoints().size() == 84);
+  checkTimeSeries();
+}
+
 static double rel_diff(const simulate::SimulationData &a,
                        const simulate::SimulationData &b, std::size_t iTimeA,
                        std::size_t iTimeB) {
   double d{0.0};
   double n{0.0};
-  for (std::size_t iC = 0; iC < a.concentration[iTimeA].size(); ++iC) {
-    const auto &cA{a.concentration[iTimeA][iC]};
-    const auto &cB{b.concentration[iTimeB][iC]};
+  const auto frameA{a.concentration[iTimeA]};
+  const auto frameB{b.concentration[iTimeB]};
+  for (std::size_t iC = 0; iC < frameA.size(); ++iC) {
+    const auto &cA{frameA[iC]};
+    const auto &cB{frameB[iC]};
     // normalise to max conc over all species & points in each compartment
     double norm{*std::max_element(cA.cbegin(), cA.cend())};
     if (norm == 0.0) {
@@ -1609,8 +2389,19 @@ TEST_CASE("Events: setting species concentrations",
     events.setTime("eA_c2", 0.1);
     m1.getSimulationSettings().simulatorType = simType;
     simulate::Simulation sim(m1);
+    sim.enableTimeTraceIndex();
+    const QPoint p1{m1.getCompartments()
+                        .getCompartment(sim.getCompartmentIds()[0].c_str())
+                        ->getPixel(1)};
+    // build the index before the events are applied
+    REQUIRE(sim.getPixelTimeSeries(0, 1, {p1})[0].size() == 1);
     sim.doTimesteps(0.1, 3);
     const auto &data{m1.getSimulationData()};
+    // events are also applied to the time series index
+    const auto B_c1{sim.getPixelTimeSeries(0, 1, {p1})};
+    REQUIRE(B_c1[0].size() == 4);
+    REQUIRE(B_c1[0][1] == dbl_approx(9.0));
+    REQUIRE(B_c1[0][2] == dbl_approx(2.0));
     // t=0.1
     REQUIRE(data.timePoints[1] == dbl_approx(0.1));
     // B_c1=9
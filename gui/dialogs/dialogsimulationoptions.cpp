@@ -19,6 +19,12 @@ static int toIndex(sme::simulate::PixelIntegratorType integrator) {
     return 2;
   case sme::simulate::PixelIntegratorType::RK435:
     return 3;
+  case sme::simulate::PixelIntegratorType::IMEX:
+    return 4;
+  case sme::simulate::PixelIntegratorType::Rosenbrock:
+    return 5;
+  case sme::simulate::PixelIntegratorType::RKC:
+    return 6;
   default:
     return 0;
   }
@@ -34,6 +40,12 @@ static sme::simulate::PixelIntegratorType toPixelIntegratorEnum(int index) {
     return sme::simulate::PixelIntegratorType::RK323;
   case 3:
     return sme::simulate::PixelIntegratorType::RK435;
+  case 4:
+    return sme::simulate::PixelIntegratorType::IMEX;
+  case 5:
+    return sme::simulate::PixelIntegratorType::Rosenbrock;
+  case 6:
+    return sme::simulate::PixelIntegratorType::RKC;
   default:
     return sme::simulate::PixelIntegratorType::RK101;
   }
@@ -181,6 +181,9 @@ void pybindModel(pybind11::module &m) {
            pybind11::arg("continue_existing_simulation") = false,
            pybind11::arg("return_results") = true,
            pybind11::arg("n_threads") = 1,
+           pybind11::arg("steady_state") = false,
+           pybind11::arg("steady_state_tolerance") = 1e-6,
+           pybind11::arg("newton_polish") = false,
            R"(
            returns the results of the simulation.
 
@@ -193,6 +196,9 @@ void pybindModel(pybind11::module &m) {
                continue_existing_simulation (bool): Whether to continue the existing simulation, or start a new simulation. Default value: `False`, i.e. any existing simulation results are discarded before doing the simulation.
                return_results (bool): Whether to return the simulation results. Default value: `True`. If `False`, an empty SimulationResultList is returned.
                n_threads(int): Number of cpu threads to use (for Pixel simulations). Default value is 1, 0 means use all available threads.
+               steady_state (bool): Whether to simulate until a steady state is reached. Default value: `False`. If `True`, the simulation stops when the largest `|dc/dt|` of any species is less than `steady_state_tolerance`, or when the total simulation time has been reached. The image interval is then the interval between steady state checks.
+               steady_state_tolerance (float): The largest `|dc/dt|` of any species at steady state. Default value: `1e-6`.
+               newton_polish (bool): Whether to polish the steady state with a Newton-Krylov solve (for Pixel simulations). Default value: `False`.
 
            Returns:
                SimulationResultList: the results of the simulation
@@ -208,6 +214,9 @@ void pybindModel(pybind11::module &m) {
            pybind11::arg("continue_existing_simulation") = false,
            pybind11::arg("return_results") = true,
            pybind11::arg("n_threads") = 1,
+           pybind11::arg("steady_state") = false,
+           pybind11::arg("steady_state_tolerance") = 1e-6,
+           pybind11::arg("newton_polish") = false,
            R"(
            returns the results of the simulation.
 
@@ -220,6 +229,9 @@ void pybindModel(pybind11::module &m) {
                continue_existing_simulation (bool): Whether to continue the existing simulation, or start a new simulation. Default value: `false`, i.e. any existing simulation results are discarded before doing the simulation.
                return_results (bool): Whether to return the simulation results. Default value: `True`. If `False`, an empty SimulationResultList is returned.
                n_threads(int): Number of cpu threads to use (for Pixel simulations). Default value is 1, 0 means use all available threads.
+               steady_state (bool): Whether to simulate until a steady state is reached. Default value: `False`. If `True`, the simulation stops when the largest `|dc/dt|` of any species is less than `steady_state_tolerance`, or when the total simulation time has been reached. The image interval is then the interval between steady state checks.
+               steady_state_tolerance (float): The largest `|dc/dt|` of any species at steady state. Default value: `1e-6`.
+               newton_polish (bool): Whether to polish the steady state with a Newton-Krylov solve (for Pixel simulations). Default value: `False`.
 
            Returns:
                SimulationResultList: the results of the simulation
@@ -234,6 +246,35 @@ void pybindModel(pybind11::module &m) {
           Returns:
               SimulationResultList: the simulation results
           )")
+      .def("concentration_time_series",
+           &sme::Model::getConcentrationTimeSeries,
+           pybind11::arg("species_name"), pybind11::arg("pixels"),
+           R"(
+          returns the concentration of a species at each simulation timepoint
+          for each of the given pixels.
+
+          The first call for a compartment indexes its existing simulation
+          results by pixel, after which each call for a species in that
+          compartment only reads the values for the given pixels.
+
+          Args:
+              species_name (str): The name of the species
+              pixels (List[Tuple[int, int]]): The ``(x, y)`` pixels, where ``species_concentration[y][x]`` is the concentration at ``(x, y)`` in a :class:`SimulationResult`
+
+          Returns:
+              numpy.ndarray: the concentrations, where ``[i][t]`` is the concentration at pixel ``i`` at timepoint ``t``, zero for pixels outside the compartment of the species
+
+          Raises:
+              InvalidArgument: if the species is not found
+
+          Examples:
+              >>> import sme
+              >>> model = sme.open_example_model()
+              >>> results = model.simulate(0.002, 0.001)
+              >>> c = model.concentration_time_series("B_cell", [(48, 48), (50, 50)])
+              >>> c.shape
+              (2, 3)
+          )")
       .def("__repr__",
            [](const sme::Model &a) {
              return fmt::format("<sme.Model named '{}'>", a.getName());
@@ -351,7 +392,8 @@ Model::simulateString(const std::string &lengths, const std::string &intervals,
                       int timeoutSeconds, bool throwOnTimeout,
                       simulate::SimulatorType simulatorType,
                       bool continueExistingSimulation, bool returnResults,
-                      int nThreads) {
+                      int nThreads, bool steadyState,
+                      double steadyStateTolerance, bool newtonPolish) {
   QElapsedTimer simulationRuntimeTimer;
   simulationRuntimeTimer.start();
   double timeoutMillisecs{static_cast<double>(timeoutSeconds) * 1000.0};
@@ -379,12 +421,28 @@ Model::simulateString(const std::string &lengths, const std::string &intervals,
   if (const auto &e = sim->errorMessage(); !e.empty()) {
     throw SmeRuntimeError(fmt::format("Error in simulation setup: {}", e));
   }
-  sim->doMultipleTimesteps(times.value(), timeoutMillisecs, []() {
+  auto stopRunningCallback{[]() {
     if (PyErr_CheckSignals() != 0) {
       throw pybind11::error_already_set();
     }
     return false;
-  });
+  }};
+  if (steadyState) {
+    // simulation times: maximum time, first interval: time between checks
+    simulate::SteadyStateOptions steadyStateOptions;
+    steadyStateOptions.tolerance = steadyStateTolerance;
+    steadyStateOptions.checkInterval = times->front().second;
+    steadyStateOptions.maxTime = 0;
+    for (auto [n, l] : times.value()) {
+      steadyStateOptions.maxTime += static_cast<double>(n) * l;
+    }
+    steadyStateOptions.newtonPolish = newtonPolish;
+    sim->doSteadyState(steadyStateOptions, timeoutMillisecs,
+                       stopRunningCallback);
+  } else {
+    sim->doMultipleTimesteps(times.value(), timeoutMillisecs,
+                             stopRunningCallback);
+  }
   if (const auto &e = sim->errorMessage(); throwOnTimeout && !e.empty()) {
     throw SmeRuntimeError(fmt::format("Error during simulation: {}", e));
   }
@@ -397,11 +455,13 @@ Model::simulateString(const std::string &lengths, const std::string &intervals,
 std::vector<SimulationResult> Model::simulateFloat(
     double simulationTime, double imageInterval, int timeoutSeconds,
     bool throwOnTimeout, simulate::SimulatorType simulatorType,
-    bool continueExistingSimulation, bool returnResults, int nThreads) {
+    bool continueExistingSimulation, bool returnResults, int nThreads,
+    bool steadyState, double steadyStateTolerance, bool newtonPolish) {
   return simulateString(QString::number(simulationTime, 'g', 17).toStdString(),
                         QString::number(imageInterval, 'g', 17).toStdString(),
                         timeoutSeconds, throwOnTimeout, simulatorType,
-                        continueExistingSimulation, returnResults, nThreads);
+                        continueExistingSimulation, returnResults, nThreads,
+                        steadyState, steadyStateTolerance, newtonPolish);
 }
 
 std::vector<SimulationResult> Model::getSimulationResults() {
@@ -413,6 +473,44 @@ std::vector<SimulationResult> Model::getSimulationResults() {
   return constructSimulationResults(sim.get(), false);
 }
 
+pybind11::array_t<double> Model::getConcentrationTimeSeries(
+    const std::string &speciesName,
+    const std::vector<std::pair<int, int>> &pixels) {
+  if (sim == nullptr) {
+    sim = std::make_unique<simulate::Simulation>(*(s.get()));
+    if (const auto &e{sim->errorMessage()}; !e.empty()) {
+      throw SmeRuntimeError(fmt::format("Error in simulation setup: {}", e));
+    }
+  }
+  if (!sim->getTimeTraceIndexEnabled()) {
+    sim->enableTimeTraceIndex();
+  }
+  std::vector<QPoint> points;
+  points.reserve(pixels.size());
+  for (const auto &[x, y] : pixels) {
+    points.emplace_back(x, y);
+  }
+  for (std::size_t ci = 0; ci < sim->getCompartmentIds().size(); ++ci) {
+    const auto &names{sim->getPyNames(ci)};
+    if (auto iter{std::find(names.cbegin(), names.cend(), speciesName)};
+        iter != names.cend()) {
+      const auto si{static_cast<std::size_t>(iter - names.cbegin())};
+      const auto timeSeries{sim->getPixelTimeSeries(ci, si, points)};
+      const std::size_t nTimepoints{
+          timeSeries.empty() ? 0 : timeSeries.front().size()};
+      std::vector<double> values;
+      values.reserve(pixels.size() * nTimepoints);
+      for (const auto &v : timeSeries) {
+        values.insert(values.end(), v.cbegin(), v.cend());
+      }
+      return as_ndarray(std::move(values),
+                        {static_cast<ssize_t>(pixels.size()),
+                         static_cast<ssize_t>(nTimepoints)});
+    }
+  }
+  throw SmeInvalidArgument(fmt::format("species '{}' not found", speciesName));
+}
+
 std::string Model::getStr() const {
   std::string str("<sme.Model>\n");
   str.append(fmt::format("  - name: '{}'\n", getName()));
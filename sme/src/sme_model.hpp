@@ -10,6 +10,7 @@
 #include <memory>
 #include <pybind11/pybind11.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace sme {
@@ -40,13 +41,18 @@ public:
                  int timeoutSeconds, bool throwOnTimeout,
                  simulate::SimulatorType simulatorType,
                  bool continueExistingSimulation, bool returnResults,
-                 int nThreads);
+                 int nThreads, bool steadyState, double steadyStateTolerance,
+                 bool newtonPolish);
   std::vector<SimulationResult>
   simulateFloat(double simulationTime, double imageInterval, int timeoutSeconds,
                 bool throwOnTimeout, simulate::SimulatorType simulatorType,
                 bool continueExistingSimulation, bool returnResults,
-                int nThreads);
+                int nThreads, bool steadyState, double steadyStateTolerance,
+                bool newtonPolish);
   std::vector<SimulationResult> getSimulationResults();
+  pybind11::array_t<double>
+  getConcentrationTimeSeries(const std::string &speciesName,
+                             const std::vector<std::pair<int, int>> &pixels);
   [[nodiscard]] std::string getStr() const;
 };
 
@@ -181,6 +181,57 @@ class TestModel(unittest.TestCase):
             sim_results2 = m.simulation_results()
             self.assertEqual(len(sim_results2), 3)
 
+    def test_simulate_steady_state(self):
+        m = sme.open_example_model()
+        # zero tolerance is never reached: one result per check until max time
+        sim_results = m.simulate(3, 1, steady_state=True, steady_state_tolerance=0.0)
+        self.assertEqual([r.time_point for r in sim_results], [0.0, 1.0, 2.0, 3.0])
+        dcdt = sim_results[-1].species_dcdt
+        self.assertEqual(len(dcdt), 5)
+        for d in dcdt.values():
+            self.assertEqual(d.shape, (100, 100))
+
+        # any |dc/dt| is below a huge tolerance: stops at the first check
+        sim_results = m.simulate(3, 1, steady_state=True, steady_state_tolerance=1e300)
+        self.assertEqual([r.time_point for r in sim_results], [0.0, 1.0])
+        dcdt = sim_results[-1].species_dcdt
+        self.assertEqual(len(dcdt), 5)
+        max_dcdt = max(np.max(np.abs(d)) for d in dcdt.values())
+
+        # Newton-Krylov polish replaces the last result, and never increases
+        # the largest |dc/dt|
+        sim_results = m.simulate(
+            3, 1, steady_state=True, steady_state_tolerance=1e300, newton_polish=True
+        )
+        self.assertEqual([r.time_point for r in sim_results], [0.0, 1.0])
+        dcdt = sim_results[-1].species_dcdt
+        self.assertEqual(len(dcdt), 5)
+        for d in dcdt.values():
+            self.assertEqual(d.shape, (100, 100))
+        polished_max_dcdt = max(np.max(np.abs(d)) for d in dcdt.values())
+        self.assertLessEqual(polished_max_dcdt, max_dcdt)
+
+    def test_concentration_time_series(self):
+        m = sme.open_example_model()
+        sim_results = m.simulate(0.004, 0.001)
+        # a pixel in the nucleus is in the image but outside the cell
+        y_nucleus, x_nucleus = np.argwhere(m.compartments["Nucleus"].geometry_mask)[0]
+        pixels = [(48, 48), (50, 50), (0, 0), (int(x_nucleus), int(y_nucleus))]
+        c = m.concentration_time_series("B_cell", pixels)
+        self.assertEqual(c.shape, (4, 5))
+        for t, res in enumerate(sim_results):
+            b_cell = res.species_concentration["B_cell"]
+            for i, (x, y) in enumerate(pixels):
+                self.assertAlmostEqual(c[i][t], b_cell[y][x])
+        self.assertTrue(np.all(c[3] == 0))
+        # includes the timepoints of a continued simulation
+        sim_results = m.simulate(0.002, 0.001, continue_existing_simulation=True)
+        c = m.concentration_time_series("B_cell", pixels)
+        self.assertEqual(c.shape, (4, 7))
+        self.assertTrue(np.all(c[3] == 0))
+        with self.assertRaises(sme.InvalidArgument):
+            m.concentration_time_series("not_a_species", pixels)
+
     def test_import_geometry_from_image(self):
         imgfile_original = _get_abs_path("concave-cell-nucleus-100x100.png")
         imgfile_modified = _get_abs_path("modified-concave-cell-nucleus-100x100.png")